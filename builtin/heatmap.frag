@@ -0,0 +1,24 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D frame;
+layout(set = 0, binding = 1, r32ui) uniform readonly uimage2D cost;
+
+layout(push_constant) uniform Heatmap {
+    float low;
+    float high;
+    int cellSide; // framebuffer pixels per cost texel
+} pc;
+
+layout(location = 0) out vec4 outColor;
+
+vec3 ramp(float t) {
+    return clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float value = float(imageLoad(cost, pixel / pc.cellSide).r);
+    float t = clamp((value - pc.low) / max(pc.high - pc.low, 1.0), 0.0, 1.0);
+    float luma = dot(texelFetch(frame, pixel, 0).rgb, vec3(0.2126, 0.7152, 0.0722));
+    outColor = vec4(mix(vec3(luma), ramp(t), 0.7), 1.0);
+}
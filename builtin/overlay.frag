@@ -0,0 +1,43 @@
+#version 450
+
+layout(binding = 0) uniform OverlayValues {
+    vec4 milliseconds[16]; // four cells per element, negative until measured
+} values;
+
+layout(push_constant) uniform OverlayBox {
+    vec4 box;
+    vec2 extent;
+    uint cell;
+} pc;
+
+layout(location = 0) out vec4 outColor;
+
+// 3x5 bitmap digits, top row in the high bits, then the decimal point
+const int glyphs[11] = int[11](31599, 11415, 29671, 29647, 23497, 31183, 31215, 29257, 31727, 31695, 2);
+const int powers[6] = int[6](1, 10, 100, 1000, 10000, 100000);
+const float scale = 3.0;
+
+// glyph at position idx of "ddd.ddd", -1 for a blank leading zero
+int glyphAt(float ms, int idx) {
+    if (idx == 3)
+        return 10;
+    int value = clamp(int(ms * 1000.0 + 0.5), 0, 999999);
+    int place = idx < 3 ? 5 - idx : 6 - idx;
+    if (idx < 2 && value < powers[place])
+        return -1;
+    return (value / powers[place]) % 10;
+}
+
+void main() {
+    float ms = values.milliseconds[pc.cell / 4][pc.cell % 4];
+    ivec2 texel = ivec2(floor((gl_FragCoord.xy - pc.box.xy) / scale)) - ivec2(1);
+    int idx = texel.x / 4;
+    int column = texel.x % 4;
+    vec3 color = vec3(0.0);
+    if (ms >= 0.0 && texel.x >= 0 && texel.y >= 0 && idx < 7 && column < 3 && texel.y < 5) {
+        int glyph = glyphAt(ms, idx);
+        if (glyph >= 0 && ((glyphs[glyph] >> (14 - texel.y * 3 - column)) & 1) != 0)
+            color = vec3(1.0);
+    }
+    outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+layout(push_constant) uniform OverlayBox {
+    vec4 box;    // x, y, width, height in framebuffer pixels
+    vec2 extent; // framebuffer size
+    uint cell;
+} pc;
+
+vec2 positions[6] = vec2[](
+    vec2(-1.0, -1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, 1.0),
+    vec2(1.0, 1.0),
+    vec2(-1.0, -1.0),
+    vec2(1.0, -1.0)
+);
+
+void main() {
+   vec2 pixel = pc.box.xy + (positions[gl_VertexIndex] * 0.5 + 0.5) * pc.box.zw;
+   gl_Position = vec4(pixel / pc.extent * 2.0 - 1.0, 0.0, 1.0);
+}
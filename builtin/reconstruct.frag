@@ -0,0 +1,50 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D evenFrames;
+layout(set = 0, binding = 1) uniform sampler2D oddFrames;
+
+layout(push_constant) uniform Reconstruct {
+    int parity;  // of the frame just shaded
+    int history; // 0 until the other target holds a frame
+} pc;
+
+layout(location = 0) out vec4 outColor;
+
+bool shaded(int parity, ivec2 pixel) {
+    return ((pixel.y + parity) & 1) == (pixel.x & 1);
+}
+
+vec3 fetch(int parity, ivec2 pixel) {
+    ivec2 texel = ivec2(pixel.x >> 1, pixel.y);
+    return parity == 0 ? texelFetch(evenFrames, texel, 0).rgb : texelFetch(oddFrames, texel, 0).rgb;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (shaded(pc.parity, pixel)) {
+        outColor = vec4(fetch(pc.parity, pixel), 1.0);
+        return;
+    }
+
+    ivec2 size = textureSize(evenFrames, 0) * ivec2(2, 1);
+    const ivec2 offsets[4] = ivec2[](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    vec3 lo = vec3(1e30);
+    vec3 hi = vec3(-1e30);
+    vec3 sum = vec3(0.0);
+    float count = 0.0;
+    for (int idx = 0; idx < 4; idx++) {
+        ivec2 neighbour = pixel + offsets[idx];
+        if (any(lessThan(neighbour, ivec2(0))) || any(greaterThanEqual(neighbour, size)))
+            continue;
+        vec3 color = fetch(pc.parity, neighbour);
+        lo = min(lo, color);
+        hi = max(hi, color);
+        sum += color;
+        count += 1.0;
+    }
+
+    vec3 color = count > 0.0 ? sum / count : vec3(0.0);
+    if (pc.history != 0)
+        color = count > 0.0 ? clamp(fetch(1 - pc.parity, pixel), lo, hi) : fetch(1 - pc.parity, pixel);
+    outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D accumulation;
+
+layout(push_constant) uniform Resolve {
+    float scale;
+    int factor;
+} pc;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    ivec2 origin = ivec2(gl_FragCoord.xy) * pc.factor;
+    vec3 sum = vec3(0.0);
+    for (int y = 0; y < pc.factor; y++)
+        for (int x = 0; x < pc.factor; x++)
+            sum += texelFetch(accumulation, origin + ivec2(x, y), 0).rgb;
+    outColor = vec4(sum * (pc.scale / float(pc.factor * pc.factor)), 1.0);
+}
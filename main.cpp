@@ -2,19 +2,57 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <optional>
-#include <shaderc/shaderc.hpp>
+#include <random>
+#include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifndef DISABLE_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+// the builtin shaders, compiled from builtin/ by the Makefile into arrays of spir-v words
+#include "builtin/fullscreen.vert.h"
+#include "builtin/heatmap.frag.h"
+#include "builtin/overlay.frag.h"
+#include "builtin/overlay.vert.h"
+#include "builtin/reconstruct.frag.h"
+#include "builtin/resolve.frag.h"
+
 /*
 
     --- validation layers
@@ -114,27 +152,57 @@ VkDebugUtilsMessengerCreateInfoEXT createDebugInfo()
     --- window
 */
 
+/*
+    A glfw window, or with a headless extent a VK_EXT_headless_surface and no display at all.
+    A headless surface has no size of its own, the swap chain takes the extent this reports, and it never goes
+    out of date; SetHeadlessExtent stands in for the user resizing the window.
+    Further windows can be opened on the instance of the first, which must outlive them.
+*/
 struct Window
 {
-    Window();
+    Window(std::optional<VkExtent2D> headlessExtent = std::nullopt);
+    Window(Window *primary, const std::string &title);
     ~Window();
-    GLFWwindow *window;
+    bool ShouldClose();
+    void FramebufferSize(int &width, int &height);
+    void PollEvents();
+    void WaitEvents();
+    void SetHeadlessExtent(VkExtent2D extent);
+    void RequestSize(VkExtent2D extent);
+
+    GLFWwindow *window; // nullptr when headless
     VkInstance instance;
     VkSurfaceKHR surface;
+    VkExtent2D headlessExtent;
+    bool resized;      // headless extent changed since the swap chain was built, cleared by the application
+    bool ownsInstance; // false for a window opened on the instance of another
 };
 
-Window::Window()
+Window::Window(std::optional<VkExtent2D> headlessExtent)
 {
-    // init glfw
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    window = glfwCreateWindow(800, 600, "Vulkan window", nullptr, nullptr);
+    window = nullptr;
+    this->headlessExtent = headlessExtent.value_or(VkExtent2D{0, 0});
+    resized = false;
+    ownsInstance = true;
 
     // setup extensions
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    if (headlessExtent.has_value())
+    {
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+    }
+    else
+    {
+        // init glfw
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(800, 600, "Vulkan window", nullptr, nullptr);
+
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME); // looks like these two are only needed for macos
     extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
 #ifdef ENABLE_VALIDATION_LAYERS
@@ -204,21 +272,109 @@ Window::Window()
     {
         throw std::runtime_error("[FATAL] could not create vk instance with error \'" + std::to_string(err) + "\'");
     }
-    if (auto err = glfwCreateWindowSurface(instance, window, nullptr, &surface); err != VK_SUCCESS)
+    if (window == nullptr)
+    {
+        auto createHeadlessSurface = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+        VkHeadlessSurfaceCreateInfoEXT surfaceInfo{};
+        surfaceInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+        if (createHeadlessSurface == nullptr)
+            throw std::runtime_error("[FATAL] could not load vkCreateHeadlessSurfaceEXT");
+        if (auto err = createHeadlessSurface(instance, &surfaceInfo, nullptr, &surface); err != VK_SUCCESS)
+            throw std::runtime_error("[FATAL] could not create headless surface \'" + std::to_string(err) + "\'");
+        std::cout << "[INFO] headless surface " << this->headlessExtent.width << "x" << this->headlessExtent.height << std::endl;
+    }
+    else if (auto err = glfwCreateWindowSurface(instance, window, nullptr, &surface); err != VK_SUCCESS)
     {
         throw std::runtime_error("[FATAL] could not create surface \'" + std::to_string(err) + "\'");
     }
 }
 
+Window::Window(Window *primary, const std::string &title)
+{
+    if (primary->window == nullptr)
+        throw std::runtime_error("[FATAL] a headless surface cannot share its instance with a window");
+    instance = primary->instance;
+    headlessExtent = {0, 0};
+    resized = false;
+    ownsInstance = false;
+
+    // glfw is initialised and the no api hint set by the primary window
+    window = glfwCreateWindow(800, 600, title.c_str(), nullptr, nullptr);
+    if (window == nullptr)
+        throw std::runtime_error("[FATAL] could not create window '" + title + "'");
+    if (auto err = glfwCreateWindowSurface(instance, window, nullptr, &surface); err != VK_SUCCESS)
+        throw std::runtime_error("[FATAL] could not create surface '" + std::to_string(err) + "'");
+}
+
 Window::~Window()
 {
     vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!ownsInstance)
+    {
+        glfwDestroyWindow(window);
+        return;
+    }
     vkDestroyInstance(instance, nullptr);
 
+    if (window == nullptr)
+        return;
     glfwDestroyWindow(window);
     glfwTerminate();
 }
 
+// a headless run ends when the application stops it
+bool Window::ShouldClose()
+{
+    return window != nullptr && glfwWindowShouldClose(window);
+}
+
+void Window::FramebufferSize(int &width, int &height)
+{
+    if (window == nullptr)
+    {
+        width = static_cast<int>(headlessExtent.width);
+        height = static_cast<int>(headlessExtent.height);
+        return;
+    }
+    glfwGetFramebufferSize(window, &width, &height);
+}
+
+void Window::PollEvents()
+{
+    if (window != nullptr)
+        glfwPollEvents();
+}
+
+void Window::WaitEvents()
+{
+    if (window != nullptr)
+        glfwWaitEvents();
+}
+
+void Window::SetHeadlessExtent(VkExtent2D extent)
+{
+    resized = resized || extent.width != headlessExtent.width || extent.height != headlessExtent.height;
+    headlessExtent = extent;
+}
+
+// a framebuffer of this many pixels; a window manager may ignore the request, a headless surface cannot
+void Window::RequestSize(VkExtent2D extent)
+{
+    if (window == nullptr)
+    {
+        SetHeadlessExtent(extent);
+        return;
+    }
+    int windowWidth, windowHeight, width, height;
+    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+    glfwGetFramebufferSize(window, &width, &height);
+    if (width == 0 || height == 0)
+        return;
+    glfwSetWindowSize(window,
+                      static_cast<int>(static_cast<int64_t>(extent.width) * windowWidth / width),
+                      static_cast<int>(static_cast<int64_t>(extent.height) * windowHeight / height));
+}
+
 /*
     --- device helpers
 */
@@ -257,6 +413,21 @@ bool isDeviceSuitable(VkPhysicalDevice device, std::vector<const char *> request
     return true;
 }
 
+bool supportsDeviceExtension(VkPhysicalDevice device, const char *name)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (auto availableExtension : availableExtensions)
+    {
+        if (strcmp(name, availableExtension.extensionName) == 0)
+            return true;
+    }
+    return false;
+}
+
 int scoreDevice(VkPhysicalDevice physicalDeviceHandle)
 {
     if (physicalDeviceHandle == VK_NULL_HANDLE)
@@ -380,6 +551,522 @@ uint32_t selectQueueFamilyIndex(VkPhysicalDevice physicalDeviceHandle, VkSurface
     return queueFamily.value().index;
 }
 
+/*
+    --- memory allocator
+*/
+uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties &memProperties, uint32_t typeBits, VkMemoryPropertyFlags flags)
+{
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((typeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & flags) == flags)
+        {
+            return i;
+        }
+    }
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Extent allocations belong to resources that are rebuilt on every resize (uniforms, framebuffer targets).
+//    They are bumped out of an arena and released all at once by ResetExtent.
+// Persistent allocations belong to long-lived resources (textures, lookup buffers) and are released individually.
+enum class AllocationScope
+{
+    Persistent,
+    Extent
+};
+
+// buffers and linear images must not share a bufferImageGranularity sized page with optimal tiled images
+enum class ResourceKind
+{
+    Linear,
+    Optimal
+};
+
+struct MemoryBlock
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void *mapped; // host visible blocks stay mapped for their whole lifetime
+    uint32_t memoryTypeIndex;
+    AllocationScope scope;
+    ResourceKind kind; // persistent blocks only hold one kind of resource
+    bool dedicated;    // one resource too large to share a block
+    uint32_t liveAllocations;
+
+    VkDeviceSize head;     // extent arena bump offset
+    ResourceKind lastKind; // kind of the allocation that ends at head
+
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> freeRanges; // persistent free list of (offset, size) sorted by offset
+};
+
+struct Allocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr;
+    MemoryBlock *block = nullptr;
+    uint64_t id = 0;
+};
+
+// bookkeeping for --memory-report, keyed by Allocation::id
+struct AllocationRecord
+{
+    std::string owner;
+    AllocationScope scope;
+    uint32_t memoryTypeIndex;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+struct HeapBudget
+{
+    VkDeviceSize size;
+    VkDeviceSize budget;     // how much this process may use before the driver starts paging or failing
+    VkDeviceSize usage;      // what the driver reports this process uses, including memory we did not allocate
+    VkDeviceSize blockBytes; // VkDeviceMemory we allocated on this heap
+    VkDeviceSize usedBytes;  // bytes handed out to resources from those blocks
+};
+
+std::string formatBytes(VkDeviceSize bytes)
+{
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024.0 && unit < 4)
+    {
+        value /= 1024.0;
+        unit++;
+    }
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << value << units[unit];
+    return ss.str();
+}
+
+class Allocator
+{
+public:
+    Allocator(VkPhysicalDevice physicalDevice, VkDevice device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2);
+    ~Allocator();
+    Allocation Allocate(VkMemoryRequirements requirements, VkMemoryPropertyFlags flags, AllocationScope scope, ResourceKind kind, std::string owner);
+    Allocation BindBuffer(VkBuffer buffer, VkMemoryPropertyFlags flags, AllocationScope scope, std::string owner);
+    Allocation BindImage(VkImage image, VkMemoryPropertyFlags flags, AllocationScope scope, std::string owner);
+    void Free(Allocation &allocation);
+    void ResetExtent();
+    std::vector<HeapBudget> QueryBudget();
+    std::string BudgetSummary();
+    void Report(std::ostream &out);
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    uint32_t allocationCount; // live VkDeviceMemory objects, bounded by maxMemoryAllocationCount
+
+private:
+    MemoryBlock *createBlock(VkDeviceSize size, uint32_t memoryTypeIndex, AllocationScope scope, ResourceKind kind, bool dedicated);
+    void destroyBlock(MemoryBlock *block);
+    VkDeviceSize preferredBlockSize(uint32_t memoryTypeIndex);
+    bool allocateLinear(MemoryBlock *block, VkMemoryRequirements requirements, ResourceKind kind, Allocation &allocation);
+    bool allocateFreeList(MemoryBlock *block, VkMemoryRequirements requirements, Allocation &allocation);
+
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    // only set when VK_EXT_memory_budget is enabled, otherwise budgets fall back to our own bookkeeping
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2;
+    VkDeviceSize bufferImageGranularity;
+    uint32_t maxMemoryAllocationCount;
+    std::vector<MemoryBlock *> persistentBlocks;
+    std::vector<MemoryBlock *> extentBlocks;
+    std::map<uint64_t, AllocationRecord> records;
+    uint64_t nextAllocationId;
+};
+
+const VkDeviceSize kLargeBlockSize = 64 * 1024 * 1024;
+const VkDeviceSize kHostBlockSize = 4 * 1024 * 1024;
+const VkDeviceSize kSmallHeapSize = 1024 * 1024 * 1024;
+
+Allocator::Allocator(VkPhysicalDevice physicalDevice, VkDevice device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2)
+{
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    this->getMemoryProperties2 = getMemoryProperties2;
+    this->allocationCount = 0;
+    this->nextAllocationId = 1;
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    bufferImageGranularity = std::max<VkDeviceSize>(deviceProperties.limits.bufferImageGranularity, 1);
+    maxMemoryAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+}
+
+Allocator::~Allocator()
+{
+    for (auto block : extentBlocks)
+        destroyBlock(block);
+    extentBlocks.clear();
+
+    for (auto block : persistentBlocks)
+    {
+        if (block->liveAllocations > 0)
+            std::cerr << "[WARN] freeing memory block with " << block->liveAllocations << " live allocations" << std::endl;
+        destroyBlock(block);
+    }
+    persistentBlocks.clear();
+}
+
+VkDeviceSize Allocator::preferredBlockSize(uint32_t memoryTypeIndex)
+{
+    auto memoryType = memProperties.memoryTypes[memoryTypeIndex];
+    auto heapSize = memProperties.memoryHeaps[memoryType.heapIndex].size;
+
+    // uniforms and staging buffers are tiny, don't reserve a large block of host memory for them
+    VkDeviceSize size = (memoryType.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? kLargeBlockSize : kHostBlockSize;
+    if (heapSize <= kSmallHeapSize)
+        size = std::min(size, heapSize / 8);
+    return size;
+}
+
+MemoryBlock *Allocator::createBlock(VkDeviceSize size, uint32_t memoryTypeIndex, AllocationScope scope, ResourceKind kind, bool dedicated)
+{
+    if (allocationCount >= maxMemoryAllocationCount)
+    {
+        throw std::runtime_error("[FATAL] maxMemoryAllocationCount (" + std::to_string(maxMemoryAllocationCount) + ") reached");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    auto block = new MemoryBlock{};
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+    {
+        delete block;
+        throw std::runtime_error("failed to allocate device memory block!");
+    }
+    allocationCount++;
+
+    block->size = size;
+    block->mapped = nullptr;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->scope = scope;
+    block->kind = kind;
+    block->dedicated = dedicated;
+    block->liveAllocations = 0;
+    block->head = 0;
+    block->lastKind = kind;
+    block->freeRanges.push_back({0, size});
+
+    if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+        {
+            vkFreeMemory(device, block->memory, nullptr);
+            allocationCount--;
+            delete block;
+            throw std::runtime_error("failed to map device memory block!");
+        }
+    }
+
+    return block;
+}
+
+void Allocator::destroyBlock(MemoryBlock *block)
+{
+    if (block->mapped != nullptr)
+        vkUnmapMemory(device, block->memory);
+    if (block->memory != VK_NULL_HANDLE)
+        vkFreeMemory(device, block->memory, nullptr);
+    allocationCount--;
+    delete block;
+}
+
+bool Allocator::allocateLinear(MemoryBlock *block, VkMemoryRequirements requirements, ResourceKind kind, Allocation &allocation)
+{
+    auto offset = alignUp(block->head, requirements.alignment);
+    // start a new granularity page if the previous resource in the arena is of the other kind
+    if (block->liveAllocations > 0 && block->lastKind != kind)
+        offset = alignUp(offset, bufferImageGranularity);
+    if (offset + requirements.size > block->size)
+        return false;
+
+    block->head = offset + requirements.size;
+    block->lastKind = kind;
+    allocation.offset = offset;
+    return true;
+}
+
+bool Allocator::allocateFreeList(MemoryBlock *block, VkMemoryRequirements requirements, Allocation &allocation)
+{
+    for (size_t idx = 0; idx < block->freeRanges.size(); idx++)
+    {
+        auto [rangeOffset, rangeSize] = block->freeRanges[idx];
+        auto offset = alignUp(rangeOffset, requirements.alignment);
+        auto padding = offset - rangeOffset;
+        if (padding + requirements.size > rangeSize)
+            continue;
+
+        // split the range into the alignment padding in front and the remainder behind the allocation
+        auto remainder = rangeSize - padding - requirements.size;
+        block->freeRanges.erase(block->freeRanges.begin() + idx);
+        if (remainder > 0)
+            block->freeRanges.insert(block->freeRanges.begin() + idx, {offset + requirements.size, remainder});
+        if (padding > 0)
+            block->freeRanges.insert(block->freeRanges.begin() + idx, {rangeOffset, padding});
+
+        allocation.offset = offset;
+        return true;
+    }
+    return false;
+}
+
+Allocation Allocator::Allocate(VkMemoryRequirements requirements, VkMemoryPropertyFlags flags, AllocationScope scope, ResourceKind kind, std::string owner)
+{
+    auto memoryTypeIndex = findMemoryType(memProperties, requirements.memoryTypeBits, flags);
+    auto blockSize = preferredBlockSize(memoryTypeIndex);
+
+    Allocation allocation{};
+    allocation.size = requirements.size;
+
+    auto &blocks = (scope == AllocationScope::Extent) ? extentBlocks : persistentBlocks;
+    if (requirements.size > blockSize / 2)
+    {
+        // large resources get a block of their own instead of wasting the tail of a shared one
+        allocation.block = createBlock(requirements.size, memoryTypeIndex, scope, kind, true);
+        allocation.block->freeRanges.clear();
+        blocks.push_back(allocation.block);
+    }
+    else
+    {
+        for (auto block : blocks)
+        {
+            if (block->dedicated || block->memoryTypeIndex != memoryTypeIndex)
+                continue;
+            if (scope == AllocationScope::Extent && allocateLinear(block, requirements, kind, allocation))
+            {
+                allocation.block = block;
+                break;
+            }
+            if (scope == AllocationScope::Persistent && block->kind == kind && allocateFreeList(block, requirements, allocation))
+            {
+                allocation.block = block;
+                break;
+            }
+        }
+
+        if (allocation.block == nullptr)
+        {
+            auto block = createBlock(blockSize, memoryTypeIndex, scope, kind, false);
+            blocks.push_back(block);
+            bool fits = (scope == AllocationScope::Extent) ? allocateLinear(block, requirements, kind, allocation) : allocateFreeList(block, requirements, allocation);
+            if (!fits)
+                throw std::runtime_error("failed to sub-allocate from a new memory block!");
+            allocation.block = block;
+        }
+    }
+
+    allocation.block->liveAllocations++;
+    allocation.memory = allocation.block->memory;
+    if (allocation.block->mapped != nullptr)
+        allocation.mapped = static_cast<char *>(allocation.block->mapped) + allocation.offset;
+
+    allocation.id = nextAllocationId++;
+    records[allocation.id] = {owner, scope, memoryTypeIndex, allocation.offset, allocation.size};
+
+    return allocation;
+}
+
+Allocation Allocator::BindBuffer(VkBuffer buffer, VkMemoryPropertyFlags flags, AllocationScope scope, std::string owner)
+{
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    auto allocation = Allocate(memRequirements, flags, scope, ResourceKind::Linear, owner);
+    if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+        throw std::runtime_error("failed to bind buffer memory!");
+
+    return allocation;
+}
+
+Allocation Allocator::BindImage(VkImage image, VkMemoryPropertyFlags flags, AllocationScope scope, std::string owner)
+{
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    auto allocation = Allocate(memRequirements, flags, scope, ResourceKind::Optimal, owner);
+    if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+        throw std::runtime_error("failed to bind image memory!");
+
+    return allocation;
+}
+
+void Allocator::Free(Allocation &allocation)
+{
+    auto block = allocation.block;
+    if (block == nullptr)
+        return;
+    allocation.block = nullptr;
+    block->liveAllocations--;
+    records.erase(allocation.id);
+
+    // a dedicated block holds only this allocation, whatever its scope
+    if (block->dedicated)
+    {
+        auto &scopeBlocks = block->scope == AllocationScope::Extent ? extentBlocks : persistentBlocks;
+        scopeBlocks.erase(std::find(scopeBlocks.begin(), scopeBlocks.end(), block));
+        destroyBlock(block);
+        return;
+    }
+
+    // shared extent memory is only reclaimed by ResetExtent
+    if (block->scope == AllocationScope::Extent)
+        return;
+
+    // return the range to the free list and merge it with its neighbours
+    auto it = std::lower_bound(block->freeRanges.begin(), block->freeRanges.end(), std::make_pair(allocation.offset, allocation.size));
+    it = block->freeRanges.insert(it, {allocation.offset, allocation.size});
+    if (it + 1 != block->freeRanges.end() && it->first + it->second == (it + 1)->first)
+    {
+        it->second += (it + 1)->second;
+        block->freeRanges.erase(it + 1);
+    }
+    if (it != block->freeRanges.begin() && (it - 1)->first + (it - 1)->second == it->first)
+    {
+        (it - 1)->second += it->second;
+        block->freeRanges.erase(it);
+    }
+}
+
+void Allocator::ResetExtent()
+{
+    std::vector<MemoryBlock *> keep;
+    for (auto block : extentBlocks)
+    {
+        if (block->liveAllocations > 0)
+            std::cerr << "[WARN] resetting extent memory block with " << block->liveAllocations << " live allocations" << std::endl;
+
+        if (block->dedicated)
+        {
+            destroyBlock(block);
+            continue;
+        }
+        block->head = 0;
+        block->liveAllocations = 0;
+        keep.push_back(block);
+    }
+    extentBlocks = keep;
+
+    for (auto it = records.begin(); it != records.end();)
+    {
+        if (it->second.scope == AllocationScope::Extent)
+            it = records.erase(it);
+        else
+            it++;
+    }
+}
+
+std::vector<HeapBudget> Allocator::QueryBudget()
+{
+    std::vector<HeapBudget> heaps(memProperties.memoryHeapCount, HeapBudget{});
+    for (uint32_t heapIdx = 0; heapIdx < memProperties.memoryHeapCount; heapIdx++)
+        heaps[heapIdx].size = memProperties.memoryHeaps[heapIdx].size;
+
+    for (auto blocks : {&persistentBlocks, &extentBlocks})
+    {
+        for (auto block : *blocks)
+            heaps[memProperties.memoryTypes[block->memoryTypeIndex].heapIndex].blockBytes += block->size;
+    }
+    for (const auto &[id, record] : records)
+        heaps[memProperties.memoryTypes[record.memoryTypeIndex].heapIndex].usedBytes += record.size;
+
+    if (getMemoryProperties2 != nullptr)
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2KHR memProperties2{};
+        memProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memProperties2.pNext = &budgetProperties;
+        getMemoryProperties2(physicalDevice, &memProperties2);
+
+        for (uint32_t heapIdx = 0; heapIdx < memProperties.memoryHeapCount; heapIdx++)
+        {
+            heaps[heapIdx].budget = budgetProperties.heapBudget[heapIdx];
+            heaps[heapIdx].usage = budgetProperties.heapUsage[heapIdx];
+        }
+    }
+    else
+    {
+        // without the extension all we know is what we allocated ourselves
+        for (auto &heap : heaps)
+        {
+            heap.budget = heap.size;
+            heap.usage = heap.blockBytes;
+        }
+    }
+
+    return heaps;
+}
+
+std::string Allocator::BudgetSummary()
+{
+    std::stringstream ss;
+    auto heaps = QueryBudget();
+    for (size_t heapIdx = 0; heapIdx < heaps.size(); heapIdx++)
+    {
+        if (heapIdx > 0)
+            ss << " ";
+        ss << "heap" << heapIdx << " " << formatBytes(heaps[heapIdx].usage) << "/" << formatBytes(heaps[heapIdx].budget);
+    }
+    return ss.str();
+}
+
+void Allocator::Report(std::ostream &out)
+{
+    out << "[INFO] memory report (" << (getMemoryProperties2 != nullptr ? "VK_EXT_memory_budget" : "tracked allocations only") << ")" << std::endl;
+
+    auto heaps = QueryBudget();
+    for (size_t heapIdx = 0; heapIdx < heaps.size(); heapIdx++)
+    {
+        const auto &heap = heaps[heapIdx];
+        out << "  heap " << heapIdx
+            << ((memProperties.memoryHeaps[heapIdx].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " device local" : " host")
+            << " size " << formatBytes(heap.size)
+            << " budget " << formatBytes(heap.budget)
+            << " usage " << formatBytes(heap.usage)
+            << " blocks " << formatBytes(heap.blockBytes)
+            << " used " << formatBytes(heap.usedBytes) << std::endl;
+    }
+    out << "  " << allocationCount << " of " << maxMemoryAllocationCount << " device memory allocations" << std::endl;
+
+    std::map<std::string, std::pair<size_t, VkDeviceSize>> owners;
+    for (const auto &[id, record] : records)
+    {
+        owners[record.owner].first++;
+        owners[record.owner].second += record.size;
+    }
+    for (const auto &[owner, total] : owners)
+    {
+        out << "  " << owner << ": " << total.first << " allocations, " << formatBytes(total.second) << std::endl;
+        for (const auto &[id, record] : records)
+        {
+            if (record.owner != owner)
+                continue;
+            out << "    #" << id
+                << " " << (record.scope == AllocationScope::Extent ? "extent" : "persistent")
+                << " heap " << memProperties.memoryTypes[record.memoryTypeIndex].heapIndex
+                << " type " << record.memoryTypeIndex
+                << " offset " << record.offset
+                << " size " << formatBytes(record.size) << std::endl;
+        }
+    }
+}
+
 struct Device
 {
     VkPhysicalDevice physicalDevice;
@@ -387,11 +1074,23 @@ struct Device
     VkPhysicalDeviceProperties deviceProperties;
     VkFence memoryTransferFence;
     VkCommandPool commandPoolHandle;
+    VkPipelineCache pipelineCache; // the shaders' pipelines are built through it, a second window of one shader compiles nothing
     VkQueue graphicsQueue;
     VkQueue presentQueue;
     int selectedQueue;
     uint32_t queueFamilyIndex;
     VkDevice handle;
+    Allocator *allocator;
+    bool memoryBudgetSupported;
+    bool presentWaitSupported; // VK_KHR_present_id + VK_KHR_present_wait
+    PFN_vkWaitForPresentKHR waitForPresent;
+    bool timestampsSupported; // the selected queue family can write timestamps
+    uint32_t timestampValidBits;
+    bool timelineSemaphoreSupported;       // VK_KHR_timeline_semaphore
+    bool shaderClockSupported;             // VK_KHR_shader_clock subgroup clock, with fragment shader stores to write what it reads
+    bool graphicsPipelineLibrarySupported; // VK_KHR_pipeline_library + VK_EXT_graphics_pipeline_library
+    PFN_vkWaitSemaphoresKHR waitSemaphores;
+    PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue;
 
     Device(VkInstance instance, VkSurfaceKHR surface);
     ~Device();
@@ -405,6 +1104,15 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
         "VK_KHR_portability_subset",
 #endif
         VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // enabled when the selected device has them
+    const std::vector<const char *> optionalDeviceExtensions = {
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+        VK_KHR_PRESENT_ID_EXTENSION_NAME,
+        VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+        VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+        VK_KHR_SHADER_CLOCK_EXTENSION_NAME,
+        VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+        VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME};
 
     /*
         create physical device
@@ -448,11 +1156,65 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
         throw std::runtime_error("[FATAL] no suitable devices found");
     }
 
+    std::vector<const char *> enabledDeviceExtensions = requestedDeviceExtensions;
+    for (auto name : optionalDeviceExtensions)
+    {
+        if (supportsDeviceExtension(physicalDevice, name))
+        {
+            std::cout << "[DEBUG] enabling optional device extension " << name << std::endl;
+            enabledDeviceExtensions.push_back(name);
+        }
+    }
+    auto extensionEnabled = [&](const char *name)
+    {
+        return std::find_if(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), [&](const char *enabled)
+                            { return strcmp(enabled, name) == 0; }) != enabledDeviceExtensions.end();
+    };
+    memoryBudgetSupported = extensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    /*
+        query extension features
+    */
+    // VK_KHR_get_physical_device_properties2 is always enabled on the instance, see Window::Window
+    auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+    libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    VkPhysicalDeviceShaderClockFeaturesKHR clockFeatures{};
+    clockFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_CLOCK_FEATURES_KHR;
+    clockFeatures.pNext = &libraryFeatures;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timelineFeatures.pNext = &clockFeatures;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = &timelineFeatures;
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    VkPhysicalDeviceFeatures2KHR supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &presentIdFeatures;
+    if (getFeatures2 != nullptr)
+        getFeatures2(physicalDevice, &supportedFeatures);
+
+    presentWaitSupported = extensionEnabled(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+                           extensionEnabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) &&
+                           presentIdFeatures.presentId &&
+                           presentWaitFeatures.presentWait;
+    timelineSemaphoreSupported = extensionEnabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) && timelineFeatures.timelineSemaphore;
+    shaderClockSupported = extensionEnabled(VK_KHR_SHADER_CLOCK_EXTENSION_NAME) &&
+                           clockFeatures.shaderSubgroupClock &&
+                           supportedFeatures.features.fragmentStoresAndAtomics;
+    graphicsPipelineLibrarySupported = extensionEnabled(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+                                       extensionEnabled(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+                                       libraryFeatures.graphicsPipelineLibrary;
+
     /*
         create queue
     */
     // create a queue from a queue family that supports graphics capabilities
-    auto queueFamilyIndex = selectQueueFamilyIndex(physicalDevice, surface);
+    queueFamilyIndex = selectQueueFamilyIndex(physicalDevice, surface);
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     VkDeviceQueueCreateInfo queueCreateInfo{};
     queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -470,6 +1232,14 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
     selectedQueue = 0;
     queueFamilyIndex = queueCreateInfos[selectedQueue].queueFamilyIndex;
 
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    timestampValidBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+    timestampsSupported = timestampValidBits > 0 && deviceProperties.limits.timestampPeriod > 0.0f;
+
     /*
         create virtual device
     */
@@ -478,19 +1248,69 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
     // deviceFeatures.depthClamp = true;
     deviceFeatures.samplerAnisotropy = VK_TRUE; // @@@ config parameter; is this a bug? do i need to query the device features?
     deviceFeatures.sampleRateShading = VK_TRUE; // @@@ config parameter
+    deviceFeatures.fragmentStoresAndAtomics = shaderClockSupported ? VK_TRUE : VK_FALSE;
 
-    // specify extensions and validation layers
-    VkDeviceCreateInfo deviceCreateInfo{};
-    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-    deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-    deviceCreateInfo.ppEnabledExtensionNames = requestedDeviceExtensions.data();
-    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(requestedDeviceExtensions.size());
-    deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+    // extension features are chained behind VkPhysicalDeviceFeatures2, which then replaces pEnabledFeatures
+    VkPhysicalDeviceFeatures2KHR enabledFeatures{};
+    enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    enabledFeatures.features = deviceFeatures;
+    void **featureChain = &enabledFeatures.pNext;
 
-    // these fields are ignored by up to date implementaitons of vulkan because validation layers are only set at the instance level
-    // createInfo.enabledLayerCount
-    // createInfo.ppEnabledExtensionNames
+    VkPhysicalDevicePresentIdFeaturesKHR enabledPresentId{};
+    VkPhysicalDevicePresentWaitFeaturesKHR enabledPresentWait{};
+    if (presentWaitSupported)
+    {
+        enabledPresentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        enabledPresentId.presentId = VK_TRUE;
+        *featureChain = &enabledPresentId;
+        featureChain = &enabledPresentId.pNext;
+
+        enabledPresentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        enabledPresentWait.presentWait = VK_TRUE;
+        *featureChain = &enabledPresentWait;
+        featureChain = &enabledPresentWait.pNext;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR enabledTimeline{};
+    if (timelineSemaphoreSupported)
+    {
+        enabledTimeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        enabledTimeline.timelineSemaphore = VK_TRUE;
+        *featureChain = &enabledTimeline;
+        featureChain = &enabledTimeline.pNext;
+    }
+
+    VkPhysicalDeviceShaderClockFeaturesKHR enabledClock{};
+    if (shaderClockSupported)
+    {
+        enabledClock.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_CLOCK_FEATURES_KHR;
+        enabledClock.shaderSubgroupClock = VK_TRUE;
+        *featureChain = &enabledClock;
+        featureChain = &enabledClock.pNext;
+    }
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT enabledLibrary{};
+    if (graphicsPipelineLibrarySupported)
+    {
+        enabledLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        enabledLibrary.graphicsPipelineLibrary = VK_TRUE;
+        *featureChain = &enabledLibrary;
+        featureChain = &enabledLibrary.pNext;
+    }
+
+    // specify extensions and validation layers
+    VkDeviceCreateInfo deviceCreateInfo{};
+    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+    deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+    deviceCreateInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledDeviceExtensions.size());
+    deviceCreateInfo.pNext = &enabledFeatures;
+    deviceCreateInfo.pEnabledFeatures = nullptr;
+
+    // these fields are ignored by up to date implementaitons of vulkan because validation layers are only set at the instance level
+    // createInfo.enabledLayerCount
+    // createInfo.ppEnabledExtensionNames
     if (vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &handle) != VK_SUCCESS)
     {
         std::runtime_error("[FATAL] could not create logical device");
@@ -509,6 +1329,11 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
         throw std::runtime_error("failed to create command pool!");
     }
 
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(handle, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+        throw std::runtime_error("failed to create pipeline cache!");
+
     VkFenceCreateInfo fenceInfo{};
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
@@ -517,10 +1342,32 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
 
     vkGetDeviceQueue(handle, queueFamilyIndex, selectedQueue, &graphicsQueue);
     vkGetDeviceQueue(handle, queueFamilyIndex, selectedQueue, &presentQueue);
+
+    waitForPresent = nullptr;
+    if (presentWaitSupported)
+        waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(handle, "vkWaitForPresentKHR");
+
+    waitSemaphores = nullptr;
+    getSemaphoreCounterValue = nullptr;
+    if (timelineSemaphoreSupported)
+    {
+        waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(handle, "vkWaitSemaphoresKHR");
+        getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(handle, "vkGetSemaphoreCounterValueKHR");
+    }
+
+    // VK_KHR_get_physical_device_properties2 is always enabled on the instance, see Window::Window
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+    if (memoryBudgetSupported)
+        getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    allocator = new Allocator(physicalDevice, handle, getMemoryProperties2);
 }
 
 Device::~Device()
 {
+    if (this->allocator != nullptr)
+        delete this->allocator;
+    this->allocator = nullptr;
+
     if (this->memoryTransferFence != VK_NULL_HANDLE)
         vkDestroyFence(this->handle, this->memoryTransferFence, nullptr);
     this->memoryTransferFence = VK_NULL_HANDLE;
@@ -529,11 +1376,55 @@ Device::~Device()
         vkDestroyCommandPool(this->handle, this->commandPoolHandle, nullptr);
     this->commandPoolHandle = VK_NULL_HANDLE;
 
+    if (this->pipelineCache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(this->handle, this->pipelineCache, nullptr);
+    this->pipelineCache = VK_NULL_HANDLE;
+
     if (this->handle != VK_NULL_HANDLE)
         vkDestroyDevice(this->handle, nullptr);
     this->handle = VK_NULL_HANDLE;
 }
 
+// the device was chosen for the first window's surface, any other has to be checked before it gets a swap chain
+bool surfaceSupported(Device *device, VkSurfaceKHR surface)
+{
+    VkBool32 supported = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(device->physicalDevice, device->queueFamilyIndex, surface, &supported);
+    return supported == VK_TRUE;
+}
+
+// records a command buffer on the device's command pool, submits it and waits for it to finish
+void submitOneShot(Device *device, const std::function<void(VkCommandBuffer)> &record)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = device->commandPoolHandle;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device->handle, &allocInfo, &commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    record(commandBuffer);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    vkResetFences(device->handle, 1, &device->memoryTransferFence);
+    if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo, device->memoryTransferFence) != VK_SUCCESS)
+        throw std::runtime_error("failed to submit one-shot command buffer!");
+    vkWaitForFences(device->handle, 1, &device->memoryTransferFence, VK_TRUE, UINT64_MAX);
+    vkFreeCommandBuffers(device->handle, device->commandPoolHandle, 1, &commandBuffer);
+}
+
 /*
     --- swap chain helpers
 */
@@ -580,8 +1471,47 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>
 // VK_PRESENT_MODE_MAILBOX_KHR is a very nice trade-off if energy usage is not a concern
 //     It allows us to avoid tearing while still maintaining a fairly low latency by rendering new images
 //     that are as up-to-date as possible right until the vertical blank.
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
+std::string presentModeName(VkPresentModeKHR mode)
+{
+    switch (mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo-relaxed";
+    default:
+        return "unknown (" + std::to_string(mode) + ")";
+    }
+}
+
+std::optional<VkPresentModeKHR> parsePresentMode(std::string name)
+{
+    for (auto mode : {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR})
+    {
+        if (presentModeName(mode) == name)
+            return mode;
+    }
+    return std::nullopt;
+}
+
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes, std::optional<VkPresentModeKHR> requestedPresentMode)
 {
+    // use the requested mode if the surface supports it
+    if (requestedPresentMode.has_value())
+    {
+        for (const auto &availablePresentMode : availablePresentModes)
+        {
+            if (availablePresentMode == requestedPresentMode.value())
+            {
+                return availablePresentMode;
+            }
+        }
+        std::cerr << "[WARN] present mode " << presentModeName(requestedPresentMode.value()) << " not supported by surface" << std::endl;
+    }
     // use VK_PRESENT_MODE_MAILBOX_KHR if it is available
     for (const auto &availablePresentMode : availablePresentModes)
     {
@@ -613,16 +1543,17 @@ public:
     VkSurfaceFormatKHR surfaceFormat;
     VkPresentModeKHR presentMode;
 
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> imageFenceHandles;
+    std::vector<VkSemaphore> imageAvailableSemaphores; // per acquire, cycled by frame number
+    std::vector<VkSemaphore> renderFinishedSemaphores; // per swapchain image, waited on by its present
 
     SwapChain(
         VkSurfaceKHR surface,
         VkPhysicalDevice physicalDevice,
         VkDevice device,
         uint32_t width,
-        uint32_t height);
+        uint32_t height,
+        std::optional<VkPresentModeKHR> requestedPresentMode,
+        VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
 
     ~SwapChain();
 
@@ -635,7 +1566,9 @@ SwapChain::SwapChain(
     VkPhysicalDevice physicalDevice,
     VkDevice device,
     uint32_t width,
-    uint32_t height)
+    uint32_t height,
+    std::optional<VkPresentModeKHR> requestedPresentMode,
+    VkSwapchainKHR oldSwapchain)
 {
     //
     this->device = device;
@@ -689,7 +1622,8 @@ SwapChain::SwapChain(
     */
     extent = chooseSwapExtent(capabilities, width, height);
     surfaceFormat = chooseSwapSurfaceFormat(surfaceFormats);
-    presentMode = chooseSwapPresentMode(presentModes);
+    presentMode = chooseSwapPresentMode(presentModes, requestedPresentMode);
+    std::cout << "[DEBUG] present mode " << presentModeName(presentMode) << std::endl;
 
     // number of images in the swap chain
     uint32_t imageCount = capabilities.minImageCount + 1;
@@ -721,8 +1655,8 @@ SwapChain::SwapChain(
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; // specifies if the alpha channel should be used for blending with other windows in the window system.
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE; // we don't care about the color of pixels that are obscured, for example because another window is in front of them.
-    // @@@ todo: handle oldSwapchain?
-    createInfo.oldSwapchain = VK_NULL_HANDLE; // he window was resized. In that case the swap chain actually needs to be recreated from scratch and a reference to the old one must be specified in this field.
+    // the window was resized: the old swap chain is retired and can hand its resources over to this one
+    createInfo.oldSwapchain = oldSwapchain;
 
     if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &handle) != VK_SUCCESS)
     {
@@ -741,7 +1675,6 @@ SwapChain::SwapChain(
     this->imageViewHandles.resize(numImages);
     this->imageAvailableSemaphores.resize(numImages);
     this->renderFinishedSemaphores.resize(numImages);
-    this->imageFenceHandles.resize(numImages);
 
     for (size_t idx = 0; idx < this->imageHandles.size(); idx++)
     {
@@ -774,12 +1707,6 @@ SwapChain::SwapChain(
         {
             throw std::runtime_error("failed to create render finished semaphore!");
         }
-
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        if (vkCreateFence(device, &fenceInfo, nullptr, &this->imageFenceHandles[idx]) != VK_SUCCESS)
-            throw std::runtime_error("failed to create submit fence!");
     }
 }
 
@@ -803,15 +1730,6 @@ SwapChain::~SwapChain()
     }
     renderFinishedSemaphores.clear();
 
-    for (auto submitFence : imageFenceHandles)
-    {
-        if (submitFence != VK_NULL_HANDLE)
-        {
-            vkDestroyFence(device, submitFence, nullptr);
-        }
-    }
-    imageFenceHandles.clear();
-
     for (auto imageViewHandle : this->imageViewHandles)
     {
         if (imageViewHandle != VK_NULL_HANDLE)
@@ -826,8 +1744,188 @@ SwapChain::~SwapChain()
     this->handle = VK_NULL_HANDLE;
 }
 
-std::vector<uint32_t> compileSpriv(std::string src, shaderc_shader_kind kind)
+/*
+    --- frame timeline
+*/
+/*
+    Counts submitted frames and tells when each has finished on the gpu. Frame n signals value n on a
+    timeline semaphore; without VK_KHR_timeline_semaphore a ring of one fence per frame in flight stands in,
+    which works because no more than framesInFlight frames are ever outstanding.
+    Destruction of anything the gpu may still read can be deferred until the current frame has finished.
+*/
+class FrameTimeline
+{
+public:
+    FrameTimeline(Device *device, uint32_t framesInFlight);
+    ~FrameTimeline();
+    uint64_t Completed();
+    void Wait(uint64_t frame);
+    uint64_t Submit(VkSubmitInfo submitInfo);
+    void Defer(std::function<void()> destroy);
+    void Collect();
+
+    uint32_t framesInFlight;
+    uint64_t submitted; // frames numbered from 1, 0 is complete before anything is submitted
+
+private:
+    Device *device;
+    VkSemaphore semaphore;     // timeline, VK_NULL_HANDLE when falling back to fences
+    std::vector<VkFence> fences; // frame n signals fences[n % framesInFlight]
+    uint64_t completed;        // highest frame known to have finished
+    std::deque<std::pair<uint64_t, std::function<void()>>> deferred;
+};
+
+FrameTimeline::FrameTimeline(Device *device, uint32_t framesInFlight)
+{
+    this->device = device;
+    this->framesInFlight = framesInFlight;
+    submitted = 0;
+    completed = 0;
+    semaphore = VK_NULL_HANDLE;
+
+    if (device->timelineSemaphoreSupported)
+    {
+        VkSemaphoreTypeCreateInfoKHR typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(device->handle, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+            throw std::runtime_error("failed to create timeline semaphore!");
+        std::cout << "[DEBUG] frame sync on a timeline semaphore, " << framesInFlight << " frames in flight" << std::endl;
+        return;
+    }
+
+    fences.resize(framesInFlight);
+    for (auto &fence : fences)
+    {
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device->handle, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+            throw std::runtime_error("failed to create submit fence!");
+    }
+    std::cout << "[DEBUG] frame sync on fences, " << framesInFlight << " frames in flight" << std::endl;
+}
+
+FrameTimeline::~FrameTimeline()
+{
+    // everything deferred is released, the caller has drained the queue
+    for (auto &entry : deferred)
+        entry.second();
+    deferred.clear();
+
+    if (semaphore != VK_NULL_HANDLE)
+        vkDestroySemaphore(device->handle, semaphore, nullptr);
+    semaphore = VK_NULL_HANDLE;
+    for (auto fence : fences)
+        vkDestroyFence(device->handle, fence, nullptr);
+    fences.clear();
+}
+
+uint64_t FrameTimeline::Completed()
+{
+    if (semaphore != VK_NULL_HANDLE)
+    {
+        device->getSemaphoreCounterValue(device->handle, semaphore, &completed);
+        return completed;
+    }
+    while (completed < submitted && vkGetFenceStatus(device->handle, fences[(completed + 1) % framesInFlight]) == VK_SUCCESS)
+        completed++;
+    return completed;
+}
+
+void FrameTimeline::Wait(uint64_t frame)
+{
+    if (frame <= completed || frame > submitted)
+        return;
+
+    if (semaphore != VK_NULL_HANDLE)
+    {
+        VkSemaphoreWaitInfoKHR waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &frame;
+        if (device->waitSemaphores(device->handle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("failed to wait for frame " + std::to_string(frame) + "!");
+    }
+    else
+    {
+        // frames finish in submission order, so waiting for this one retires everything before it
+        if (vkWaitForFences(device->handle, 1, &fences[frame % framesInFlight], VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("failed to wait for frame " + std::to_string(frame) + "!");
+    }
+    completed = frame;
+}
+
+// submits on the graphics queue as the next frame and returns its number; binary semaphores in submitInfo are kept
+uint64_t FrameTimeline::Submit(VkSubmitInfo submitInfo)
+{
+    uint64_t frame = submitted + 1;
+    VkFence fence = VK_NULL_HANDLE;
+
+    // the timeline value rides along as one more signal semaphore, binary semaphores ignore their value
+    std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+    std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+    std::vector<uint64_t> waitValues(submitInfo.waitSemaphoreCount, 0);
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    if (semaphore != VK_NULL_HANDLE)
+    {
+        signalSemaphores.push_back(semaphore);
+        signalValues.push_back(frame);
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineInfo.pNext = submitInfo.pNext;
+        timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+    }
+    else
+    {
+        // the fence's previous frame is framesInFlight behind, the caller has normally waited for it already
+        if (frame > framesInFlight)
+            Wait(frame - framesInFlight);
+        fence = fences[frame % framesInFlight];
+        vkResetFences(device->handle, 1, &fence);
+    }
+
+    if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS)
+        throw std::runtime_error("failed to submit draw command buffer!");
+    submitted = frame;
+    return frame;
+}
+
+// destroy runs once every frame submitted so far has finished
+void FrameTimeline::Defer(std::function<void()> destroy)
+{
+    deferred.push_back({submitted, std::move(destroy)});
+}
+
+void FrameTimeline::Collect()
 {
+    if (deferred.empty())
+        return;
+    auto done = Completed();
+    while (!deferred.empty() && deferred.front().first <= done)
+    {
+        deferred.front().second();
+        deferred.pop_front();
+    }
+}
+
+// user shaders are all fragment shaders, the builtin ones never come through here
+std::vector<uint32_t> compileSpriv(std::string src)
+{
+#ifdef DISABLE_SHADERC
+    (void)src;
+    throw std::runtime_error("[FATAL] built without shaderc, only precompiled .spv fragment shaders can be loaded");
+#else
     shaderc::Compiler compiler;
     shaderc::CompileOptions options;
     bool optimize = false;
@@ -837,7 +1935,7 @@ std::vector<uint32_t> compileSpriv(std::string src, shaderc_shader_kind kind)
         options.SetOptimizationLevel(shaderc_optimization_level_size);
 
     shaderc::SpvCompilationResult module =
-        compiler.CompileGlslToSpv(src, kind, "shader_src", options);
+        compiler.CompileGlslToSpv(src, shaderc_glsl_fragment_shader, "shader_src", options);
 
     if (module.GetCompilationStatus() != shaderc_compilation_status_success)
     {
@@ -845,166 +1943,916 @@ std::vector<uint32_t> compileSpriv(std::string src, shaderc_shader_kind kind)
     }
 
     return {module.cbegin(), module.cend()};
+#endif
 }
 
-class RenderPass
+template <size_t N>
+std::vector<uint32_t> builtinSpirv(const uint32_t (&words)[N])
 {
-public:
-    RenderPass(VkDevice device, VkFormat format);
-    ~RenderPass();
-    VkRenderPass handle;
-
-private:
-    VkDevice device;
-};
+    return {words, words + N};
+}
 
-RenderPass::RenderPass(VkDevice device, VkFormat format)
+// a fragment shader compiled ahead of time, e.g. glslangValidator -V shader.frag -o shader.spv
+bool isPrecompiled(const std::string &path)
 {
-    this->device = device;
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".spv") == 0;
+}
 
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = format;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+/*
+    --- spirv reflection
+*/
+// the handful of opcodes, decorations and storage classes the reflection below looks at
+// https://registry.khronos.org/SPIR-V/specs/unified1/SPIRV.html
+namespace spirv
+{
+    const uint32_t MagicNumber = 0x07230203;
 
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    enum Op : uint32_t
+    {
+        OpName = 5,
+        OpMemberName = 6,
+        OpExtInstImport = 11,
+        OpExtInst = 12,
+        OpEntryPoint = 15,
+        OpTypeVoid = 19,
+        OpTypeBool = 20,
+        OpTypeInt = 21,
+        OpTypeFloat = 22,
+        OpTypeVector = 23,
+        OpTypeMatrix = 24,
+        OpTypeImage = 25,
+        OpTypeSampler = 26,
+        OpTypeSampledImage = 27,
+        OpTypeArray = 28,
+        OpTypeRuntimeArray = 29,
+        OpTypeStruct = 30,
+        OpTypePointer = 32,
+        OpConstant = 43,
+        OpFunction = 54,
+        OpFunctionEnd = 56,
+        OpFunctionCall = 57,
+        OpVariable = 59,
+        OpLoad = 61,
+        OpCopyMemory = 63,
+        OpAccessChain = 65,
+        OpInBoundsAccessChain = 66,
+        OpDecorate = 71,
+        OpMemberDecorate = 72,
+        OpImageSampleImplicitLod = 87, // through OpImageRead = 98, every sample, fetch and gather
+        OpImageRead = 98,
+        OpConvertFToU = 109, // conversions through OpBitcast = 124
+        OpBitcast = 124,
+        OpSNegate = 126, // arithmetic through OpSMulExtended = 152
+        OpSMulExtended = 152,
+        OpAny = 154, // relational and logical through OpFUnordGreaterThanEqual = 191
+        OpULessThan = 176,
+        OpSLessThan = 177,
+        OpULessThanEqual = 178,
+        OpSLessThanEqual = 179,
+        OpFOrdLessThan = 184,
+        OpFUnordLessThan = 185,
+        OpFOrdLessThanEqual = 188,
+        OpFUnordLessThanEqual = 189,
+        OpFUnordGreaterThanEqual = 191,
+        OpShiftRightLogical = 194, // bit operations through OpBitCount = 205
+        OpBitCount = 205,
+        OpDPdx = 207, // derivatives through OpFwidthCoarse = 215
+        OpFwidthCoarse = 215,
+        OpLoopMerge = 246,
+        OpLabel = 248,
+        OpBranchConditional = 250,
+        OpSwitch = 251,
+    };
+
+    // GLSL.std.450 extended instructions that run on the special function units
+    enum GlslInstruction : uint32_t
+    {
+        GlslSin = 13, // trigonometric and hyperbolic through GlslAtan2 = 25
+        GlslAtan2 = 25,
+        GlslPow = 26, // exponentials and roots through GlslInverseSqrt = 32
+        GlslInverseSqrt = 32,
+        GlslLength = 66, // length, distance and normalize take a square root
+        GlslDistance = 67,
+        GlslNormalize = 69,
+    };
+
+    enum Decoration : uint32_t
+    {
+        DecorationBlock = 2,
+        DecorationBufferBlock = 3,
+        DecorationArrayStride = 6,
+        DecorationMatrixStride = 7,
+        DecorationBuiltIn = 11,
+        DecorationBinding = 33,
+        DecorationDescriptorSet = 34,
+        DecorationOffset = 35,
+    };
+
+    enum StorageClass : uint32_t
+    {
+        StorageClassUniformConstant = 0,
+        StorageClassInput = 1,
+        StorageClassUniform = 2,
+        StorageClassOutput = 3,
+        StorageClassPushConstant = 9,
+        StorageClassStorageBuffer = 12,
+    };
+
+    // nul terminated, packed four bytes per word
+    std::string literalString(const std::vector<uint32_t> &operands, size_t first)
+    {
+        std::string result;
+        for (size_t idx = first; idx < operands.size(); idx++)
+        {
+            for (int byte = 0; byte < 4; byte++)
+            {
+                char c = static_cast<char>((operands[idx] >> (8 * byte)) & 0xff);
+                if (c == '\0')
+                    return result;
+                result.push_back(c);
+            }
+        }
+        return result;
+    }
+}
 
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
+enum class ScalarKind
+{
+    Float,
+    Int,
+    UInt,
+    Other // bools, matrices, structs
+};
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+struct ReflectedMember
+{
+    std::string name;
+    uint32_t offset;
+    uint32_t size;
+    ScalarKind scalar;
+    uint32_t components;  // 1 for scalars, n for vectors
+    uint32_t arrayLength; // 1 if the member is not an array
+    uint32_t arrayStride;
+    bool used; // the shader reads it through an access chain
+};
 
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+struct ReflectedBlock
+{
+    std::string name; // block type name, e.g. UniformBufferObject
+    uint32_t set;
+    uint32_t binding;
+    uint32_t size;
+    std::vector<ReflectedMember> members;
+};
 
-    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &handle) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create render pass!");
-    }
-}
+// any resource the pipeline layout has to describe
+struct ReflectedBinding
+{
+    std::string name;
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count; // array length, 1 for plain resources
+    uint32_t size;  // block size for buffers, 0 otherwise
+};
 
-RenderPass::~RenderPass()
+struct ShaderReflection
 {
-    if (handle != VK_NULL_HANDLE)
-        vkDestroyRenderPass(device, handle, nullptr);
-    handle = VK_NULL_HANDLE;
-}
+    std::vector<ReflectedBlock> uniformBlocks;
+    std::vector<ReflectedBinding> bindings;
+    uint32_t pushConstantSize;
+};
 
-class Pipeline
+/*
+    Walks the instruction stream once to collect names, decorations, types and variables,
+    then resolves every uniform block variable into its members.
+    A member counts as used when an access chain indexes into it; loading or passing the whole block marks every member used.
+*/
+class SpirvReflector
 {
 public:
-    Pipeline(VkDevice device,
-             VkExtent2D extent,
-             VkRenderPass renderPass,
-             VkDescriptorSetLayout setLayout,
-             std::string fragmentShaderSource);
-    ~Pipeline();
-    VkPipelineLayout layout;
-    VkPipeline handle;
+    SpirvReflector(const std::vector<uint32_t> &words);
+    ShaderReflection Reflect();
 
 private:
-    VkDevice device;
+    struct Instruction
+    {
+        uint32_t opcode;
+        std::vector<uint32_t> operands;
+    };
+
+    uint32_t typeSize(uint32_t typeId);
+    ReflectedMember reflectMember(uint32_t structId, uint32_t memberIdx);
+    bool descriptorType(uint32_t typeId, uint32_t storageClass, VkDescriptorType &type);
+
+    std::map<uint32_t, std::string> names;
+    std::map<std::pair<uint32_t, uint32_t>, std::string> memberNames;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> decorations;                            // (id, decoration) -> first literal
+    std::map<std::pair<uint32_t, std::pair<uint32_t, uint32_t>>, uint32_t> memberDecorations; // (struct, (member, decoration)) -> first literal
+    std::map<uint32_t, Instruction> types;
+    std::map<uint32_t, uint32_t> constants;
+    std::map<uint32_t, std::pair<uint32_t, uint32_t>> variables; // id -> (pointer type, storage class)
+    std::map<uint32_t, std::vector<uint32_t>> accessedMembers;   // variable -> member indices used in access chains
+    std::vector<uint32_t> wholeUses;                             // variables loaded, copied or passed as a whole
 };
-const std::string vertexShaderSource =
-    "#version 450\n"
-    "\n"
-    "vec2 positions[6] = vec2[](\n"
-    "    vec2(-1.0, -1.0),\n"
-    "    vec2(1.0, 1.0),\n"
-    "    vec2(-1.0, 1.0),\n"
-    "    vec2(1.0, 1.0),\n"
-    "    vec2(-1.0, -1.0),\n"
-    "    vec2(1.0, -1.0)\n"
-    ");\n"
-    "\n"
-    "void main() {\n"
-    "   gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);\n"
-    "}\n"
-    "";
-
-Pipeline::Pipeline(VkDevice device, VkExtent2D extent, VkRenderPass renderPass, VkDescriptorSetLayout setLayout, std::string fragmentShaderSource)
-{
-    this->device = device;
-    /*
-        --- set up shaders
-    */
 
-    // vertex shader
+SpirvReflector::SpirvReflector(const std::vector<uint32_t> &words)
+{
+    if (words.size() < 5 || words[0] != spirv::MagicNumber)
+        throw std::runtime_error("[FATAL] not a spir-v module");
 
-    std::vector<uint32_t> vertexShader = compileSpriv(vertexShaderSource, shaderc_glsl_vertex_shader);
+    size_t idx = 5; // skip the header
+    while (idx < words.size())
+    {
+        uint32_t wordCount = words[idx] >> 16;
+        uint32_t opcode = words[idx] & 0xffff;
+        if (wordCount == 0 || idx + wordCount > words.size())
+            throw std::runtime_error("[FATAL] malformed spir-v instruction");
+        std::vector<uint32_t> operands(words.begin() + idx + 1, words.begin() + idx + wordCount);
+        idx += wordCount;
+
+        switch (opcode)
+        {
+        case spirv::OpName:
+            names[operands[0]] = spirv::literalString(operands, 1);
+            break;
+        case spirv::OpMemberName:
+            memberNames[{operands[0], operands[1]}] = spirv::literalString(operands, 2);
+            break;
+        case spirv::OpDecorate:
+            decorations[{operands[0], operands[1]}] = operands.size() > 2 ? operands[2] : 0;
+            break;
+        case spirv::OpMemberDecorate:
+            memberDecorations[{operands[0], {operands[1], operands[2]}}] = operands.size() > 3 ? operands[3] : 0;
+            break;
+        case spirv::OpTypeVoid:
+        case spirv::OpTypeBool:
+        case spirv::OpTypeInt:
+        case spirv::OpTypeFloat:
+        case spirv::OpTypeVector:
+        case spirv::OpTypeMatrix:
+        case spirv::OpTypeImage:
+        case spirv::OpTypeSampler:
+        case spirv::OpTypeSampledImage:
+        case spirv::OpTypeArray:
+        case spirv::OpTypeRuntimeArray:
+        case spirv::OpTypeStruct:
+        case spirv::OpTypePointer:
+            types[operands[0]] = {opcode, std::vector<uint32_t>(operands.begin() + 1, operands.end())};
+            break;
+        case spirv::OpConstant:
+            constants[operands[1]] = operands[2];
+            break;
+        case spirv::OpVariable:
+            variables[operands[1]] = {operands[0], operands[2]};
+            break;
+        case spirv::OpAccessChain:
+        case spirv::OpInBoundsAccessChain:
+            if (operands.size() > 3)
+                accessedMembers[operands[2]].push_back(operands[3]);
+            else
+                wholeUses.push_back(operands[2]);
+            break;
+        case spirv::OpLoad:
+            wholeUses.push_back(operands[2]);
+            break;
+        case spirv::OpCopyMemory:
+            wholeUses.push_back(operands[1]);
+            break;
+        case spirv::OpFunctionCall:
+            for (size_t arg = 3; arg < operands.size(); arg++)
+                wholeUses.push_back(operands[arg]);
+            break;
+        default:
+            break;
+        }
+    }
+}
 
-    VkShaderModule vertShaderModule;
-    VkShaderModuleCreateInfo vertModuleCreateInfo{};
-    vertModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vertModuleCreateInfo.codeSize = vertexShader.size() * sizeof(uint32_t);
-    vertModuleCreateInfo.pCode = vertexShader.data();
-    if (vkCreateShaderModule(device, &vertModuleCreateInfo, nullptr, &vertShaderModule) != VK_SUCCESS)
+uint32_t SpirvReflector::typeSize(uint32_t typeId)
+{
+    const auto &type = types[typeId];
+    switch (type.opcode)
     {
-        throw std::runtime_error("failed to create shader module!");
+    case spirv::OpTypeBool:
+        return 4;
+    case spirv::OpTypeInt:
+    case spirv::OpTypeFloat:
+        return type.operands[0] / 8;
+    case spirv::OpTypeVector:
+        return typeSize(type.operands[0]) * type.operands[1];
+    case spirv::OpTypeMatrix:
+    {
+        // columns are MatrixStride apart, but that decoration sits on the struct member, assume vec4 aligned columns
+        return 16 * type.operands[1];
     }
-    VkPipelineShaderStageCreateInfo vertCreateInfo{};
-    vertCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertCreateInfo.module = vertShaderModule;
-    vertCreateInfo.pName = "main";
+    case spirv::OpTypeArray:
+    {
+        uint32_t length = constants[type.operands[1]];
+        auto stride = decorations.find({typeId, spirv::DecorationArrayStride});
+        return length * (stride != decorations.end() ? stride->second : typeSize(type.operands[0]));
+    }
+    case spirv::OpTypeStruct:
+    {
+        uint32_t size = 0;
+        for (uint32_t member = 0; member < type.operands.size(); member++)
+        {
+            auto offset = memberDecorations[{typeId, {member, spirv::DecorationOffset}}];
+            size = std::max(size, offset + typeSize(type.operands[member]));
+        }
+        return size;
+    }
+    default:
+        return 0;
+    }
+}
 
-    // fragment shader
-    std::vector<uint32_t> fragmentShader = compileSpriv(fragmentShaderSource, shaderc_glsl_fragment_shader);
-    VkShaderModule fragShaderModule;
+ReflectedMember SpirvReflector::reflectMember(uint32_t structId, uint32_t memberIdx)
+{
+    ReflectedMember member{};
+    auto typeId = types[structId].operands[memberIdx];
+    member.name = memberNames[{structId, memberIdx}];
+    member.offset = memberDecorations[{structId, {memberIdx, spirv::DecorationOffset}}];
+    member.size = typeSize(typeId);
+    member.arrayLength = 1;
+    member.arrayStride = 0;
+
+    if (types[typeId].opcode == spirv::OpTypeArray)
+    {
+        member.arrayLength = constants[types[typeId].operands[1]];
+        member.arrayStride = decorations[{typeId, spirv::DecorationArrayStride}];
+        typeId = types[typeId].operands[0];
+    }
 
-    VkShaderModuleCreateInfo fragModuleCreateInfo{};
-    fragModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    fragModuleCreateInfo.codeSize = fragmentShader.size() * sizeof(uint32_t);
-    fragModuleCreateInfo.pCode = fragmentShader.data();
-    if (vkCreateShaderModule(device, &fragModuleCreateInfo, nullptr, &fragShaderModule) != VK_SUCCESS)
+    member.components = 1;
+    if (types[typeId].opcode == spirv::OpTypeVector)
     {
-        throw std::runtime_error("failed to create shader module!");
+        member.components = types[typeId].operands[1];
+        typeId = types[typeId].operands[0];
     }
 
-    VkPipelineShaderStageCreateInfo fragCreateInfo{};
-    fragCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragCreateInfo.module = fragShaderModule;
-    fragCreateInfo.pName = "main";
+    const auto &scalar = types[typeId];
+    if (scalar.opcode == spirv::OpTypeFloat && scalar.operands[0] == 32)
+        member.scalar = ScalarKind::Float;
+    else if (scalar.opcode == spirv::OpTypeInt && scalar.operands[0] == 32)
+        member.scalar = scalar.operands[1] ? ScalarKind::Int : ScalarKind::UInt;
+    else
+        member.scalar = ScalarKind::Other;
 
-    // shader stages
-    std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
-        vertCreateInfo,
-        fragCreateInfo};
+    return member;
+}
 
-    /*
-        --- create pipeline
-    */
+bool SpirvReflector::descriptorType(uint32_t typeId, uint32_t storageClass, VkDescriptorType &type)
+{
+    const uint32_t DimBuffer = 5;
+    const uint32_t DimSubpassData = 6;
+
+    const auto &typeInfo = types[typeId];
+    switch (typeInfo.opcode)
+    {
+    case spirv::OpTypeStruct:
+        if (storageClass == spirv::StorageClassStorageBuffer || decorations.count({typeId, spirv::DecorationBufferBlock}))
+            type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        else
+            type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return true;
+    case spirv::OpTypeSampler:
+        type = VK_DESCRIPTOR_TYPE_SAMPLER;
+        return true;
+    case spirv::OpTypeSampledImage:
+        if (types[typeInfo.operands[0]].operands[1] == DimBuffer)
+            type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        else
+            type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        return true;
+    case spirv::OpTypeImage:
+    {
+        // operands: sampled type, dim, depth, arrayed, multisampled, sampled (1 = with sampler, 2 = storage), format
+        auto dim = typeInfo.operands[1];
+        auto sampled = typeInfo.operands[5];
+        if (dim == DimSubpassData)
+            type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        else if (dim == DimBuffer)
+            type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        else
+            type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+ShaderReflection SpirvReflector::Reflect()
+{
+    ShaderReflection reflection;
+    reflection.pushConstantSize = 0;
+
+    for (const auto &[variableId, variable] : variables)
+    {
+        auto [pointerTypeId, storageClass] = variable;
+        auto pointeeId = types[pointerTypeId].operands[1];
+
+        if (storageClass == spirv::StorageClassPushConstant)
+        {
+            reflection.pushConstantSize = std::max(reflection.pushConstantSize, typeSize(pointeeId));
+            continue;
+        }
+        if (storageClass != spirv::StorageClassUniform &&
+            storageClass != spirv::StorageClassUniformConstant &&
+            storageClass != spirv::StorageClassStorageBuffer)
+            continue;
+
+        ReflectedBinding resource{};
+        resource.name = names[variableId];
+        resource.set = decorations[{variableId, spirv::DecorationDescriptorSet}];
+        resource.binding = decorations[{variableId, spirv::DecorationBinding}];
+        resource.count = 1;
+        auto resourceTypeId = pointeeId;
+        if (types[resourceTypeId].opcode == spirv::OpTypeArray)
+        {
+            resource.count = constants[types[resourceTypeId].operands[1]];
+            resourceTypeId = types[resourceTypeId].operands[0];
+        }
+        else if (types[resourceTypeId].opcode == spirv::OpTypeRuntimeArray)
+        {
+            throw std::runtime_error("[FATAL] runtime sized descriptor array '" + resource.name + "' is not supported");
+        }
+        if (!descriptorType(resourceTypeId, storageClass, resource.type))
+            continue;
+        if (types[resourceTypeId].opcode == spirv::OpTypeStruct)
+            resource.size = typeSize(resourceTypeId);
+        reflection.bindings.push_back(resource);
+
+        if (storageClass != spirv::StorageClassUniform)
+            continue;
+
+        auto structId = pointeeId;
+        if (types[structId].opcode != spirv::OpTypeStruct || !decorations.count({structId, spirv::DecorationBlock}))
+            continue;
+
+        ReflectedBlock block{};
+        block.name = names[structId];
+        block.set = decorations[{variableId, spirv::DecorationDescriptorSet}];
+        block.binding = decorations[{variableId, spirv::DecorationBinding}];
+        block.size = typeSize(structId);
+
+        bool wholeUse = std::find(wholeUses.begin(), wholeUses.end(), variableId) != wholeUses.end();
+        const auto &accessed = accessedMembers[variableId];
+        for (uint32_t memberIdx = 0; memberIdx < types[structId].operands.size(); memberIdx++)
+        {
+            auto member = reflectMember(structId, memberIdx);
+            member.used = wholeUse || std::any_of(accessed.begin(), accessed.end(), [&](uint32_t indexId)
+                                                   { return constants.count(indexId) && constants[indexId] == memberIdx; });
+            block.members.push_back(member);
+        }
+        reflection.uniformBlocks.push_back(block);
+    }
+
+    return reflection;
+}
+
+ShaderReflection reflectSpirv(const std::vector<uint32_t> &words)
+{
+    SpirvReflector reflector(words);
+    return reflector.Reflect();
+}
+
+/*
+    --- spirv cost analysis
+*/
+// relative cost of one operation against one alu component op, roughly desktop gpu throughput:
+// transcendentals issue at quarter rate, a sample that hits the cache costs about eight alu ops
+const double kTranscendentalWeight = 4.0;
+const double kTextureWeight = 8.0;
+const double kBranchWeight = 1.0;
+// assumed for loops whose bound is not a constant
+const double kDefaultTripCount = 8.0;
+
+// a static estimate of the work one fragment does, loop bodies counted once per estimated iteration
+struct ShaderCost
+{
+    double alu;            // per pixel, one per vector component
+    double transcendental; // per pixel, one per vector component
+    double texture;        // per pixel samples, fetches and gathers
+    double branches;       // per pixel conditional branches and switches
+    uint32_t loops;        // static count, through calls
+    uint32_t guessedLoops; // loops without a constant bound, assumed to run kDefaultTripCount times
+    uint32_t loopDepth;    // deepest loop nesting, through calls
+    uint32_t callDepth;    // longest call chain below the entry point
+    double estimatedOps;   // weighted sum of the mix
+};
+
+std::string costSummary(const ShaderCost &cost)
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(0)
+       << "alu " << cost.alu << ", transcendental " << cost.transcendental << ", texture " << cost.texture << ", branch " << cost.branches
+       << " | loops " << cost.loops << " (" << cost.guessedLoops << " unbounded) depth " << cost.loopDepth << ", call depth " << cost.callDepth
+       << " | ~" << cost.estimatedOps << " ops/pixel";
+    return ss.str();
+}
+
+/*
+    Counts the instruction mix of every function, scaling loop bodies by their trip count, then folds callees into callers
+    from the entry point down. Structured control flow keeps a loop's blocks between its header and merge block, so a
+    stack of open merge labels is enough to track nesting. The trip count is read off the first comparison against a
+    constant inside the loop, which covers the usual for (int i = 0; i < N; i++); anything else gets kDefaultTripCount.
+    Loads, stores and access chains on locals are not counted, the driver's compiler turns most of them into registers.
+*/
+class SpirvCostAnalyzer
+{
+public:
+    SpirvCostAnalyzer(const std::vector<uint32_t> &words);
+    ShaderCost Analyze();
+
+private:
+    struct Counts
+    {
+        double alu = 0.0;
+        double transcendental = 0.0;
+        double texture = 0.0;
+        double branches = 0.0;
+        std::map<uint32_t, double> calls; // callee -> executions per call of the function
+
+        void Add(const Counts &other, double scale);
+    };
+
+    struct Loop
+    {
+        uint32_t mergeLabel;
+        double tripCount; // 0 until a bound is found
+        bool compared;    // only the first comparison decides the bound
+        Counts counts;
+    };
+
+    struct Function
+    {
+        Counts counts;
+        uint32_t loops = 0;
+        uint32_t guessedLoops = 0;
+        uint32_t loopDepth = 0;
+        std::map<uint32_t, uint32_t> callLoopDepths; // callee -> deepest loop nesting around a call
+    };
+
+    uint32_t components(uint32_t typeId);
+    double constantValue(uint32_t id, bool &found);
+    ShaderCost total(uint32_t functionId, std::vector<uint32_t> &callStack);
+
+    uint32_t entryPoint;
+    uint32_t glslInstructions; // id of the GLSL.std.450 import
+    std::map<uint32_t, uint32_t> vectorSizes; // vector and matrix type -> scalar components
+    std::vector<uint32_t> floatTypes;
+    std::map<uint32_t, std::pair<uint32_t, uint32_t>> constants; // id -> (type, first word)
+    std::map<uint32_t, Function> functions;
+};
+
+void SpirvCostAnalyzer::Counts::Add(const Counts &other, double scale)
+{
+    alu += scale * other.alu;
+    transcendental += scale * other.transcendental;
+    texture += scale * other.texture;
+    branches += scale * other.branches;
+    for (const auto &[callee, count] : other.calls)
+        calls[callee] += scale * count;
+}
+
+SpirvCostAnalyzer::SpirvCostAnalyzer(const std::vector<uint32_t> &words)
+{
+    if (words.size() < 5 || words[0] != spirv::MagicNumber)
+        throw std::runtime_error("[FATAL] not a spir-v module");
+
+    entryPoint = UINT32_MAX;
+    glslInstructions = UINT32_MAX;
+    Function *function = nullptr;
+    std::vector<Loop> loops; // open in the current function, innermost last
+
+    size_t idx = 5; // skip the header
+    while (idx < words.size())
+    {
+        uint32_t wordCount = words[idx] >> 16;
+        uint32_t opcode = words[idx] & 0xffff;
+        if (wordCount == 0 || idx + wordCount > words.size())
+            throw std::runtime_error("[FATAL] malformed spir-v instruction");
+        std::vector<uint32_t> operands(words.begin() + idx + 1, words.begin() + idx + wordCount);
+        idx += wordCount;
+
+        Counts *counts = loops.empty() ? (function != nullptr ? &function->counts : nullptr) : &loops.back().counts;
+        switch (opcode)
+        {
+        case spirv::OpExtInstImport:
+            if (spirv::literalString(operands, 1) == "GLSL.std.450")
+                glslInstructions = operands[0];
+            break;
+        case spirv::OpEntryPoint:
+            if (entryPoint == UINT32_MAX)
+                entryPoint = operands[1];
+            break;
+        case spirv::OpTypeFloat:
+            floatTypes.push_back(operands[0]);
+            break;
+        case spirv::OpTypeVector:
+        case spirv::OpTypeMatrix:
+            vectorSizes[operands[0]] = components(operands[1]) * operands[2];
+            break;
+        case spirv::OpConstant:
+            constants[operands[1]] = {operands[0], operands[2]};
+            break;
+        case spirv::OpFunction:
+            function = &functions[operands[1]];
+            loops.clear();
+            break;
+        case spirv::OpFunctionEnd:
+            function = nullptr;
+            break;
+        case spirv::OpLoopMerge:
+            if (function == nullptr)
+                break;
+            loops.push_back({operands[0], 0.0, false, {}});
+            function->loops++;
+            function->loopDepth = std::max(function->loopDepth, static_cast<uint32_t>(loops.size()));
+            break;
+        case spirv::OpLabel:
+            // reaching a merge block closes its loop, the body runs once per iteration
+            while (!loops.empty() && loops.back().mergeLabel == operands[0])
+            {
+                Loop loop = loops.back();
+                loops.pop_back();
+                if (loop.tripCount <= 0.0)
+                {
+                    loop.tripCount = kDefaultTripCount;
+                    function->guessedLoops++;
+                }
+                (loops.empty() ? function->counts : loops.back().counts).Add(loop.counts, loop.tripCount);
+            }
+            break;
+        case spirv::OpFunctionCall:
+            if (counts == nullptr)
+                break;
+            counts->calls[operands[2]] += 1.0;
+            function->callLoopDepths[operands[2]] = std::max(function->callLoopDepths[operands[2]], static_cast<uint32_t>(loops.size()));
+            break;
+        case spirv::OpBranchConditional:
+        case spirv::OpSwitch:
+            if (counts != nullptr)
+                counts->branches += 1.0;
+            break;
+        case spirv::OpExtInst:
+        {
+            if (counts == nullptr)
+                break;
+            uint32_t instruction = operands[3];
+            bool transcendental = operands[2] == glslInstructions &&
+                                  ((instruction >= spirv::GlslSin && instruction <= spirv::GlslInverseSqrt) ||
+                                   instruction == spirv::GlslLength || instruction == spirv::GlslDistance || instruction == spirv::GlslNormalize);
+            (transcendental ? counts->transcendental : counts->alu) += components(operands[0]);
+            break;
+        }
+        default:
+            if (counts == nullptr)
+                break;
+            if (opcode >= spirv::OpImageSampleImplicitLod && opcode <= spirv::OpImageRead)
+            {
+                counts->texture += 1.0;
+            }
+            else if ((opcode >= spirv::OpConvertFToU && opcode <= spirv::OpBitcast) ||
+                     (opcode >= spirv::OpSNegate && opcode <= spirv::OpSMulExtended) ||
+                     (opcode >= spirv::OpAny && opcode <= spirv::OpFUnordGreaterThanEqual) ||
+                     (opcode >= spirv::OpShiftRightLogical && opcode <= spirv::OpBitCount) ||
+                     (opcode >= spirv::OpDPdx && opcode <= spirv::OpFwidthCoarse))
+            {
+                counts->alu += components(operands[0]);
+            }
+
+            // i < N or i <= N against a constant bounds the innermost loop
+            if (loops.empty() || loops.back().compared)
+                break;
+            bool less = opcode == spirv::OpULessThan || opcode == spirv::OpSLessThan || opcode == spirv::OpFOrdLessThan || opcode == spirv::OpFUnordLessThan;
+            bool lessEqual = opcode == spirv::OpULessThanEqual || opcode == spirv::OpSLessThanEqual || opcode == spirv::OpFOrdLessThanEqual || opcode == spirv::OpFUnordLessThanEqual;
+            if (!less && !lessEqual)
+                break;
+            loops.back().compared = true;
+            bool found = false;
+            double bound = constantValue(operands[3], found);
+            if (found && bound > 0.0)
+                loops.back().tripCount = std::ceil(bound) + (lessEqual ? 1.0 : 0.0);
+            break;
+        }
+    }
+}
+
+uint32_t SpirvCostAnalyzer::components(uint32_t typeId)
+{
+    auto found = vectorSizes.find(typeId);
+    return found != vectorSizes.end() ? found->second : 1;
+}
+
+double SpirvCostAnalyzer::constantValue(uint32_t id, bool &found)
+{
+    auto constant = constants.find(id);
+    found = constant != constants.end();
+    if (!found)
+        return 0.0;
+    auto [typeId, word] = constant->second;
+    if (std::find(floatTypes.begin(), floatTypes.end(), typeId) != floatTypes.end())
+    {
+        float value;
+        memcpy(&value, &word, sizeof(value));
+        return value;
+    }
+    return static_cast<int32_t>(word);
+}
+
+ShaderCost SpirvCostAnalyzer::total(uint32_t functionId, std::vector<uint32_t> &callStack)
+{
+    ShaderCost cost{};
+    auto found = functions.find(functionId);
+    // glsl has no recursion, but a malformed module should not hang the analysis
+    if (found == functions.end() || std::find(callStack.begin(), callStack.end(), functionId) != callStack.end())
+        return cost;
+    const auto &function = found->second;
+
+    cost.alu = function.counts.alu;
+    cost.transcendental = function.counts.transcendental;
+    cost.texture = function.counts.texture;
+    cost.branches = function.counts.branches;
+    cost.loops = function.loops;
+    cost.guessedLoops = function.guessedLoops;
+    cost.loopDepth = function.loopDepth;
+
+    callStack.push_back(functionId);
+    for (const auto &[callee, count] : function.counts.calls)
+    {
+        auto calleeCost = total(callee, callStack);
+        cost.alu += count * calleeCost.alu;
+        cost.transcendental += count * calleeCost.transcendental;
+        cost.texture += count * calleeCost.texture;
+        cost.branches += count * calleeCost.branches;
+        cost.loops += calleeCost.loops;
+        cost.guessedLoops += calleeCost.guessedLoops;
+        cost.loopDepth = std::max(cost.loopDepth, function.callLoopDepths.at(callee) + calleeCost.loopDepth);
+        cost.callDepth = std::max(cost.callDepth, calleeCost.callDepth + 1);
+    }
+    callStack.pop_back();
+    return cost;
+}
+
+ShaderCost SpirvCostAnalyzer::Analyze()
+{
+    std::vector<uint32_t> callStack;
+    auto cost = total(entryPoint, callStack);
+    cost.estimatedOps = cost.alu + kTranscendentalWeight * cost.transcendental + kTextureWeight * cost.texture + kBranchWeight * cost.branches;
+    return cost;
+}
+
+ShaderCost analyzeSpirvCost(const std::vector<uint32_t> &words)
+{
+    SpirvCostAnalyzer analyzer(words);
+    return analyzer.Analyze();
+}
+
+class RenderPass
+{
+public:
+    RenderPass(VkDevice device,
+               VkFormat format,
+               VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+               VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+               VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+               VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+    ~RenderPass();
+    VkRenderPass handle;
+
+private:
+    VkDevice device;
+};
+
+// the defaults describe the swapchain pass; offscreen passes end in a layout later passes can sample or copy from
+RenderPass::RenderPass(VkDevice device, VkFormat format, VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout, VkSampleCountFlagBits samples)
+{
+    this->device = device;
+
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = format;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = loadOp;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = initialLayout;
+    colorAttachment.finalLayout = finalLayout;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    // multisampled: attachment 0 is a transient image shaded per sample, resolved into attachment 1 at the end of the subpass
+    std::vector<VkAttachmentDescription> attachments = {colorAttachment};
+    VkAttachmentReference resolveAttachmentRef{1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    if (samples != VK_SAMPLE_COUNT_1_BIT)
+    {
+        if (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
+            throw std::runtime_error("[FATAL] a multisampled pass cannot load its resolved contents");
+        VkAttachmentDescription multisampleAttachment = colorAttachment;
+        multisampleAttachment.samples = samples;
+        multisampleAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        multisampleAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        multisampleAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // the resolve overwrites every pixel
+        attachments = {multisampleAttachment, colorAttachment};
+        subpass.pResolveAttachments = &resolveAttachmentRef;
+    }
+
+    std::vector<VkSubpassDependency> dependencies;
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    if (finalLayout != VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+    {
+        // offscreen images persist across frames: wait for last frame's writes and for readers of its result,
+        // including storage images the shader writes alongside its color output
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        VkSubpassDependency outgoing{};
+        outgoing.srcSubpass = 0;
+        outgoing.dstSubpass = VK_SUBPASS_EXTERNAL;
+        outgoing.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        outgoing.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        outgoing.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        outgoing.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        dependencies.push_back(outgoing);
+    }
+    dependencies.insert(dependencies.begin(), dependency);
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create render pass!");
+    }
+}
+
+RenderPass::~RenderPass()
+{
+    if (handle != VK_NULL_HANDLE)
+        vkDestroyRenderPass(device, handle, nullptr);
+    handle = VK_NULL_HANDLE;
+}
+
+/*
+    --- pipeline state
+*/
+// the fixed function state of the full screen quad, shared by whole pipelines and pipeline libraries
+struct FixedFunctionState
+{
+    FixedFunctionState(VkRect2D area, bool dynamicScissor, VkSampleCountFlagBits samples, bool sampleShading, bool additiveBlend);
+    FixedFunctionState(const FixedFunctionState &) = delete; // the create infos point into it
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+    VkViewport viewport;
+    VkRect2D scissor;
+    VkPipelineViewportStateCreateInfo viewportState;
+    VkPipelineRasterizationStateCreateInfo rasterizer;
+    VkPipelineMultisampleStateCreateInfo multisampling;
+    VkPipelineColorBlendAttachmentState colorBlendAttachment;
+    VkPipelineColorBlendStateCreateInfo colorBlending;
+    VkDynamicState dynamicStates[1];
+    VkPipelineDynamicStateCreateInfo dynamicState;
+    const VkPipelineDynamicStateCreateInfo *dynamic; // nullptr unless the scissor is dynamic
+};
 
+// area is the viewport and scissor, the whole framebuffer or one gallery cell; with dynamicScissor the scissor is set per draw
+FixedFunctionState::FixedFunctionState(VkRect2D area, bool dynamicScissor, VkSampleCountFlagBits samples, bool sampleShading, bool additiveBlend)
+{
     // specify vertex data
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     vertexInputInfo.vertexBindingDescriptionCount = 0;
     vertexInputInfo.vertexAttributeDescriptionCount = 0;
 
     // specify the kind of geometry that is drawn
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly = {};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
@@ -1014,23 +2862,21 @@ Pipeline::Pipeline(VkDevice device, VkExtent2D extent, VkRenderPass renderPass,
     // the region of the framebuffer the output will be rendered to
     // the size o fthe swap chain and its images may differ from the window
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)extent.width;
-    viewport.height = (float)extent.height;
+    viewport = {};
+    viewport.x = (float)area.offset.x;
+    viewport.y = (float)area.offset.y;
+    viewport.width = (float)area.extent.width;
+    viewport.height = (float)area.extent.height;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
 
     // scissor rectangles define in which regions pixels are stored
     // pixels outside the scissor are discarded by the rasterizer
     // functions like a filter instead of a transformation
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = extent;
+    scissor = area;
 
     // combine scissor and rect into a state
-    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState = {};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
     viewportState.pViewports = &viewport;
@@ -1039,7 +2885,7 @@ Pipeline::Pipeline(VkDevice device, VkExtent2D extent, VkRenderPass renderPass,
 
     // rasterizer takes the geometry shaped by the verticies from the vertex shader and turns it into fragments
     // performs depth testing, face culling, and the scissor test
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer = {};
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     rasterizer.depthClampEnable = VK_FALSE;        // fragments beyond the near and far planes are clamped instead of being discarded
     rasterizer.rasterizerDiscardEnable = VK_FALSE; // disables output to the framebuffer
@@ -1053,16 +2899,29 @@ Pipeline::Pipeline(VkDevice device, VkExtent2D extent, VkRenderPass renderPass,
     rasterizer.depthBiasClamp = 0.0f;          // Optional
     rasterizer.depthBiasSlopeFactor = 0.0f;    // Optional
 
-    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling = {};
     multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.rasterizationSamples = samples;
+    // run the fragment shader once per sample rather than once per pixel, needs the sampleRateShading feature
+    multisampling.sampleShadingEnable = sampleShading ? VK_TRUE : VK_FALSE;
+    multisampling.minSampleShading = 1.0f;
 
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment = {};
     colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     colorBlendAttachment.blendEnable = VK_FALSE;
+    if (additiveBlend)
+    {
+        // dst += src, used to sum samples into an accumulation target
+        colorBlendAttachment.blendEnable = VK_TRUE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
 
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending = {};
     colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlending.logicOpEnable = VK_FALSE;
     colorBlending.logicOp = VK_LOGIC_OP_COPY;
@@ -1073,588 +2932,6454 @@ Pipeline::Pipeline(VkDevice device, VkExtent2D extent, VkRenderPass renderPass,
     colorBlending.blendConstants[2] = 0.0f;
     colorBlending.blendConstants[3] = 0.0f;
 
-    std::array<VkDescriptorSetLayout, 1> setLayouts = {setLayout};
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size()); // Optional
-    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-    pipelineInfo.pStages = shaderStages.data();
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr; // Optional
-    pipelineInfo.layout = layout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-    pipelineInfo.basePipelineIndex = -1;              // Optional
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &handle) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create graphics pipeline!");
-    }
-    /*
-        --- clean up shaders
-    */
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    dynamicStates[0] = VK_DYNAMIC_STATE_SCISSOR;
+    dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 1;
+    dynamicState.pDynamicStates = dynamicStates;
+    dynamic = dynamicScissor ? &dynamicState : nullptr;
 }
 
-Pipeline::~Pipeline()
+VkShaderModule createShaderModule(VkDevice device, const std::vector<uint32_t> &spirv)
 {
-    if (handle != VK_NULL_HANDLE)
-        vkDestroyPipeline(device, handle, nullptr);
-    handle = VK_NULL_HANDLE;
-
-    if (layout != VK_NULL_HANDLE)
-        vkDestroyPipelineLayout(device, layout, nullptr);
-    layout = VK_NULL_HANDLE;
+    VkShaderModuleCreateInfo moduleCreateInfo{};
+    moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleCreateInfo.codeSize = spirv.size() * sizeof(uint32_t);
+    moduleCreateInfo.pCode = spirv.data();
+    VkShaderModule module;
+    if (vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader module!");
+    }
+    return module;
 }
 
-class Framebuffer
+/*
+    With VK_EXT_graphics_pipeline_library a pipeline is linked from four parts, and only the fragment shader part
+    depends on the shader. The vertex input part is built once, the pre-rasterization part (the constant vertex
+    shader) once per layout, render pass and area, and the fragment output part once per render pass and blend;
+    a new fragment shader then costs its own compile and a link. Fast links skip optimizing across the parts;
+    with optimize the parts keep what link time optimization needs and every link applies it, slower to build
+    but what the timing modes should measure.
+*/
+class PipelineLibraries
 {
 public:
-    Framebuffer(VkDevice device, std::vector<VkImageView> imageViews, VkExtent2D extent, VkRenderPass renderPass);
-    ~Framebuffer();
-    std::vector<VkFramebuffer> handles;
+    PipelineLibraries(VkDevice device, VkPipelineCache cache, const std::vector<uint32_t> &vertexShader, bool optimize);
+    ~PipelineLibraries();
+    VkPipeline Link(VkPipelineLayout layout,
+                    VkRenderPass renderPass,
+                    VkRect2D area,
+                    bool dynamicScissor,
+                    VkSampleCountFlagBits samples,
+                    bool sampleShading,
+                    bool additiveBlend,
+                    const VkPipelineShaderStageCreateInfo &fragmentStage);
+    // drops the parts built against a render pass about to be destroyed, whose handle may come back for another
+    void Forget(VkRenderPass renderPass);
+
+    bool optimize;
 
 private:
+    VkPipeline create(VkGraphicsPipelineLibraryFlagsEXT parts, VkGraphicsPipelineCreateInfo pipelineInfo);
+
     VkDevice device;
+    VkPipelineCache cache;
+    VkShaderModule vertexModule;
+    VkPipeline vertexInput;
+    // keyed by handle; layouts live as long as the DescriptorCache, render passes are dropped through Forget
+    std::map<std::tuple<VkPipelineLayout, VkRenderPass, int32_t, int32_t, uint32_t, uint32_t, bool>, VkPipeline> preRasterization;
+    std::map<std::tuple<VkRenderPass, VkSampleCountFlagBits, bool, bool>, VkPipeline> fragmentOutput;
 };
 
-Framebuffer::Framebuffer(VkDevice device, std::vector<VkImageView> imageViews, VkExtent2D extent, VkRenderPass renderPass)
+PipelineLibraries::PipelineLibraries(VkDevice device, VkPipelineCache cache, const std::vector<uint32_t> &vertexShader, bool optimize)
 {
     this->device = device;
-    handles.resize(imageViews.size());
+    this->cache = cache;
+    this->optimize = optimize;
+    vertexModule = createShaderModule(device, vertexShader);
 
-    for (size_t idx = 0; idx < imageViews.size(); idx++)
-    {
-        VkImageView attachments[] = {
-            imageViews[idx]};
+    FixedFunctionState state({{0, 0}, {1, 1}}, false, VK_SAMPLE_COUNT_1_BIT, false, false);
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.pVertexInputState = &state.vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+    vertexInput = create(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, pipelineInfo);
+}
 
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = extent.width;
-        framebufferInfo.height = extent.height;
-        framebufferInfo.layers = 1;
+PipelineLibraries::~PipelineLibraries()
+{
+    for (auto &entry : preRasterization)
+        vkDestroyPipeline(device, entry.second, nullptr);
+    preRasterization.clear();
+    for (auto &entry : fragmentOutput)
+        vkDestroyPipeline(device, entry.second, nullptr);
+    fragmentOutput.clear();
+    if (vertexInput != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, vertexInput, nullptr);
+    vertexInput = VK_NULL_HANDLE;
+    if (vertexModule != VK_NULL_HANDLE)
+        vkDestroyShaderModule(device, vertexModule, nullptr);
+    vertexModule = VK_NULL_HANDLE;
+}
 
-        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &handles[idx]) != VK_SUCCESS)
+// a linked pipeline does not need its libraries any more, they can go whenever
+void PipelineLibraries::Forget(VkRenderPass renderPass)
+{
+    for (auto it = preRasterization.begin(); it != preRasterization.end();)
+    {
+        if (std::get<1>(it->first) != renderPass)
         {
-            throw std::runtime_error("failed to create framebuffer!");
+            ++it;
+            continue;
         }
+        vkDestroyPipeline(device, it->second, nullptr);
+        it = preRasterization.erase(it);
     }
-}
-
-Framebuffer::~Framebuffer()
-{
-    for (auto framebuffer : handles)
+    for (auto it = fragmentOutput.begin(); it != fragmentOutput.end();)
     {
-        if (framebuffer != VK_NULL_HANDLE)
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        if (std::get<0>(it->first) != renderPass)
+        {
+            ++it;
+            continue;
+        }
+        vkDestroyPipeline(device, it->second, nullptr);
+        it = fragmentOutput.erase(it);
     }
-    handles.clear();
 }
 
-class CommandBuffer
+VkPipeline PipelineLibraries::create(VkGraphicsPipelineLibraryFlagsEXT parts, VkGraphicsPipelineCreateInfo pipelineInfo)
 {
-public:
-    CommandBuffer(VkDevice device, VkCommandPool commandPool, std::vector<VkFramebuffer> framebuffers);
-    ~CommandBuffer();
-    std::vector<VkCommandBuffer> handles;
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = parts;
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+    if (optimize)
+        pipelineInfo.flags |= VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineIndex = -1;
 
-private:
-    VkDevice device;
-    VkCommandPool commandPool;
-};
+    VkPipeline library;
+    if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &library) != VK_SUCCESS)
+        throw std::runtime_error("failed to create graphics pipeline library!");
+    return library;
+}
 
-CommandBuffer::CommandBuffer(VkDevice device, VkCommandPool commandPool, std::vector<VkFramebuffer> framebuffers)
+VkPipeline PipelineLibraries::Link(VkPipelineLayout layout,
+                                   VkRenderPass renderPass,
+                                   VkRect2D area,
+                                   bool dynamicScissor,
+                                   VkSampleCountFlagBits samples,
+                                   bool sampleShading,
+                                   bool additiveBlend,
+                                   const VkPipelineShaderStageCreateInfo &fragmentStage)
 {
-    this->device = device;
-    this->commandPool = commandPool;
-    handles.resize(framebuffers.size());
+    FixedFunctionState state(area, dynamicScissor, samples, sampleShading, additiveBlend);
 
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)handles.size();
+    auto &preRasterizationPart = preRasterization[{layout, renderPass, area.offset.x, area.offset.y, area.extent.width, area.extent.height, dynamicScissor}];
+    if (preRasterizationPart == VK_NULL_HANDLE)
+    {
+        VkPipelineShaderStageCreateInfo vertexStage{};
+        vertexStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertexStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertexStage.module = vertexModule;
+        vertexStage.pName = "main";
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &vertexStage;
+        pipelineInfo.pViewportState = &state.viewportState;
+        pipelineInfo.pRasterizationState = &state.rasterizer;
+        pipelineInfo.pDynamicState = state.dynamic;
+        pipelineInfo.layout = layout;
+        pipelineInfo.renderPass = renderPass;
+        preRasterizationPart = create(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, pipelineInfo);
+    }
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, handles.data()) != VK_SUCCESS)
+    auto &fragmentOutputPart = fragmentOutput[{renderPass, samples, sampleShading, additiveBlend}];
+    if (fragmentOutputPart == VK_NULL_HANDLE)
     {
-        throw std::runtime_error("failed to allocate command buffers!");
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.pMultisampleState = &state.multisampling;
+        pipelineInfo.pColorBlendState = &state.colorBlending;
+        pipelineInfo.renderPass = renderPass;
+        fragmentOutputPart = create(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, pipelineInfo);
     }
+
+    // the one part compiled for every shader, it is not needed once linked
+    VkGraphicsPipelineCreateInfo fragmentInfo{};
+    fragmentInfo.stageCount = 1;
+    fragmentInfo.pStages = &fragmentStage;
+    fragmentInfo.pMultisampleState = &state.multisampling;
+    fragmentInfo.layout = layout;
+    fragmentInfo.renderPass = renderPass;
+    VkPipeline fragmentPart = create(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, fragmentInfo);
+
+    std::array<VkPipeline, 4> parts = {vertexInput, preRasterizationPart, fragmentPart, fragmentOutputPart};
+    VkPipelineLibraryCreateInfoKHR linkInfo{};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = static_cast<uint32_t>(parts.size());
+    linkInfo.pLibraries = parts.data();
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &linkInfo;
+    pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = layout;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline linked;
+    auto result = vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &linked);
+    vkDestroyPipeline(device, fragmentPart, nullptr);
+    if (result != VK_SUCCESS)
+        throw std::runtime_error("failed to link graphics pipeline!");
+    return linked;
 }
 
-CommandBuffer::~CommandBuffer()
+class Pipeline
 {
-    vkFreeCommandBuffers(device,
-                         commandPool,
-                         static_cast<uint32_t>(handles.size()),
-                         handles.data());
+public:
+    Pipeline(VkDevice device,
+             VkRect2D area,
+             VkRenderPass renderPass,
+             VkPipelineLayout layout,
+             const std::vector<uint32_t> &vertexShader,
+             const std::vector<uint32_t> &fragmentShader,
+             const VkSpecializationInfo *fragmentSpecialization = nullptr,
+             bool additiveBlend = false,
+             bool dynamicScissor = false,
+             VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+             bool sampleShading = false,
+             VkPipelineCache cache = VK_NULL_HANDLE,
+             PipelineLibraries *libraries = nullptr);
+    ~Pipeline();
+    VkPipelineLayout layout; // owned by the DescriptorCache
+    VkPipeline handle;
 
-    handles.clear();
-}
+private:
+    VkDevice device;
+};
 
-/*
-Vulkan expects the data in your structure to be aligned in memory in a specific way, for example:
+// with libraries the pipeline is linked from them and only its fragment shader is compiled here
+Pipeline::Pipeline(VkDevice device,
+                   VkRect2D area,
+                   VkRenderPass renderPass,
+                   VkPipelineLayout layout,
+                   const std::vector<uint32_t> &vertexShader,
+                   const std::vector<uint32_t> &fragmentShader,
+                   const VkSpecializationInfo *fragmentSpecialization,
+                   bool additiveBlend,
+                   bool dynamicScissor,
+                   VkSampleCountFlagBits samples,
+                   bool sampleShading,
+                   VkPipelineCache cache,
+                   PipelineLibraries *libraries)
+{
+    this->device = device;
+    this->layout = layout;
+    /*
+        --- set up shaders
+    */
+
+    // fragment shader, compiled once up front so its uniform block can be reflected
+    VkShaderModule fragShaderModule = createShaderModule(device, fragmentShader);
+    VkPipelineShaderStageCreateInfo fragCreateInfo{};
+    fragCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragCreateInfo.module = fragShaderModule;
+    fragCreateInfo.pName = "main";
+    fragCreateInfo.pSpecializationInfo = fragmentSpecialization;
 
-    Scalars have to be aligned by N (= 4 bytes given 32 bit floats).
-    A vec2 must be aligned by 2N (= 8 bytes)
-    A vec3 or vec4 must be aligned by 4N (= 16 bytes)
-    A nested structure must be aligned by the base alignment of its members rounded up to a multiple of 16.
-    A mat4 matrix must have the same alignment as a vec4.
+    if (libraries != nullptr)
+    {
+        try
+        {
+            handle = libraries->Link(layout, renderPass, area, dynamicScissor, samples, sampleShading, additiveBlend, fragCreateInfo);
+        }
+        catch (...)
+        {
+            vkDestroyShaderModule(device, fragShaderModule, nullptr);
+            throw;
+        }
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        return;
+    }
 
-https://www.khronos.org/registry/vulkan/specs/1.1-extensions/html/chap14.html#interfaces-resources-layout
-*/
-struct UniformBufferObject
+    // vertex shader
+    VkShaderModule vertShaderModule = createShaderModule(device, vertexShader);
+    VkPipelineShaderStageCreateInfo vertCreateInfo{};
+    vertCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertCreateInfo.module = vertShaderModule;
+    vertCreateInfo.pName = "main";
+
+    // shader stages
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
+        vertCreateInfo,
+        fragCreateInfo};
+
+    /*
+        --- create pipeline
+    */
+    FixedFunctionState state(area, dynamicScissor, samples, sampleShading, additiveBlend);
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &state.vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+    pipelineInfo.pViewportState = &state.viewportState;
+    pipelineInfo.pRasterizationState = &state.rasterizer;
+    pipelineInfo.pMultisampleState = &state.multisampling;
+    pipelineInfo.pColorBlendState = &state.colorBlending;
+    pipelineInfo.pDynamicState = state.dynamic;
+    pipelineInfo.layout = layout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+    pipelineInfo.basePipelineIndex = -1;              // Optional
+
+    auto result = vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &handle);
+    /*
+        --- clean up shaders
+    */
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+}
+
+Pipeline::~Pipeline()
 {
-    alignas(16) glm::vec3 resolution;
-    alignas(4) float time;
-    alignas(16) glm::vec4 mouse;
-};
+    if (handle != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, handle, nullptr);
+    handle = VK_NULL_HANDLE;
+}
 
-class Uniform
+class Framebuffer
 {
 public:
-    Uniform(VkPhysicalDevice physicalDevice, VkDevice device, size_t numSwapChainImages);
-    ~Uniform();
-    void Update(void *data, uint32_t currentImage);
-
-    std::vector<VkBuffer> bufferHandles;
-    std::vector<VkDeviceMemory> memoryHandles;
+    // a multisample view goes in front of every image view, for passes that resolve into the images
+    Framebuffer(VkDevice device, std::vector<VkImageView> imageViews, VkExtent2D extent, VkRenderPass renderPass, VkImageView multisampleView = VK_NULL_HANDLE);
+    ~Framebuffer();
+    std::vector<VkFramebuffer> handles;
 
 private:
     VkDevice device;
 };
 
-Uniform::Uniform(VkPhysicalDevice physicalDevice, VkDevice device, size_t numSwapChainImages)
+Framebuffer::Framebuffer(VkDevice device, std::vector<VkImageView> imageViews, VkExtent2D extent, VkRenderPass renderPass, VkImageView multisampleView)
 {
     this->device = device;
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    handles.resize(imageViews.size());
 
-    for (size_t i = 0; i < numSwapChainImages; i++)
+    for (size_t idx = 0; idx < imageViews.size(); idx++)
     {
-        //
-
-        /*
-            create ubo buffer
-        */
-        VkBuffer uniformBufferHandle;
+        std::vector<VkImageView> attachments = {imageViews[idx]};
+        if (multisampleView != VK_NULL_HANDLE)
+            attachments.insert(attachments.begin(), multisampleView);
 
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = bufferSize;
-        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
+        framebufferInfo.layers = 1;
 
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &uniformBufferHandle) != VK_SUCCESS)
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &handles[idx]) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to create buffer!");
+            throw std::runtime_error("failed to create framebuffer!");
         }
+    }
+}
 
-        /*
-            create ubo memory
-        */
-        uint32_t flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, uniformBufferHandle, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
+Framebuffer::~Framebuffer()
+{
+    for (auto framebuffer : handles)
+    {
+        if (framebuffer != VK_NULL_HANDLE)
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+    handles.clear();
+}
 
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+/*
+    --- offscreen targets
+*/
+// prefers fp32 so long accumulations do not lose low bits, falls back to fp16 where fp32 cannot be blended
+VkFormat chooseAccumulationFormat(VkPhysicalDevice physicalDevice)
+{
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    for (auto format : {VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT})
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+        if ((properties.optimalTilingFeatures & required) == required)
+            return format;
+        std::cout << "[WARN] format " << format << " cannot be blended into, trying a narrower accumulation format" << std::endl;
+    }
+    throw std::runtime_error("[FATAL] no float color format supports blending");
+}
 
-        bool found = false;
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-        {
-            if ((memRequirements.memoryTypeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & flags) == flags)
-            {
-                allocInfo.memoryTypeIndex = i;
-                found = true;
-            }
-        }
-        if (!found)
-            throw std::runtime_error("failed to find suitable memory type!");
+// intermediate formats a shader can render into before the swapchain pass resolves it
+struct TargetFormat
+{
+    const char *name;
+    VkFormat format;
+    uint32_t bytesPerPixel;
+};
 
-        VkDeviceMemory uniformMemoryHandle;
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &uniformMemoryHandle) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to allocate vertex buffer memory!");
-        }
-        vkBindBufferMemory(device, uniformBufferHandle, uniformMemoryHandle, 0);
+const std::array<TargetFormat, 5> kTargetFormats = {{{"rgba8", VK_FORMAT_R8G8B8A8_UNORM, 4},
+                                                     {"rgb10a2", VK_FORMAT_A2B10G10R10_UNORM_PACK32, 4},
+                                                     {"b10g11r11", VK_FORMAT_B10G11R11_UFLOAT_PACK32, 4},
+                                                     {"rgba16f", VK_FORMAT_R16G16B16A16_SFLOAT, 8},
+                                                     {"rgba32f", VK_FORMAT_R32G32B32A32_SFLOAT, 16}}};
 
-        bufferHandles.push_back(uniformBufferHandle);
-        memoryHandles.push_back(uniformMemoryHandle);
+std::optional<TargetFormat> parseTargetFormat(const std::string &name)
+{
+    for (const auto &targetFormat : kTargetFormats)
+    {
+        if (name == targetFormat.name)
+            return targetFormat;
     }
+    return std::nullopt;
 }
-Uniform::~Uniform()
+
+// rendered into by a full screen pass and sampled by the resolve
+bool targetFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+// a single color image the size of the swapchain, rendered into by one pass and sampled or copied by later ones
+class RenderTarget
+{
+public:
+    RenderTarget(Device *device, VkExtent2D extent, VkFormat format, VkRenderPass renderPass, std::string owner, VkImageView multisampleView = VK_NULL_HANDLE, AllocationScope scope = AllocationScope::Extent);
+    ~RenderTarget();
+    void Clear(VkImageLayout newLayout);
+    std::vector<float> Read(VkImageLayout currentLayout);
+
+    VkImage image;
+    VkImageView view;
+    Framebuffer *framebuffer;
+    VkExtent2D extent;
+    VkFormat format;
+
+private:
+    Device *device;
+    Allocation allocation;
+};
+
+RenderTarget::RenderTarget(Device *device, VkExtent2D extent, VkFormat format, VkRenderPass renderPass, std::string owner, VkImageView multisampleView, AllocationScope scope)
 {
-    for (auto uniformMemoryHandle : memoryHandles)
+    this->device = device;
+    this->extent = extent;
+    this->format = format;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(device->handle, &imageInfo, nullptr, &image) != VK_SUCCESS)
     {
-        if (uniformMemoryHandle != VK_NULL_HANDLE)
-            vkFreeMemory(device, uniformMemoryHandle, nullptr);
+        throw std::runtime_error("failed to create image!");
     }
-    this->memoryHandles.clear();
-
-    for (auto uniformBufferHandle : bufferHandles)
+    // sized by the swapchain, so it lives in the per-resolution arena unless it is gone again before the next resize
+    allocation = device->allocator->BindImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scope, owner);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(device->handle, &viewInfo, nullptr, &view) != VK_SUCCESS)
     {
-        if (uniformBufferHandle != VK_NULL_HANDLE)
-            vkDestroyBuffer(device, uniformBufferHandle, nullptr);
+        throw std::runtime_error("failed to create image view!");
     }
-    this->bufferHandles.clear();
+
+    framebuffer = new Framebuffer(device->handle, {view}, extent, renderPass, multisampleView);
 }
 
-void Uniform::Update(void *data, uint32_t currentImage)
+RenderTarget::~RenderTarget()
 {
-    void *dst;
-    vkMapMemory(device, memoryHandles[currentImage], 0, sizeof(UniformBufferObject), 0, &dst);
-    memcpy(dst, data, sizeof(UniformBufferObject));
-    vkUnmapMemory(device, this->memoryHandles[currentImage]);
+    if (framebuffer != nullptr)
+        delete framebuffer;
+    framebuffer = nullptr;
+    if (view != VK_NULL_HANDLE)
+        vkDestroyImageView(device->handle, view, nullptr);
+    view = VK_NULL_HANDLE;
+    if (image != VK_NULL_HANDLE)
+    {
+        vkDestroyImage(device->handle, image, nullptr);
+        device->allocator->Free(allocation);
+    }
+    image = VK_NULL_HANDLE;
 }
 
-class DescriptorSet
+// transient color image a multisampled pass shades into and resolves out of, never stored or read back
+class MultisampleImage
 {
 public:
-    DescriptorSet(VkDevice device, size_t numSwapChainImages, std::vector<VkBuffer> uniformBuffers);
-    ~DescriptorSet();
+    MultisampleImage(Device *device, VkExtent2D extent, VkFormat format, VkSampleCountFlagBits samples, std::string owner, AllocationScope scope = AllocationScope::Extent);
+    ~MultisampleImage();
 
-    VkDescriptorPool pool;
-    VkDescriptorSetLayout layout;
-    std::vector<VkDescriptorSet> handles;
+    VkImage image;
+    VkImageView view;
 
 private:
-    VkDevice device;
+    Device *device;
+    Allocation allocation;
 };
 
-DescriptorSet::DescriptorSet(VkDevice device, size_t numSwapChainImages, std::vector<VkBuffer> uniformBuffers)
+MultisampleImage::MultisampleImage(Device *device, VkExtent2D extent, VkFormat format, VkSampleCountFlagBits samples, std::string owner, AllocationScope scope)
 {
     this->device = device;
-    /*
-    --- create descriptor set layout
-    */
 
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr;
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = samples;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(device->handle, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create multisampled image!");
+    }
+    allocation = device->allocator->BindImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scope, owner);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(device->handle, &viewInfo, nullptr, &view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image view!");
+    }
+}
 
-    std::array<VkDescriptorSetLayoutBinding, 1> bindings = {uboLayoutBinding};
+MultisampleImage::~MultisampleImage()
+{
+    vkDestroyImageView(device->handle, view, nullptr);
+    vkDestroyImage(device->handle, image, nullptr);
+    device->allocator->Free(allocation);
+}
 
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
+/*
+    --- anti-aliasing
+*/
+/*
+    A full screen triangle has no edges inside the frame, so plain MSAA shades once per pixel and only pays for the
+    extra samples and the resolve. With sample shading every sample runs the shader at its own gl_FragCoord, which
+    is what antialiases procedural images. Supersampling shades a target factor x factor times the pixel count on
+    an ordered grid and box filters it down in the resolve.
+*/
+const VkFormat kSupersampleFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+const uint32_t kMaxSupersampleFactor = 4;
 
-    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create descriptor set layout!");
-    }
+// the sample counts the device can render into a color attachment, 1 always included
+bool sampleCountSupported(Device *device, uint32_t samples)
+{
+    return (device->deviceProperties.limits.framebufferColorSampleCounts & samples) != 0;
+}
 
-    /*
-    --- create descriptor pool
-    */
-    std::array<VkDescriptorPoolSize, 1> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(numSwapChainImages);
+// fills the image with black and leaves it in newLayout, for targets sampled before anything rendered into them
+void RenderTarget::Clear(VkImageLayout newLayout)
+{
+    submitOneShot(device, [&](VkCommandBuffer commandBuffer)
+                  {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 0.0f}};
+        vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &barrier.subresourceRange);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = newLayout;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier); });
+}
 
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(numSwapChainImages);
+float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (half >> 15) & 0x1;
+    int32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    float value;
+    if (exponent == 0)
+        value = std::ldexp(static_cast<float>(mantissa), -24);
+    else if (exponent == 31)
+        value = mantissa == 0 ? INFINITY : NAN;
+    else
+        value = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+    return sign ? -value : value;
+}
 
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+// copies the image back as rgba floats, top row first; the device must be idle
+std::vector<float> RenderTarget::Read(VkImageLayout currentLayout)
+{
+    if (format != VK_FORMAT_R32G32B32A32_SFLOAT && format != VK_FORMAT_R16G16B16A16_SFLOAT)
+        throw std::runtime_error("[FATAL] read back of format " + std::to_string(format) + " is not supported");
+    VkDeviceSize texelSize = format == VK_FORMAT_R32G32B32A32_SFLOAT ? 16 : 8;
+    VkDeviceSize size = texelSize * extent.width * extent.height;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer;
+    if (vkCreateBuffer(device->handle, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create buffer!");
+    }
+    auto bufferAllocation = device->allocator->BindBuffer(
+        buffer,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        AllocationScope::Extent,
+        "Readback");
+
+    submitOneShot(device, [&](VkCommandBuffer commandBuffer)
+                  {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = currentLayout;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+        // back to where the render passes expect it
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = currentLayout;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier); });
+
+    std::vector<float> texels(4 * static_cast<size_t>(extent.width) * extent.height);
+    if (texelSize == 16)
     {
-        throw std::runtime_error("failed to create descriptor pool!");
+        memcpy(texels.data(), bufferAllocation.mapped, size);
+    }
+    else
+    {
+        auto halves = reinterpret_cast<const uint16_t *>(bufferAllocation.mapped);
+        for (size_t idx = 0; idx < texels.size(); idx++)
+            texels[idx] = halfToFloat(halves[idx]);
     }
 
-    /*
-    --- create descriptor sets
-    */
-    std::vector<VkDescriptorSetLayout> layouts(numSwapChainImages, layout);
+    vkDestroyBuffer(device->handle, buffer, nullptr);
+    device->allocator->Free(bufferAllocation);
+    return texels;
+}
 
-    /*
-    specify the descriptor pool to allocate from, the number of descriptor sets to allocate, and the descriptor layout to base them on
-    we will create one descriptor set for each swap chain image, all with the same layout
-    */
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = pool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(numSwapChainImages);
-    allocInfo.pSetLayouts = layouts.data();
+float linearToSrgb(float value)
+{
+    value = std::clamp(value, 0.0f, 1.0f);
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// rgba floats, top row first, to a .pfm (linear, full range) or otherwise a binary .ppm (8 bit, clamped)
+void writeImage(const std::string &path, uint32_t width, uint32_t height, const std::vector<float> &texels, bool srgbEncode)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (file.fail())
+        throw std::runtime_error("[FATAL] could not open \'" + path + "\' for writing");
 
-    handles.resize(numSwapChainImages);
-    if (vkAllocateDescriptorSets(device, &allocInfo, handles.data()) != VK_SUCCESS)
+    bool pfm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0;
+    if (pfm)
     {
-        throw std::runtime_error("failed to allocate descriptor sets!");
+        // little endian scale, rows stored bottom to top
+        file << "PF\n"
+             << width << " " << height << "\n-1.0\n";
+        for (uint32_t row = height; row-- > 0;)
+            for (uint32_t column = 0; column < width; column++)
+                file.write(reinterpret_cast<const char *>(&texels[4 * (static_cast<size_t>(row) * width + column)]), 3 * sizeof(float));
     }
-
-    /*
-    --- update descriptor sets
-    */
-    for (size_t idx = 0; idx < numSwapChainImages; idx++)
+    else
     {
-        //
-        std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+        file << "P6\n"
+             << width << " " << height << "\n255\n";
+        std::vector<uint8_t> bytes;
+        bytes.reserve(3 * static_cast<size_t>(width) * height);
+        for (size_t texel = 0; texel < static_cast<size_t>(width) * height; texel++)
+            for (size_t channel = 0; channel < 3; channel++)
+            {
+                float value = texels[4 * texel + channel];
+                value = srgbEncode ? linearToSrgb(value) : std::clamp(value, 0.0f, 1.0f);
+                bytes.push_back(static_cast<uint8_t>(value * 255.0f + 0.5f));
+            }
+        file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+    if (file.fail())
+        throw std::runtime_error("[FATAL] could not write \'" + path + "\'");
+}
+
+/*
+    --- shader inputs
+*/
+// shadertoy uniforms; the fragment shader declares whichever subset it wants in its uniform block,
+// the compiler lays them out (std140) and the offsets are read back through reflection
+enum class ShaderInput
+{
+    Resolution,
+    Time,
+    TimeDelta,
+    FrameRate,
+    Frame,
+    Mouse,
+    Date,
+    ChannelTime,
+    ChannelResolution,
+    SampleRate,
+    Unknown
+};
+
+ShaderInput shaderInputFromName(const std::string &name)
+{
+    static const std::map<std::string, ShaderInput> inputs = {
+        {"iResolution", ShaderInput::Resolution},
+        {"iTime", ShaderInput::Time},
+        {"iGlobalTime", ShaderInput::Time}, // pre-2017 shadertoy name
+        {"iTimeDelta", ShaderInput::TimeDelta},
+        {"iFrameRate", ShaderInput::FrameRate},
+        {"iFrame", ShaderInput::Frame},
+        {"iMouse", ShaderInput::Mouse},
+        {"iDate", ShaderInput::Date},
+        {"iChannelTime", ShaderInput::ChannelTime},
+        {"iChannelResolution", ShaderInput::ChannelResolution},
+        {"iSampleRate", ShaderInput::SampleRate},
+    };
+    auto it = inputs.find(name);
+    return it != inputs.end() ? it->second : ShaderInput::Unknown;
+}
 
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[idx];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
+/*
+    shadertoy mouse semantics, in framebuffer pixels:
+        xy  cursor position while a button is held, the last held position otherwise
+        z   x of the last click, positive while held and negative once released
+        w   y of the last click, positive only on the frame the click happened
+*/
+struct MouseState
+{
+    glm::vec2 position{0.0f, 0.0f};
+    glm::vec2 click{0.0f, 0.0f};
+    bool down = false;
+    bool clicked = false; // set by the button callback, cleared once a frame has seen it
+};
 
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = handles[idx];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
+struct FrameInputs
+{
+    glm::vec3 resolution;
+    float time;
+    float timeDelta;
+    float frameRate;
+    int32_t frame;
+    MouseState mouse;
+    std::array<float, 4> date{}; // iDate, sampled with the rest so a replay sees the recorded day
+};
 
-        // used to set which resources are used by a descriptor set
-        vkUpdateDescriptorSets(
-            device,
-            static_cast<uint32_t>(descriptorWrites.size()),
-            descriptorWrites.data(),
-            0,
-            nullptr);
-    }
+// year, month (0-based, as shadertoy does), day of month, seconds since midnight
+std::array<float, 4> localDate()
+{
+    auto now = std::chrono::system_clock::now();
+    auto seconds = std::chrono::system_clock::to_time_t(now);
+    std::tm local = *std::localtime(&seconds);
+    auto fraction = std::chrono::duration<float>(now - std::chrono::system_clock::from_time_t(seconds)).count();
+    return {static_cast<float>(local.tm_year + 1900),
+            static_cast<float>(local.tm_mon),
+            static_cast<float>(local.tm_mday),
+            static_cast<float>(local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec) + fraction};
 }
-DescriptorSet::~DescriptorSet()
+
+class UniformLayout
 {
-    if (pool != VK_NULL_HANDLE)
+public:
+    UniformLayout(const ShaderReflection &reflection);
+    bool Uses(ShaderInput input) const;
+    // computes only the inputs the shader reads and writes them at their reflected offsets
+    void Write(const FrameInputs &inputs, void *dst) const;
+
+    bool present; // the shader declares a uniform block at all
+    uint32_t set;
+    uint32_t binding;
+    VkDeviceSize size;
+
+private:
+    struct Field
+    {
+        ShaderInput input;
+        ReflectedMember member;
+    };
+    void store(uint8_t *dst, const ReflectedMember &member, uint32_t element, const float *values) const;
+
+    std::vector<Field> fields;
+};
+
+UniformLayout::UniformLayout(const ShaderReflection &reflection)
+{
+    present = false;
+    set = 0;
+    binding = 0;
+    size = 16; // keep a valid buffer around for shaders without a uniform block
+
+    if (reflection.uniformBlocks.empty())
+        return;
+    if (reflection.uniformBlocks.size() > 1)
+        std::cout << "[WARN] only the first uniform block is fed shader inputs" << std::endl;
+
+    const auto &block = reflection.uniformBlocks[0];
+    present = true;
+    set = block.set;
+    binding = block.binding;
+    size = std::max<VkDeviceSize>(size, block.size);
+
+    for (const auto &member : block.members)
     {
-        vkDestroyDescriptorPool(device, pool, nullptr);
+        auto input = shaderInputFromName(member.name);
+        if (input == ShaderInput::Unknown || member.scalar == ScalarKind::Other)
+        {
+            std::cout << "[WARN] uniform member \'" << member.name << "\' is not a known shader input, it stays zero" << std::endl;
+            continue;
+        }
+        if (!member.used)
+            continue;
+        fields.push_back({input, member});
     }
-    pool = VK_NULL_HANDLE;
 
-    if (layout != VK_NULL_HANDLE)
-        vkDestroyDescriptorSetLayout(device, layout, nullptr);
-    layout = VK_NULL_HANDLE;
+    std::cout << "[DEBUG] uniform block \'" << block.name << "\' set " << set << " binding " << binding << " size " << size << " using";
+    for (const auto &field : fields)
+        std::cout << " " << field.member.name << "@" << field.member.offset;
+    std::cout << std::endl;
 }
 
-void RecordCommand(VkCommandBuffer commandBuffer,
-                   VkRenderPass renderPass,
-                   VkFramebuffer framebuffer,
-                   VkExtent2D extent,
-                   VkPipeline pipeline,
-                   VkPipelineLayout layout,
-                   std::vector<VkDescriptorSet> descriptorSets)
+bool UniformLayout::Uses(ShaderInput input) const
 {
+    return std::any_of(fields.begin(), fields.end(), [&](const Field &field)
+                       { return field.input == input; });
+}
+
+void UniformLayout::store(uint8_t *dst, const ReflectedMember &member, uint32_t element, const float *values) const
+{
+    uint8_t *base = dst + member.offset + element * member.arrayStride;
+    for (uint32_t component = 0; component < member.components; component++)
+    {
+        switch (member.scalar)
+        {
+        case ScalarKind::Float:
+        {
+            float value = values[component];
+            memcpy(base + 4 * component, &value, 4);
+            break;
+        }
+        case ScalarKind::Int:
+        {
+            int32_t value = static_cast<int32_t>(values[component]);
+            memcpy(base + 4 * component, &value, 4);
+            break;
+        }
+        case ScalarKind::UInt:
+        {
+            uint32_t value = static_cast<uint32_t>(std::max(0.0f, values[component]));
+            memcpy(base + 4 * component, &value, 4);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void UniformLayout::Write(const FrameInputs &inputs, void *dst) const
+{
+    auto bytes = static_cast<uint8_t *>(dst);
+    for (const auto &field : fields)
+    {
+        float values[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        switch (field.input)
+        {
+        case ShaderInput::Resolution:
+            values[0] = inputs.resolution.x;
+            values[1] = inputs.resolution.y;
+            values[2] = inputs.resolution.z;
+            break;
+        case ShaderInput::Time:
+            values[0] = inputs.time;
+            break;
+        case ShaderInput::TimeDelta:
+            values[0] = inputs.timeDelta;
+            break;
+        case ShaderInput::FrameRate:
+            values[0] = inputs.frameRate;
+            break;
+        case ShaderInput::Frame:
+            values[0] = static_cast<float>(inputs.frame);
+            break;
+        case ShaderInput::Mouse:
+        {
+            const auto &mouse = inputs.mouse;
+            values[0] = mouse.position.x;
+            values[1] = mouse.position.y;
+            values[2] = mouse.down ? mouse.click.x : -mouse.click.x;
+            values[3] = mouse.clicked ? mouse.click.y : -mouse.click.y;
+            break;
+        }
+        case ShaderInput::Date:
+            std::copy(inputs.date.begin(), inputs.date.end(), values);
+            break;
+        case ShaderInput::ChannelTime:
+            // channels are not bound yet, they share the global clock
+            values[0] = inputs.time;
+            break;
+        case ShaderInput::ChannelResolution:
+            // no channel textures are bound yet, resolutions stay zero
+            break;
+        case ShaderInput::SampleRate:
+            values[0] = 44100.0f;
+            break;
+        default:
+            break;
+        }
+
+        for (uint32_t element = 0; element < field.member.arrayLength; element++)
+            store(bytes, field.member, element, values);
+    }
+}
+
+class Uniform
+{
+public:
+    Uniform(Allocator *allocator, VkDevice device, size_t numSwapChainImages, VkDeviceSize size, AllocationScope scope = AllocationScope::Extent);
+    ~Uniform();
+    void Update(const UniformLayout &layout, const FrameInputs &inputs, uint32_t currentImage);
+
+    std::vector<VkBuffer> bufferHandles;
+    std::vector<Allocation> allocations;
+
+private:
+    Allocator *allocator;
+    VkDevice device;
+};
+
+Uniform::Uniform(Allocator *allocator, VkDevice device, size_t numSwapChainImages, VkDeviceSize size, AllocationScope scope)
+{
+    this->allocator = allocator;
+    this->device = device;
+    VkDeviceSize bufferSize = size;
+
+    for (size_t i = 0; i < numSwapChainImages; i++)
+    {
+        //
+
+        /*
+            create ubo buffer
+        */
+        VkBuffer uniformBufferHandle;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = bufferSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &uniformBufferHandle) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        /*
+            sub-allocate ubo memory, by default from the per-resolution arena; it stays mapped so Update is a plain memcpy
+        */
+        auto allocation = allocator->BindBuffer(
+            uniformBufferHandle,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            scope,
+            "Uniform");
+        // members the shader never reads are never written, start them at zero
+        memset(allocation.mapped, 0, bufferSize);
+
+        bufferHandles.push_back(uniformBufferHandle);
+        allocations.push_back(allocation);
+    }
+}
+Uniform::~Uniform()
+{
+    for (auto uniformBufferHandle : bufferHandles)
+    {
+        if (uniformBufferHandle != VK_NULL_HANDLE)
+            vkDestroyBuffer(device, uniformBufferHandle, nullptr);
+    }
+    this->bufferHandles.clear();
+
+    for (auto &allocation : allocations)
+        allocator->Free(allocation);
+    this->allocations.clear();
+}
+
+void Uniform::Update(const UniformLayout &layout, const FrameInputs &inputs, uint32_t currentImage)
+{
+    layout.Write(inputs, allocations[currentImage].mapped);
+}
+
+/*
+    --- descriptors
+*/
+// the resource interface of a pipeline, one list of bindings per descriptor set index
+struct ShaderInterface
+{
+    std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>> sets;
+    uint32_t pushConstantSize = 0;
+    VkShaderStageFlags pushConstantStages = 0;
+
+    void Add(const ShaderReflection &reflection, VkShaderStageFlags stage);
+    uint64_t Hash() const;
+    bool Matches(const ShaderInterface &other) const;
+};
+
+void ShaderInterface::Add(const ShaderReflection &reflection, VkShaderStageFlags stage)
+{
+    for (const auto &resource : reflection.bindings)
+    {
+        auto &bindings = sets[resource.set];
+        auto existing = std::find_if(bindings.begin(), bindings.end(), [&](const VkDescriptorSetLayoutBinding &binding)
+                                     { return binding.binding == resource.binding; });
+        if (existing != bindings.end())
+        {
+            if (existing->descriptorType != resource.type)
+                throw std::runtime_error("[FATAL] stages disagree on the type of set " + std::to_string(resource.set) + " binding " + std::to_string(resource.binding));
+            existing->stageFlags |= stage;
+            existing->descriptorCount = std::max(existing->descriptorCount, resource.count);
+            continue;
+        }
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = resource.binding;
+        binding.descriptorType = resource.type;
+        binding.descriptorCount = resource.count;
+        binding.stageFlags = stage;
+        binding.pImmutableSamplers = nullptr;
+        bindings.push_back(binding);
+    }
+    for (auto &[set, bindings] : sets)
+        std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+                  { return a.binding < b.binding; });
+
+    if (reflection.pushConstantSize > 0)
+    {
+        pushConstantSize = std::max(pushConstantSize, reflection.pushConstantSize);
+        pushConstantStages |= stage;
+    }
+}
+
+// FNV-1a over everything that ends up in the set and pipeline layouts
+uint64_t ShaderInterface::Hash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](uint32_t value)
+    {
+        for (int byte = 0; byte < 4; byte++)
+        {
+            hash ^= (value >> (8 * byte)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (const auto &[set, bindings] : sets)
+    {
+        mix(set);
+        mix(static_cast<uint32_t>(bindings.size()));
+        for (const auto &binding : bindings)
+        {
+            mix(binding.binding);
+            mix(binding.descriptorType);
+            mix(binding.descriptorCount);
+            mix(binding.stageFlags);
+        }
+    }
+    mix(pushConstantSize);
+    mix(pushConstantStages);
+    return hash;
+}
+
+// compares what Hash mixes, a hash hit alone does not make two interfaces the same
+bool ShaderInterface::Matches(const ShaderInterface &other) const
+{
+    if (pushConstantSize != other.pushConstantSize || pushConstantStages != other.pushConstantStages || sets.size() != other.sets.size())
+        return false;
+    for (auto it = sets.begin(), otherIt = other.sets.begin(); it != sets.end(); it++, otherIt++)
+    {
+        if (it->first != otherIt->first || it->second.size() != otherIt->second.size())
+            return false;
+        for (size_t idx = 0; idx < it->second.size(); idx++)
+        {
+            const auto &a = it->second[idx];
+            const auto &b = otherIt->second[idx];
+            if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+                a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags)
+                return false;
+        }
+    }
+    return true;
+}
+
+// layouts for one interface plus the pools its descriptor sets are carved from
+struct InterfaceLayout
+{
+    uint64_t hash;
+    ShaderInterface shaderInterface;
+    std::vector<VkDescriptorSetLayout> setLayouts; // indexed by set number, unused set numbers get an empty layout
+    VkPipelineLayout pipelineLayout;
+    std::vector<VkDescriptorPoolSize> copySizes; // descriptors for one copy of every set
+    std::vector<VkDescriptorPool> pools;
+    std::vector<uint32_t> poolCopies; // live copies per pool
+};
+
+/*
+    Pipelines whose shaders declare the same resources share set layouts, pipeline layout and pools.
+    A pool holds kCopiesPerPool copies of the interface's sets; when all are taken another pool is added.
+*/
+class DescriptorCache
+{
+public:
+    DescriptorCache(VkDevice device);
+    ~DescriptorCache();
+    InterfaceLayout *Get(const ShaderInterface &shaderInterface);
+    // allocates one descriptor set per set layout, returns the pool they came from
+    VkDescriptorPool Allocate(InterfaceLayout *layout, std::vector<VkDescriptorSet> &sets);
+    void Free(InterfaceLayout *layout, VkDescriptorPool pool, std::vector<VkDescriptorSet> &sets);
+
+private:
+    static const uint32_t kCopiesPerPool = 16;
+
+    VkDevice device;
+    std::multimap<uint64_t, InterfaceLayout *> layouts; // by ShaderInterface::Hash, colliding interfaces side by side
+};
+
+DescriptorCache::DescriptorCache(VkDevice device)
+{
+    this->device = device;
+}
+
+DescriptorCache::~DescriptorCache()
+{
+    for (auto &[hash, layout] : layouts)
+    {
+        for (auto pool : layout->pools)
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        if (layout->pipelineLayout != VK_NULL_HANDLE)
+            vkDestroyPipelineLayout(device, layout->pipelineLayout, nullptr);
+        for (auto setLayout : layout->setLayouts)
+            vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        delete layout;
+    }
+    layouts.clear();
+}
+
+InterfaceLayout *DescriptorCache::Get(const ShaderInterface &shaderInterface)
+{
+    auto hash = shaderInterface.Hash();
+    auto [first, last] = layouts.equal_range(hash);
+    for (auto it = first; it != last; it++)
+    {
+        if (it->second->shaderInterface.Matches(shaderInterface))
+            return it->second;
+    }
+
+    auto layout = new InterfaceLayout{};
+    layout->hash = hash;
+    layout->shaderInterface = shaderInterface;
+    layouts.emplace(hash, layout);
+
+    /*
+    --- create descriptor set layouts
+    */
+    uint32_t setCount = shaderInterface.sets.empty() ? 0 : shaderInterface.sets.rbegin()->first + 1;
+    std::map<VkDescriptorType, uint32_t> descriptorCounts;
+    for (uint32_t set = 0; set < setCount; set++)
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        if (auto it = shaderInterface.sets.find(set); it != shaderInterface.sets.end())
+            bindings = it->second;
+        for (const auto &binding : bindings)
+            descriptorCounts[binding.descriptorType] += binding.descriptorCount;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        VkDescriptorSetLayout setLayout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+        layout->setLayouts.push_back(setLayout);
+    }
+    for (const auto &[type, count] : descriptorCounts)
+        layout->copySizes.push_back({type, count});
+
+    /*
+    --- create pipeline layout
+    */
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = shaderInterface.pushConstantStages;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = shaderInterface.pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layout->setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = layout->setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = shaderInterface.pushConstantSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout->pipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    std::cout << "[DEBUG] descriptor interface " << std::hex << hash << std::dec
+              << ": " << setCount << " set(s), " << layout->copySizes.size() << " descriptor type(s), "
+              << shaderInterface.pushConstantSize << " bytes of push constants" << std::endl;
+    return layout;
+}
+
+VkDescriptorPool DescriptorCache::Allocate(InterfaceLayout *layout, std::vector<VkDescriptorSet> &sets)
+{
+    sets.clear();
+    if (layout->setLayouts.empty())
+        return VK_NULL_HANDLE;
+
+    size_t poolIdx = 0;
+    while (poolIdx < layout->pools.size() && layout->poolCopies[poolIdx] >= kCopiesPerPool)
+        poolIdx++;
+
+    if (poolIdx == layout->pools.size())
+    {
+        /*
+        --- create descriptor pool
+        */
+        std::vector<VkDescriptorPoolSize> poolSizes = layout->copySizes;
+        for (auto &poolSize : poolSizes)
+            poolSize.descriptorCount *= kCopiesPerPool;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT; // sets come and go with the swapchain
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = static_cast<uint32_t>(layout->setLayouts.size()) * kCopiesPerPool;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+        layout->pools.push_back(pool);
+        layout->poolCopies.push_back(0);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = layout->pools[poolIdx];
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layout->setLayouts.size());
+    allocInfo.pSetLayouts = layout->setLayouts.data();
+
+    sets.resize(layout->setLayouts.size());
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+    layout->poolCopies[poolIdx]++;
+    return layout->pools[poolIdx];
+}
+
+void DescriptorCache::Free(InterfaceLayout *layout, VkDescriptorPool pool, std::vector<VkDescriptorSet> &sets)
+{
+    if (pool == VK_NULL_HANDLE)
+        return;
+    auto it = std::find(layout->pools.begin(), layout->pools.end(), pool);
+    if (it == layout->pools.end())
+        throw std::runtime_error("[FATAL] descriptor sets freed to a pool their interface does not own");
+
+    vkFreeDescriptorSets(device, pool, static_cast<uint32_t>(sets.size()), sets.data());
+    layout->poolCopies[it - layout->pools.begin()]--;
+    sets.clear();
+}
+
+/*
+    Stand-ins for resources a shader declares but shaderbench does not provide yet (textures, extra buffers),
+    so every declared binding can be written. Created on first use and kept for the lifetime of the device,
+    descriptor sets of every program and of frames in flight point at them.
+*/
+class PlaceholderResources
+{
+public:
+    PlaceholderResources(Device *device);
+    ~PlaceholderResources();
+    VkBuffer Buffer(VkDeviceSize size);
+    VkImageView ImageView();
+    VkSampler Sampler();
+
+private:
+    struct PlaceholderBuffer
+    {
+        VkBuffer buffer;
+        Allocation allocation;
+    };
+
+    Device *device;
+    std::map<VkDeviceSize, PlaceholderBuffer> buffers; // by size class
+    VkImage image;
+    VkImageView imageView;
+    Allocation imageAllocation;
+    VkSampler sampler;
+};
+
+PlaceholderResources::PlaceholderResources(Device *device)
+{
+    this->device = device;
+    image = VK_NULL_HANDLE;
+    imageView = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+}
+
+PlaceholderResources::~PlaceholderResources()
+{
+    if (sampler != VK_NULL_HANDLE)
+        vkDestroySampler(device->handle, sampler, nullptr);
+    if (imageView != VK_NULL_HANDLE)
+        vkDestroyImageView(device->handle, imageView, nullptr);
+    if (image != VK_NULL_HANDLE)
+    {
+        vkDestroyImage(device->handle, image, nullptr);
+        device->allocator->Free(imageAllocation);
+    }
+    for (auto &[sizeClass, placeholder] : buffers)
+    {
+        vkDestroyBuffer(device->handle, placeholder.buffer, nullptr);
+        device->allocator->Free(placeholder.allocation);
+    }
+    buffers.clear();
+}
+
+// zero filled and shared by every placeholder binding of its size class: 64KiB, then powers of two above it.
+// a bigger block gets a buffer of its own class, the smaller ones stay alive for the sets already written
+VkBuffer PlaceholderResources::Buffer(VkDeviceSize size)
+{
+    VkDeviceSize sizeClass = 64 * 1024;
+    while (sizeClass < size)
+        sizeClass *= 2;
+    if (auto it = buffers.find(sizeClass); it != buffers.end())
+        return it->second.buffer;
+
+    VkBuffer buffer;
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = sizeClass;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device->handle, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create buffer!");
+    }
+    auto allocation = device->allocator->BindBuffer(
+        buffer,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        AllocationScope::Persistent,
+        "Placeholder");
+    memset(allocation.mapped, 0, sizeClass);
+    buffers[sizeClass] = {buffer, allocation};
+    return buffer;
+}
+
+// 1x1 black rgba8 image in VK_IMAGE_LAYOUT_GENERAL so it can back both sampled and storage bindings
+VkImageView PlaceholderResources::ImageView()
+{
+    if (imageView != VK_NULL_HANDLE)
+        return imageView;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = {1, 1, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(device->handle, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image!");
+    }
+    imageAllocation = device->allocator->BindImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationScope::Persistent, "Placeholder");
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(device->handle, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image view!");
+    }
+
+    /*
+        one-off transition and clear
+    */
+    submitOneShot(device, [&](VkCommandBuffer commandBuffer)
+                  {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = viewInfo.subresourceRange;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 0.0f}};
+        vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &black, 1, &viewInfo.subresourceRange);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier); });
+
+    return imageView;
+}
+
+VkSampler PlaceholderResources::Sampler()
+{
+    if (sampler != VK_NULL_HANDLE)
+        return sampler;
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = 0.0f;
+    if (vkCreateSampler(device->handle, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create sampler!");
+    }
+    return sampler;
+}
+
+/*
+    One copy of the interface's descriptor sets per swapchain image. The uniform block at uniformSet/uniformBinding
+    (the shadertoy inputs) gets that image's uniform buffer, images listed in boundImages by (set, binding) are
+    written as given (a null sampler takes the placeholder's), every other declared binding gets a placeholder.
+*/
+class DescriptorSet
+{
+public:
+    DescriptorSet(VkDevice device,
+                  DescriptorCache *cache,
+                  InterfaceLayout *layout,
+                  PlaceholderResources *placeholders,
+                  const ShaderReflection &reflection,
+                  uint32_t uniformSet,
+                  uint32_t uniformBinding,
+                  std::vector<VkBuffer> uniformBuffers,
+                  const std::map<std::pair<uint32_t, uint32_t>, VkDescriptorImageInfo> &boundImages = {});
+    ~DescriptorSet();
+
+    std::vector<std::vector<VkDescriptorSet>> handles; // [swapchain image][set number]
+
+private:
+    VkDevice device;
+    DescriptorCache *cache;
+    InterfaceLayout *layout;
+    std::vector<VkDescriptorPool> pools;
+};
+
+DescriptorSet::DescriptorSet(VkDevice device,
+                             DescriptorCache *cache,
+                             InterfaceLayout *layout,
+                             PlaceholderResources *placeholders,
+                             const ShaderReflection &reflection,
+                             uint32_t uniformSet,
+                             uint32_t uniformBinding,
+                             std::vector<VkBuffer> uniformBuffers,
+                             const std::map<std::pair<uint32_t, uint32_t>, VkDescriptorImageInfo> &boundImages)
+{
+    this->device = device;
+    this->cache = cache;
+    this->layout = layout;
+
+    /*
+    --- create descriptor sets
+    */
+    handles.resize(uniformBuffers.size());
+    for (size_t idx = 0; idx < uniformBuffers.size(); idx++)
+        pools.push_back(cache->Allocate(layout, handles[idx]));
+
+    /*
+    --- update descriptor sets
+    */
+    for (size_t idx = 0; idx < uniformBuffers.size(); idx++)
+    {
+        // the infos are referenced by pointer until vkUpdateDescriptorSets, size them up front
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+        std::vector<VkDescriptorImageInfo> imageInfos;
+        size_t descriptorCount = 0;
+        for (const auto &resource : reflection.bindings)
+            descriptorCount += resource.count;
+        bufferInfos.reserve(descriptorCount);
+        imageInfos.reserve(descriptorCount);
+
+        for (const auto &resource : reflection.bindings)
+        {
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = handles[idx][resource.set];
+            write.dstBinding = resource.binding;
+            write.dstArrayElement = 0;
+            write.descriptorType = resource.type;
+            write.descriptorCount = resource.count;
+
+            switch (resource.type)
+            {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            {
+                bool inputs = resource.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER &&
+                              resource.set == uniformSet && resource.binding == uniformBinding;
+                write.pBufferInfo = bufferInfos.data() + bufferInfos.size();
+                for (uint32_t element = 0; element < resource.count; element++)
+                {
+                    VkDescriptorBufferInfo bufferInfo{};
+                    bufferInfo.buffer = inputs ? uniformBuffers[idx] : placeholders->Buffer(resource.size);
+                    bufferInfo.offset = 0;
+                    // uniform ranges are capped by maxUniformBufferRange, storage blocks may end in a runtime array
+                    bufferInfo.range = resource.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ? std::max<VkDeviceSize>(resource.size, 16) : VK_WHOLE_SIZE;
+                    bufferInfos.push_back(bufferInfo);
+                }
+                break;
+            }
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+            case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+            {
+                auto bound = boundImages.find({resource.set, resource.binding});
+                write.pImageInfo = imageInfos.data() + imageInfos.size();
+                for (uint32_t element = 0; element < resource.count; element++)
+                {
+                    VkDescriptorImageInfo imageInfo{};
+                    if (bound != boundImages.end())
+                        imageInfo = bound->second;
+                    if (resource.type != VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE && resource.type != VK_DESCRIPTOR_TYPE_STORAGE_IMAGE && imageInfo.sampler == VK_NULL_HANDLE)
+                        imageInfo.sampler = placeholders->Sampler();
+                    if (resource.type != VK_DESCRIPTOR_TYPE_SAMPLER && imageInfo.imageView == VK_NULL_HANDLE)
+                    {
+                        imageInfo.imageView = placeholders->ImageView();
+                        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                    }
+                    if (imageInfo.imageLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+                        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                    imageInfos.push_back(imageInfo);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("[FATAL] binding \'" + resource.name + "\' uses a descriptor type shaderbench cannot provide (" + std::to_string(resource.type) + ")");
+            }
+            descriptorWrites.push_back(write);
+        }
+
+        // used to set which resources are used by a descriptor set
+        if (!descriptorWrites.empty())
+            vkUpdateDescriptorSets(
+                device,
+                static_cast<uint32_t>(descriptorWrites.size()),
+                descriptorWrites.data(),
+                0,
+                nullptr);
+    }
+}
+DescriptorSet::~DescriptorSet()
+{
+    for (size_t idx = 0; idx < handles.size(); idx++)
+        cache->Free(layout, pools[idx], handles[idx]);
+    handles.clear();
+    pools.clear();
+}
+
+/*
+    --- gpu timing
+*/
+// a begin/end timestamp pair per region, one set of regions per swapchain image
+class GpuTimer
+{
+public:
+    GpuTimer(Device *device, uint32_t slots, uint32_t regions);
+    ~GpuTimer();
+    // outside a render pass, before the slot's first Begin
+    void Reset(VkCommandBuffer commandBuffer, uint32_t slot);
+    // a begin at the bottom of the pipe waits for every earlier command, for incremental times of draws behind others
+    void Begin(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t region, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    void End(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t region);
+    // milliseconds per region from the slot's last execution; false while any of them is unavailable
+    // or was not written since the slot's last Reset
+    bool Read(uint32_t slot, std::vector<double> &milliseconds);
+
+    uint32_t regions;
+
+private:
+    VkDevice device;
+    VkQueryPool pool;
+    double nanosecondsPerTick;
+    uint64_t validMask;
+    std::vector<uint8_t> written; // [slot * regions + region], bytes so recording threads can set their own regions
+};
+
+GpuTimer::GpuTimer(Device *device, uint32_t slots, uint32_t regions)
+{
+    this->device = device->handle;
+    this->regions = regions;
+    nanosecondsPerTick = device->deviceProperties.limits.timestampPeriod;
+    validMask = device->timestampValidBits >= 64 ? ~0ull : (1ull << device->timestampValidBits) - 1;
+    written.assign(slots * regions, 0);
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = slots * regions * 2;
+    if (vkCreateQueryPool(this->device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (pool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(device, pool, nullptr);
+    pool = VK_NULL_HANDLE;
+}
+
+void GpuTimer::Reset(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    vkCmdResetQueryPool(commandBuffer, pool, slot * regions * 2, regions * 2);
+    std::fill(written.begin() + slot * regions, written.begin() + (slot + 1) * regions, 0);
+}
+
+void GpuTimer::Begin(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t region, VkPipelineStageFlagBits stage)
+{
+    vkCmdWriteTimestamp(commandBuffer, stage, pool, (slot * regions + region) * 2);
+}
+
+void GpuTimer::End(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t region)
+{
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, (slot * regions + region) * 2 + 1);
+    written[slot * regions + region] = 1;
+}
+
+bool GpuTimer::Read(uint32_t slot, std::vector<double> &milliseconds)
+{
+    // a query that was never reset has no defined state to read
+    if (std::find(written.begin() + slot * regions, written.begin() + (slot + 1) * regions, 0) != written.begin() + (slot + 1) * regions)
+        return false;
+    std::vector<uint64_t> ticks(regions * 2);
+    auto status = vkGetQueryPoolResults(device,
+                                        pool,
+                                        slot * regions * 2,
+                                        regions * 2,
+                                        ticks.size() * sizeof(uint64_t),
+                                        ticks.data(),
+                                        sizeof(uint64_t),
+                                        VK_QUERY_RESULT_64_BIT);
+    if (status != VK_SUCCESS)
+        return false;
+
+    milliseconds.resize(regions);
+    for (uint32_t region = 0; region < regions; region++)
+    {
+        uint64_t elapsed = ((ticks[region * 2 + 1] & validMask) - (ticks[region * 2] & validMask)) & validMask;
+        milliseconds[region] = elapsed * nanosecondsPerTick * 1e-6;
+    }
+    return true;
+}
+
+// everything needed to issue one draw; timerRegion < 0 leaves the draw untimed
+struct DrawCall
+{
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+    std::vector<VkDescriptorSet> descriptorSets;
+    VkShaderStageFlags pushConstantStages;
+    std::vector<uint8_t> pushConstants;
+    int timerRegion;
+    std::optional<VkRect2D> scissor = std::nullopt; // only for pipelines with a dynamic scissor
+};
+
+/*
+    Draws in one render pass overlap on the gpu, so timestamps around each would overlap as well. A timed draw
+    after others in its pass (passOffset + idx > 0) begins its time once every earlier command has finished, so
+    its time is incremental: how much longer the gpu stayed busy because of it. Work it shared with the draws
+    before it is counted for them, and the times of a pass add up to its whole length.
+*/
+void RecordDraws(VkCommandBuffer commandBuffer,
+                 const DrawCall *draws,
+                 size_t drawCount,
+                 GpuTimer *timer,
+                 uint32_t timerSlot,
+                 size_t passOffset = 0)
+{
+    for (size_t idx = 0; idx < drawCount; idx++)
+    {
+        const auto &draw = draws[idx];
+        if (timer != nullptr && draw.timerRegion >= 0)
+        {
+            if (passOffset + idx > 0)
+                timer->Begin(commandBuffer, timerSlot, draw.timerRegion, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+            else
+                timer->Begin(commandBuffer, timerSlot, draw.timerRegion);
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+        if (draw.scissor.has_value())
+            vkCmdSetScissor(commandBuffer, 0, 1, &draw.scissor.value());
+
+        if (!draw.descriptorSets.empty())
+            vkCmdBindDescriptorSets(commandBuffer,
+                                    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    draw.layout,
+                                    0,
+                                    static_cast<uint32_t>(draw.descriptorSets.size()),
+                                    draw.descriptorSets.data(),
+                                    0,
+                                    nullptr);
+
+        if (!draw.pushConstants.empty())
+            vkCmdPushConstants(commandBuffer,
+                               draw.layout,
+                               draw.pushConstantStages,
+                               0,
+                               static_cast<uint32_t>(draw.pushConstants.size()),
+                               draw.pushConstants.data());
+
+        vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+
+        if (timer != nullptr && draw.timerRegion >= 0)
+            timer->End(commandBuffer, timerSlot, draw.timerRegion);
+    }
+}
+
+/*
+    --- parallel recording
+*/
+// fixed set of threads for fork/join jobs; the calling thread takes part as worker 0
+class WorkerPool
+{
+public:
+    WorkerPool(uint32_t threadCount);
+    ~WorkerPool();
+    // runs job(worker, index) for every index in [0, count) and returns once all have finished
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)> &job);
+
+    uint32_t threadCount;
+
+private:
+    void workerLoop(uint32_t worker);
+    void drain(uint32_t worker);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(uint32_t, uint32_t)> *job;
+    std::atomic<uint32_t> nextIndex;
+    uint32_t count;
+    uint32_t busyWorkers;
+    uint64_t generation;
+    bool stopping;
+    std::exception_ptr error;
+};
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+{
+    this->threadCount = std::max(threadCount, 1u);
+    job = nullptr;
+    nextIndex = 0;
+    count = 0;
+    busyWorkers = 0;
+    generation = 0;
+    stopping = false;
+    for (uint32_t worker = 1; worker < this->threadCount; worker++)
+        threads.emplace_back(&WorkerPool::workerLoop, this, worker);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void WorkerPool::drain(uint32_t worker)
+{
+    try
+    {
+        for (uint32_t index = nextIndex++; index < count; index = nextIndex++)
+            (*job)(worker, index);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+            error = std::current_exception();
+        nextIndex = count; // stop handing out work
+    }
+}
+
+void WorkerPool::workerLoop(uint32_t worker)
+{
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]
+                      { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+        }
+
+        drain(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0)
+            finished.notify_one();
+    }
+}
+
+void WorkerPool::ParallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)> &job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->count = count;
+        nextIndex = 0;
+        busyWorkers = static_cast<uint32_t>(threads.size());
+        error = nullptr;
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]
+                  { return busyWorkers == 0; });
+    this->job = nullptr;
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// one render pass instance and the draws inside it
+struct PassRecording
+{
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+    const std::vector<DrawCall> *draws;
+};
+
+/*
+    Re-records each swapchain image's primary command buffer every frame.
+    With more than one worker each pass's draws are split into one contiguous chunk per worker, each recorded into a
+    secondary command buffer from its own command pool, and executed in order from the primary.
+    A chunk's pool is only ever used by the thread recording that chunk, and pools are per image so
+    recording never resets a pool whose buffers the gpu may still be reading.
+*/
+class CommandRecorder
+{
+public:
+    CommandRecorder(Device *device, WorkerPool *workers, size_t numImages);
+    ~CommandRecorder();
+    VkCommandBuffer Record(uint32_t imageIdx, const std::vector<PassRecording> &passes, GpuTimer *timer);
+    VkCommandBuffer Record(uint32_t imageIdx,
+                           VkRenderPass renderPass,
+                           VkFramebuffer framebuffer,
+                           VkExtent2D extent,
+                           const std::vector<DrawCall> &draws,
+                           GpuTimer *timer);
+
+private:
+    struct ImageCommands
+    {
+        VkCommandPool primaryPool;
+        VkCommandBuffer primary;
+        std::vector<std::vector<VkCommandPool>> chunkPools;     // [pass][chunk]
+        std::vector<std::vector<VkCommandBuffer>> secondaries; // [pass][chunk]
+    };
+    void reservePasses(ImageCommands &image, size_t passCount);
+    VkCommandPool createPool();
+    VkCommandBuffer allocate(VkCommandPool pool, VkCommandBufferLevel level);
+
+    VkDevice device;
+    uint32_t queueFamilyIndex;
+    WorkerPool *workers;
+    std::vector<ImageCommands> images;
+};
+
+CommandRecorder::CommandRecorder(Device *device, WorkerPool *workers, size_t numImages)
+{
+    this->device = device->handle;
+    this->queueFamilyIndex = device->queueFamilyIndex;
+    this->workers = workers;
+
+    images.resize(numImages);
+    for (auto &image : images)
+    {
+        image.primaryPool = createPool();
+        image.primary = allocate(image.primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        reservePasses(image, 1);
+    }
+}
+
+CommandRecorder::~CommandRecorder()
+{
+    // destroying a pool frees the command buffers allocated from it
+    for (auto &image : images)
+    {
+        vkDestroyCommandPool(device, image.primaryPool, nullptr);
+        for (auto &pools : image.chunkPools)
+            for (auto pool : pools)
+                vkDestroyCommandPool(device, pool, nullptr);
+    }
+    images.clear();
+}
+
+// secondaries are only needed with more than one worker; passes beyond the first get theirs on first use
+void CommandRecorder::reservePasses(ImageCommands &image, size_t passCount)
+{
+    if (workers->threadCount < 2)
+        return;
+    while (image.secondaries.size() < passCount)
+    {
+        image.chunkPools.emplace_back();
+        image.secondaries.emplace_back();
+        for (uint32_t chunk = 0; chunk < workers->threadCount; chunk++)
+        {
+            image.chunkPools.back().push_back(createPool());
+            image.secondaries.back().push_back(allocate(image.chunkPools.back().back(), VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+        }
+    }
+}
+
+VkCommandPool CommandRecorder::createPool()
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // reset as a whole every frame
+
+    VkCommandPool pool;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create command pool!");
+    }
+    return pool;
+}
+
+VkCommandBuffer CommandRecorder::allocate(VkCommandPool pool, VkCommandBufferLevel level)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = pool;
+    allocInfo.level = level;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+    return commandBuffer;
+}
+
+// the previous submission of imageIdx must have completed
+VkCommandBuffer CommandRecorder::Record(uint32_t imageIdx, const std::vector<PassRecording> &passes, GpuTimer *timer)
+{
+    auto &image = images[imageIdx];
+    vkResetCommandPool(device, image.primaryPool, 0);
+    reservePasses(image, passes.size());
+
+    // chunk count per pass and where each pass's chunks start in the flat job index
+    std::vector<uint32_t> passChunks(passes.size(), 0);
+    std::vector<uint32_t> firstJob(passes.size(), 0);
+    uint32_t jobs = 0;
+    for (size_t pass = 0; pass < passes.size(); pass++)
+    {
+        if (!image.secondaries.empty())
+            passChunks[pass] = std::min<uint32_t>(workers->threadCount, static_cast<uint32_t>(passes[pass].draws->size()));
+        firstJob[pass] = jobs;
+        jobs += passChunks[pass];
+    }
+
+    if (jobs > 0)
+    {
+        workers->ParallelFor(jobs, [&](uint32_t /*worker*/, uint32_t job)
+                             {
+            // passes without chunks share their start with the next pass, so the last start <= job is the owner
+            size_t pass = std::upper_bound(firstJob.begin(), firstJob.end(), job) - firstJob.begin() - 1;
+            uint32_t chunk = job - firstJob[pass];
+            uint32_t chunks = passChunks[pass];
+            const auto &draws = *passes[pass].draws;
+            auto commandBuffer = image.secondaries[pass][chunk];
+            vkResetCommandPool(device, image.chunkPools[pass][chunk], 0);
+
+            VkCommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritanceInfo.renderPass = passes[pass].renderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = passes[pass].framebuffer;
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+
+            size_t first = draws.size() * chunk / chunks;
+            size_t last = draws.size() * (chunk + 1) / chunks;
+            RecordDraws(commandBuffer, draws.data() + first, last - first, timer, imageIdx, first);
+
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+                throw std::runtime_error("failed to record secondary command buffer!"); });
+    }
+
+    /*
+        primary: query reset, then per pass the render pass with either the draws inline or the secondaries in chunk order
+    */
+    auto commandBuffer = image.primary;
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    if (timer != nullptr)
+        timer->Reset(commandBuffer, imageIdx);
+
+    for (size_t pass = 0; pass < passes.size(); pass++)
+    {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = passes[pass].renderPass;
+        renderPassInfo.framebuffer = passes[pass].framebuffer;
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = passes[pass].extent;
+
+        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        if (passChunks[pass] > 0)
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(commandBuffer, passChunks[pass], image.secondaries[pass].data());
+        }
+        else
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            RecordDraws(commandBuffer, passes[pass].draws->data(), passes[pass].draws->size(), timer, imageIdx);
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+    return commandBuffer;
+}
+
+VkCommandBuffer CommandRecorder::Record(uint32_t imageIdx,
+                                        VkRenderPass renderPass,
+                                        VkFramebuffer framebuffer,
+                                        VkExtent2D extent,
+                                        const std::vector<DrawCall> &draws,
+                                        GpuTimer *timer)
+{
+    return Record(imageIdx, {{renderPass, framebuffer, extent, &draws}}, timer);
+}
+
+/*
+    --- gallery
+*/
+const uint32_t kMaxGalleryCells = 64;
+
+// near square grid of cells covering extent, row major
+std::vector<VkRect2D> galleryCells(VkExtent2D extent, size_t count)
+{
+    uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    uint32_t rows = static_cast<uint32_t>((count + columns - 1) / columns);
+    uint32_t width = std::max(extent.width / columns, 1u);
+    uint32_t height = std::max(extent.height / rows, 1u);
+
+    std::vector<VkRect2D> cells;
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        VkRect2D cell{};
+        cell.offset = {static_cast<int32_t>((idx % columns) * width), static_cast<int32_t>((idx / columns) * height)};
+        cell.extent = {width, height};
+        cells.push_back(cell);
+    }
+    return cells;
+}
+
+/*
+    Cells are drawn through an offset viewport but gl_FragCoord stays framebuffer relative.
+    Rewrite it to a cell relative expression whose origin is a specialization constant,
+    set per pipeline, so gallery shaders need no changes and the fragment shader is compiled only once.
+    A checkerboard parity constant likewise maps a half width target's pixels back to the full frame.
+*/
+const uint32_t kCellOriginConstantId = 1000; // x, y is kCellOriginConstantId + 1
+const uint32_t kParityConstantId = 1002;     // -1 shades every pixel, 0 or 1 the checkerboard half for that frame parity
+
+// matches the constants declared by rewriteFragCoord
+struct FragCoordConstants
+{
+    float cellOrigin[2];
+    int32_t parity;
+};
+
+/*
+    Puts header after the #version and any #extension lines of source, where declarations may start, and applies
+    the replacement to every line of the user's code. A #line directive keeps compiler errors pointing at the
+    user's line numbers.
+*/
+std::string injectHeader(const std::string &source, const std::string &header, const std::regex &pattern, const std::string &replacement)
+{
+    std::stringstream in(source);
+    std::vector<std::string> lines;
+    size_t insertAt = 0;
+    for (std::string line; std::getline(in, line);)
+    {
+        auto first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && (line.compare(first, 8, "#version") == 0 || line.compare(first, 10, "#extension") == 0))
+            insertAt = lines.size() + 1;
+        lines.push_back(line);
+    }
+
+    std::stringstream out;
+    for (size_t idx = 0; idx <= lines.size(); idx++)
+    {
+        // insertAt may be one past the last line, when the file ends in its preamble
+        if (idx == insertAt)
+            out << header << "#line " << idx + 1 << "\n";
+        if (idx < lines.size())
+            out << std::regex_replace(lines[idx], pattern, replacement) << "\n";
+    }
+    return out.str();
+}
+
+std::string rewriteFragCoord(const std::string &source)
+{
+    std::stringstream header;
+    header << "layout(constant_id = " << kCellOriginConstantId << ") const float sbCellOriginX = 0.0;\n"
+           << "layout(constant_id = " << kCellOriginConstantId + 1 << ") const float sbCellOriginY = 0.0;\n"
+           << "layout(constant_id = " << kParityConstantId << ") const int sbParity = -1;\n"
+           << "vec4 sbFragCoordOf(vec4 coord) {\n"
+           << "    if (sbParity >= 0)\n"
+           << "        coord.x = floor(coord.x) * 2.0 + float((int(coord.y) + sbParity) & 1) + 0.5;\n"
+           << "    return coord - vec4(sbCellOriginX, sbCellOriginY, 0.0, 0.0);\n"
+           << "}\n"
+           << "#define sbFragCoord sbFragCoordOf(gl_FragCoord)\n";
+    return injectHeader(source, header.str(), std::regex("\\bgl_FragCoord\\b"), "sbFragCoord");
+}
+
+// gpu time per cell drawn as "ddd.ddd" milliseconds in the top left corner of the cell, see builtin/overlay.vert and .frag
+// matches OverlayBox in the overlay shaders
+struct OverlayPushConstants
+{
+    float box[4];
+    float extent[2];
+    uint32_t cell;
+};
+
+const uint32_t kOverlayWidth = 30 * 3; // padding + 7 glyphs of 4 texels, at 3 pixels per texel
+const uint32_t kOverlayHeight = 7 * 3;
+
+/*
+    One fragment shader and everything that has to be rebuilt around it when the swapchain changes.
+    The compiled module, reflection and layouts survive resizes.
+*/
+struct ShaderProgram
+{
+    std::string path;
+    std::vector<uint32_t> spirv;
+    ShaderReflection reflection;
+    ShaderCost cost;
+    UniformLayout *uniformLayout; // nullptr for builtin programs that fill their uniforms themselves
+    InterfaceLayout *interfaceLayout;
+    uint32_t costSet = UINT32_MAX; // instrumented with clock reads, the descriptor set of the cost image
+
+    // per swapchain
+    VkRect2D cell;
+    Uniform *uniform;
+    DescriptorSet *descriptorSet;
+    Pipeline *pipeline;
+    std::array<Pipeline *, 2> parityPipelines; // checkerboard mode, one per frame parity, instead of pipeline
+};
+
+/*
+    --- accumulation
+*/
+/*
+    builtin/resolve.frag draws the accumulated sum scaled by 1 / samples. The target is factor times the swapchain
+    extent along each axis, 1 for every mode but supersampling, so each pixel averages its factor x factor block of
+    texels.
+*/
+struct ResolvePushConstants
+{
+    float scale;
+    int32_t factor;
+};
+
+/*
+    --- checkerboard
+*/
+/*
+    Each frame shades half the pixels, in a checkerboard whose phase follows iFrame parity, into a half width target.
+    Pixel x' of row y in the target is pixel 2x' + ((y + parity) & 1) of the full frame (see rewriteFragCoord).
+    The reconstruction takes this frame's half as is and fills the other half from the previous frame's target,
+    clamped to the range of the four neighbours shaded this frame to limit ghosting where the image changed.
+*/
+const VkFormat kCheckerboardFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// matches Reconstruct in builtin/reconstruct.frag
+struct ReconstructPushConstants
+{
+    int32_t parity;
+    int32_t history;
+};
+
+/*
+    --- heatmap
+*/
+/*
+    Where VK_KHR_shader_clock is available the user's main() is wrapped in subgroup clock reads and every pixel
+    stores its cycle count into an r32ui storage image the size of the frame. Without it the frame is drawn in
+    kHeatmapTileSide tiles, one timestamped draw each, and the cost image holds a nanosecond count per tile. In
+    both cases the swapchain pass shows the frame in grey under a false color ramp of the cost.
+*/
+const VkFormat kHeatmapTargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
+const VkFormat kCostFormat = VK_FORMAT_R32_UINT;
+const uint32_t kHeatmapTileSide = 64;
+const double kHeatmapReportSeconds = 1.0;
+const double kHeatmapTopFraction = 0.05; // the share of the cost spent in this fraction of the costliest pixels is reported
+
+// renames the user's main and calls it between two clock reads; the cost image goes in its own descriptor set
+std::string instrumentClock(const std::string &source, uint32_t costSet)
+{
+    std::stringstream header;
+    header << "#extension GL_ARB_shader_clock : require\n"
+           << "layout(set = " << costSet << ", binding = 0, r32ui) uniform writeonly uimage2D sbCost;\n";
+    std::stringstream out;
+    out << injectHeader(source, header.str(), std::regex("\\bvoid(\\s+)main(\\s*)\\("), "void$1sbUserMain$2(")
+        << "void main() {\n"
+        << "    uvec2 sbStart = clock2x32ARB();\n"
+        << "    sbUserMain();\n"
+        << "    uvec2 sbEnd = clock2x32ARB();\n"
+        << "    imageStore(sbCost, ivec2(gl_FragCoord.xy), uvec4(sbEnd.x - sbStart.x));\n"
+        << "}\n";
+    return out.str();
+}
+
+// builtin/heatmap.frag draws the frame in grey, tinted from blue (cheapest) to red (costliest) by the cost of its pixel or tile
+struct HeatmapPushConstants
+{
+    float low;
+    float high;
+    int32_t cellSide;
+};
+
+// one uint per pixel or tile, kept in VK_IMAGE_LAYOUT_GENERAL for shader stores, loads and copies alike
+class CostImage
+{
+public:
+    CostImage(Device *device, VkExtent2D extent);
+    ~CostImage();
+    // the device must be idle for both
+    std::vector<uint32_t> Read();
+    void Write(const std::vector<uint32_t> &values);
+
+    VkImage image;
+    VkImageView view;
+    VkExtent2D extent;
+
+private:
+    VkBuffer CreateStaging(VkBufferUsageFlags usage, Allocation &allocation);
+
+    Device *device;
+    Allocation allocation;
+};
+
+CostImage::CostImage(Device *device, VkExtent2D extent)
+{
+    this->device = device;
+    this->extent = extent;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = kCostFormat;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(device->handle, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image!");
+    }
+    allocation = device->allocator->BindImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationScope::Extent, "Cost");
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = kCostFormat;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    if (vkCreateImageView(device->handle, &viewInfo, nullptr, &view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image view!");
+    }
+
+    // zeroed, so the overlay reads something defined before the first frame lands
+    submitOneShot(device, [&](VkCommandBuffer commandBuffer)
+                  {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = viewInfo.subresourceRange;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkClearColorValue zero{};
+        vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &viewInfo.subresourceRange);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier); });
+}
+
+CostImage::~CostImage()
+{
+    vkDestroyImageView(device->handle, view, nullptr);
+    vkDestroyImage(device->handle, image, nullptr);
+    device->allocator->Free(allocation);
+}
+
+VkBuffer CostImage::CreateStaging(VkBufferUsageFlags usage, Allocation &stagingAllocation)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = sizeof(uint32_t) * extent.width * extent.height;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer;
+    if (vkCreateBuffer(device->handle, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create buffer!");
+    }
+    stagingAllocation = device->allocator->BindBuffer(
+        buffer,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        AllocationScope::Extent,
+        "CostStaging");
+    return buffer;
+}
+
+// row major, top row first
+std::vector<uint32_t> CostImage::Read()
+{
+    Allocation stagingAllocation;
+    VkBuffer buffer = this->CreateStaging(VK_BUFFER_USAGE_TRANSFER_DST_BIT, stagingAllocation);
+    submitOneShot(device, [&](VkCommandBuffer commandBuffer)
+                  {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, buffer, 1, &region); });
+
+    std::vector<uint32_t> values(static_cast<size_t>(extent.width) * extent.height);
+    memcpy(values.data(), stagingAllocation.mapped, values.size() * sizeof(uint32_t));
+    vkDestroyBuffer(device->handle, buffer, nullptr);
+    device->allocator->Free(stagingAllocation);
+    return values;
+}
+
+void CostImage::Write(const std::vector<uint32_t> &values)
+{
+    if (values.size() != static_cast<size_t>(extent.width) * extent.height)
+        throw std::runtime_error("[FATAL] cost image write of " + std::to_string(values.size()) + " values does not match its extent");
+    Allocation stagingAllocation;
+    VkBuffer buffer = this->CreateStaging(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingAllocation);
+    memcpy(stagingAllocation.mapped, values.data(), values.size() * sizeof(uint32_t));
+    submitOneShot(device, [&](VkCommandBuffer commandBuffer)
+                  {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr); });
+    vkDestroyBuffer(device->handle, buffer, nullptr);
+    device->allocator->Free(stagingAllocation);
+}
+
+struct CostDistribution
+{
+    uint32_t min, p50, p90, p99, max;
+    double topShare; // of the summed cost, spent in the costliest kHeatmapTopFraction of the values
+};
+
+CostDistribution summarizeCosts(std::vector<uint32_t> values)
+{
+    CostDistribution distribution{};
+    if (values.empty())
+        return distribution;
+    std::sort(values.begin(), values.end());
+    auto at = [&](double fraction)
+    { return values[std::min(values.size() - 1, static_cast<size_t>(fraction * static_cast<double>(values.size())))]; };
+    distribution.min = values.front();
+    distribution.p50 = at(0.5);
+    distribution.p90 = at(0.9);
+    distribution.p99 = at(0.99);
+    distribution.max = values.back();
+
+    size_t top = std::max<size_t>(1, static_cast<size_t>(kHeatmapTopFraction * static_cast<double>(values.size())));
+    double total = std::accumulate(values.begin(), values.end(), 0.0);
+    double costliest = std::accumulate(values.end() - static_cast<std::ptrdiff_t>(top), values.end(), 0.0);
+    distribution.topShare = total > 0.0 ? costliest / total : 0.0;
+    return distribution;
+}
+
+/*
+    --- ablation
+*/
+/*
+    A poor man's profiler that works on any driver: every user function and every outermost loop is in turn replaced
+    by a cheap stub, a function body by a zero of its return type and a loop by nothing, and the time the variant
+    saves over the full shader is charged to it. Sites whose stub does not compile (struct return types, say) are
+    reported and skipped. Savings overlap, a loop inside a function counts towards both.
+*/
+const size_t kAblationTableRows = 20;
+
+struct AblationSite
+{
+    std::string name; // "march()" or "loop in march()"
+    size_t line;      // 1 based, in the user's source
+    size_t begin, end; // byte range replaced by stub
+    std::string stub;
+};
+
+// comments and preprocessor lines blanked to spaces, so offsets still index the original
+std::string maskGlsl(const std::string &source)
+{
+    std::string masked = source;
+    size_t idx = 0;
+    bool lineStart = true;
+    while (idx < masked.size())
+    {
+        size_t first = lineStart ? masked.find_first_not_of(" \t", idx) : idx;
+        bool directive = first != std::string::npos && masked[first] == '#';
+        if (directive || masked.compare(idx, 2, "//") == 0)
+        {
+            while (idx < masked.size() && masked[idx] != '\n')
+                masked[idx++] = ' ';
+            continue;
+        }
+        if (masked.compare(idx, 2, "/*") == 0)
+        {
+            auto close = masked.find("*/", idx + 2);
+            close = close == std::string::npos ? masked.size() : close + 2;
+            for (; idx < close; idx++)
+            {
+                if (masked[idx] != '\n')
+                    masked[idx] = ' ';
+            }
+            continue;
+        }
+        lineStart = masked[idx] == '\n';
+        idx++;
+    }
+    return masked;
+}
+
+// index one past the bracket closing the one at open, npos if unbalanced
+size_t matchingBracket(const std::string &masked, size_t open)
+{
+    char opening = masked[open];
+    char closing = opening == '(' ? ')' : '}';
+    int depth = 0;
+    for (size_t idx = open; idx < masked.size(); idx++)
+    {
+        if (masked[idx] == opening)
+            depth++;
+        else if (masked[idx] == closing && --depth == 0)
+            return idx + 1;
+    }
+    return std::string::npos;
+}
+
+std::vector<AblationSite> findAblationSites(const std::string &source)
+{
+    std::string masked = maskGlsl(source);
+    auto lineOf = [&](size_t offset)
+    { return static_cast<size_t>(std::count(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(offset), '\n')) + 1; };
+    const std::regex header("^\\s*(?:(?:highp|mediump|lowp|const|precise)\\s+)*(\\w+)\\s+(\\w+)\\s*\\([^)]*\\)\\s*$");
+    const std::regex loop("\\b(for|while)\\s*\\(");
+
+    std::vector<AblationSite> sites;
+    size_t statementStart = 0;
+    for (size_t idx = 0; idx < masked.size(); idx++)
+    {
+        if (masked[idx] == ';' || masked[idx] == '}')
+        {
+            statementStart = idx + 1;
+            continue;
+        }
+        if (masked[idx] != '{')
+            continue;
+
+        size_t bodyEnd = matchingBracket(masked, idx);
+        if (bodyEnd == std::string::npos)
+            break;
+        std::smatch match;
+        std::string declaration = masked.substr(statementStart, idx - statementStart);
+        if (!std::regex_match(declaration, match, header) || match[1] == "struct")
+        {
+            // a struct or interface block, nothing to stub
+            statementStart = bodyEnd;
+            idx = bodyEnd - 1;
+            continue;
+        }
+        std::string returnType = match[1], name = match[2];
+        if (name != "main")
+            sites.push_back({name + "()", lineOf(idx), idx, bodyEnd, returnType == "void" ? "{ }" : "{ return " + returnType + "(0); }"});
+
+        // outermost loops in the body; a while following a do body is the tail of a do-while and stays
+        auto bodyBegin = masked.begin() + static_cast<std::ptrdiff_t>(idx);
+        for (std::sregex_iterator it(bodyBegin, masked.begin() + static_cast<std::ptrdiff_t>(bodyEnd), loop), last; it != last; ++it)
+        {
+            size_t keyword = idx + static_cast<size_t>(it->position(0));
+            if (!sites.empty() && keyword < sites.back().end && sites.back().name.rfind("loop", 0) == 0)
+                continue;
+            size_t conditionEnd = matchingBracket(masked, keyword + static_cast<size_t>(it->length(0)) - 1);
+            size_t loopBody = conditionEnd == std::string::npos ? std::string::npos : masked.find_first_not_of(" \t\r\n", conditionEnd);
+            if (loopBody == std::string::npos || masked[loopBody] != '{')
+                continue;
+            size_t loopEnd = matchingBracket(masked, loopBody);
+            if (loopEnd == std::string::npos || loopEnd > bodyEnd)
+                continue;
+            sites.push_back({"loop in " + name + "()", lineOf(keyword), keyword, loopEnd, "{ }"});
+        }
+        statementStart = bodyEnd;
+        idx = bodyEnd - 1;
+    }
+    return sites;
+}
+
+std::string ablate(const std::string &source, const AblationSite &site)
+{
+    return source.substr(0, site.begin) + site.stub + source.substr(site.end);
+}
+
+/*
+    --- frame pacing
+*/
+// summary statistics over a window of samples
+struct SampleStats
+{
+    std::vector<double> values;
+
+    void Add(double value) { values.push_back(value); }
+    void Clear() { values.clear(); }
+    size_t Count() const { return values.size(); }
+    double Mean() const
+    {
+        if (values.empty())
+            return 0.0;
+        double sum = 0.0;
+        for (auto value : values)
+            sum += value;
+        return sum / values.size();
+    }
+    double StdDev() const
+    {
+        if (values.size() < 2)
+            return 0.0;
+        auto mean = Mean();
+        double sum = 0.0;
+        for (auto value : values)
+            sum += (value - mean) * (value - mean);
+        return std::sqrt(sum / (values.size() - 1));
+    }
+    // p in [0, 1], nearest rank
+    double Percentile(double p) const
+    {
+        if (values.empty())
+            return 0.0;
+        std::vector<double> sorted = values;
+        size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+};
+
+/*
+    Measures present-to-present intervals and missed vblanks for every frame.
+    With VK_KHR_present_wait the intervals are taken from when the presentation engine reports each present id as done,
+    which also gives the latency from starting to acquire an image until that image is on screen.
+    vkWaitForPresentKHR is polled with a zero timeout once per frame so the render loop never blocks on it,
+    completion times are therefore only as precise as the frame rate.
+    Without present wait the intervals are taken from when vkQueuePresentKHR returns.
+*/
+class FramePacing
+{
+public:
+    FramePacing(double refreshRate, bool usePresentWait)
+        : refreshPeriodMs(1000.0 / refreshRate), usePresentWait(usePresentWait), missedVblanks(0), totalFrames(0), totalMissedVblanks(0) {}
+
+    void Presented(uint64_t presentId, std::chrono::high_resolution_clock::time_point acquireStart)
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        if (usePresentWait)
+            pending.push_back({presentId, acquireStart});
+        else
+            addInterval(now);
+    }
+
+    void Poll(VkDevice device, VkSwapchainKHR swapChain, PFN_vkWaitForPresentKHR waitForPresent)
+    {
+        // present ids complete in order, stop at the first one that is still queued
+        while (!pending.empty())
+        {
+            if (waitForPresent(device, swapChain, pending.front().presentId, 0) != VK_SUCCESS)
+                break;
+            auto now = std::chrono::high_resolution_clock::now();
+            latencies.Add(std::chrono::duration<double, std::milli>(now - pending.front().acquireStart).count());
+            addInterval(now);
+            pending.pop_front();
+        }
+    }
+
+    // present ids belong to a swapchain, forget the ones queued on a swapchain that is about to be destroyed
+    void SwapChainRecreated()
+    {
+        pending.clear();
+        lastPresent.reset();
+    }
+
+    // one line for the periodic stats output, clears the window
+    std::string Summary()
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+           << "interval p50 " << intervals.Percentile(0.5) << " p99 " << intervals.Percentile(0.99)
+           << " sd " << intervals.StdDev() << " ms, missed vblanks " << missedVblanks;
+        if (usePresentWait)
+            ss << ", latency p50 " << latencies.Percentile(0.5) << " p99 " << latencies.Percentile(0.99) << " ms";
+
+        intervals.Clear();
+        latencies.Clear();
+        missedVblanks = 0;
+        return ss.str();
+    }
+
+    void Report(std::ostream &out, VkPresentModeKHR presentMode)
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+           << "[INFO] frame pacing (" << presentModeName(presentMode) << ", " << 1000.0 / refreshPeriodMs << " Hz): "
+           << totalFrames << " presents, " << totalMissedVblanks << " missed vblanks";
+        out << ss.str() << std::endl;
+    }
+
+private:
+    void addInterval(std::chrono::high_resolution_clock::time_point now)
+    {
+        totalFrames++;
+        if (lastPresent.has_value())
+        {
+            auto interval = std::chrono::duration<double, std::milli>(now - lastPresent.value()).count();
+            intervals.Add(interval);
+
+            // an interval spanning n refresh periods skipped n - 1 vblanks
+            auto periods = static_cast<long>(std::lround(interval / refreshPeriodMs));
+            if (periods > 1)
+            {
+                missedVblanks += periods - 1;
+                totalMissedVblanks += periods - 1;
+            }
+        }
+        lastPresent = now;
+    }
+
+    struct PendingPresent
+    {
+        uint64_t presentId;
+        std::chrono::high_resolution_clock::time_point acquireStart;
+    };
+
+    double refreshPeriodMs;
+    bool usePresentWait;
+    std::deque<PendingPresent> pending;
+    std::optional<std::chrono::high_resolution_clock::time_point> lastPresent;
+    SampleStats intervals;
+    SampleStats latencies;
+    long missedVblanks;
+    uint64_t totalFrames;
+    long totalMissedVblanks;
+};
+
+/*
+    --- metrics
+*/
+// fixed size single producer single consumer queue; Push and Pop never block, Push fails when the ring is full
+template <typename T, size_t Capacity>
+class SpscRing
+{
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // producer only
+    bool Push(const T &value)
+    {
+        auto write = tail.load(std::memory_order_relaxed);
+        if (write - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        slots[write % Capacity] = value;
+        tail.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    bool Pop(T &value)
+    {
+        auto read = head.load(std::memory_order_relaxed);
+        if (read == tail.load(std::memory_order_acquire))
+            return false;
+        value = slots[read % Capacity];
+        head.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> slots;
+    alignas(64) std::atomic<size_t> head; // next slot to read, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // next slot to write, written by the producer
+};
+
+enum class MetricsEvent : uint32_t
+{
+    Frame,
+    Resize
+};
+
+// one record per presented frame or swapchain rebuild; negative times were not measured
+struct MetricsSample
+{
+    MetricsEvent event;
+    uint64_t frame;
+    double seconds; // since startup
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+    double acquireMilliseconds;
+    double presentMilliseconds;
+    uint32_t width;
+    uint32_t height;
+};
+
+const size_t kMetricsRingSize = 4096;
+const int kMetricsPollMilliseconds = 20;
+// a client that hangs up mid response must not raise SIGPIPE and kill the benchmark; without
+// MSG_NOSIGNAL (macOS) every accepted socket sets SO_NOSIGPIPE instead
+#ifdef MSG_NOSIGNAL
+const int kMetricsSendFlags = MSG_NOSIGNAL;
+#else
+const int kMetricsSendFlags = 0;
+#endif
+
+/*
+    Serves the render loop's samples over a tiny HTTP/1.0 server on 127.0.0.1:port or a unix socket path:
+    GET /metrics returns prometheus text, GET /stream keeps the connection open and sends one json object per line.
+    The render thread only pushes into a lock free ring; a separate thread drains it, aggregates and does all socket io,
+    so a slow or stalled client costs samples, never frame time. Samples that find the ring full are counted as dropped.
+*/
+class MetricsServer
+{
+public:
+    MetricsServer(const std::string &endpoint);
+    ~MetricsServer();
+    // render thread
+    void Record(const MetricsSample &sample);
+
+private:
+    void serve();
+    void drain();
+    void accept();
+    void respond(int client);
+    std::string prometheusText();
+    static std::string jsonLine(const MetricsSample &sample);
+    static bool sendAll(int socket, const std::string &data);
+
+    struct Timing
+    {
+        double sum = 0.0; // seconds
+        uint64_t count = 0;
+        double last = 0.0;
+
+        void Add(double milliseconds);
+    };
+
+    SpscRing<MetricsSample, kMetricsRingSize> ring;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> stopping;
+    std::thread thread;
+    int listener;
+    std::string unixPath; // removed again on shutdown
+
+    // drain thread only
+    std::vector<int> streams;
+    uint64_t frames;
+    uint64_t resizes;
+    Timing cpu, gpu, acquire, present;
+};
+
+void MetricsServer::Timing::Add(double milliseconds)
+{
+    if (milliseconds < 0.0)
+        return;
+    sum += milliseconds / 1000.0;
+    count++;
+    last = milliseconds / 1000.0;
+}
+
+MetricsServer::MetricsServer(const std::string &endpoint)
+{
+    dropped = 0;
+    stopping = false;
+    frames = 0;
+    resizes = 0;
+
+    bool isPort = !endpoint.empty() && std::all_of(endpoint.begin(), endpoint.end(), [](char c)
+                                                   { return c >= '0' && c <= '9'; });
+    if (isPort)
+    {
+        unsigned long port = endpoint.size() <= 5 ? std::stoul(endpoint) : 0;
+        if (port == 0 || port > 65535)
+            throw std::runtime_error("[FATAL] metrics port " + endpoint + " is not in 1-65535");
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0)
+            throw std::runtime_error("[FATAL] could not create metrics socket: " + std::string(std::strerror(errno)));
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            std::string reason = std::strerror(errno);
+            close(listener);
+            throw std::runtime_error("[FATAL] could not bind metrics port " + endpoint + ": " + reason);
+        }
+    }
+    else
+    {
+        sockaddr_un address{};
+        if (endpoint.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("[FATAL] metrics socket path '" + endpoint + "' is too long");
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+            throw std::runtime_error("[FATAL] could not create metrics socket: " + std::string(std::strerror(errno)));
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, endpoint.c_str(), sizeof(address.sun_path) - 1);
+        unlink(endpoint.c_str()); // left over from a run that did not shut down
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            std::string reason = std::strerror(errno);
+            close(listener);
+            throw std::runtime_error("[FATAL] could not bind metrics socket '" + endpoint + "': " + reason);
+        }
+        unixPath = endpoint;
+    }
+    if (listen(listener, 8) != 0)
+    {
+        // the destructor does not run for a throwing constructor, so the socket and its file go here
+        std::string reason = std::strerror(errno);
+        close(listener);
+        if (!unixPath.empty())
+            unlink(unixPath.c_str());
+        throw std::runtime_error("[FATAL] could not listen for metrics clients: " + reason);
+    }
+
+    std::cout << "[INFO] serving metrics on " << (isPort ? "http://127.0.0.1:" + endpoint : endpoint) << " (/metrics, /stream)" << std::endl;
+    thread = std::thread(&MetricsServer::serve, this);
+}
+
+MetricsServer::~MetricsServer()
+{
+    stopping = true;
+    thread.join();
+    for (auto stream : streams)
+        close(stream);
+    close(listener);
+    if (!unixPath.empty())
+        unlink(unixPath.c_str());
+}
+
+void MetricsServer::Record(const MetricsSample &sample)
+{
+    if (!ring.Push(sample))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MetricsServer::serve()
+{
+    while (!stopping)
+    {
+        pollfd pending{listener, POLLIN, 0};
+        if (poll(&pending, 1, kMetricsPollMilliseconds) > 0)
+            this->accept();
+        this->drain();
+    }
+    this->drain(); // whatever the last frames pushed
+}
+
+void MetricsServer::drain()
+{
+    MetricsSample sample;
+    std::string lines;
+    while (ring.Pop(sample))
+    {
+        if (sample.event == MetricsEvent::Resize)
+        {
+            resizes++;
+        }
+        else
+        {
+            frames++;
+            cpu.Add(sample.cpuMilliseconds);
+            gpu.Add(sample.gpuMilliseconds);
+            acquire.Add(sample.acquireMilliseconds);
+            present.Add(sample.presentMilliseconds);
+        }
+        if (!streams.empty())
+            lines += jsonLine(sample);
+    }
+    if (lines.empty())
+        return;
+
+    // drop a stream that cannot keep up rather than wait for it
+    streams.erase(std::remove_if(streams.begin(), streams.end(), [&](int stream)
+                                 {
+                                     if (sendAll(stream, lines))
+                                         return false;
+                                     close(stream);
+                                     return true; }),
+                  streams.end());
+}
+
+void MetricsServer::accept()
+{
+    int client = ::accept(listener, nullptr, nullptr);
+    if (client < 0)
+        return;
+    // the request is a single line, give the client a moment to send it
+    timeval timeout{0, 200000};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int noSigpipe = 1;
+    setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &noSigpipe, sizeof(noSigpipe));
+#endif
+    this->respond(client);
+}
+
+void MetricsServer::respond(int client)
+{
+    char request[1024];
+    auto received = recv(client, request, sizeof(request) - 1, 0);
+    std::string line = received > 0 ? std::string(request, received) : "";
+    line = line.substr(0, line.find('\r'));
+
+    if (line.rfind("GET /stream", 0) == 0)
+    {
+        if (sendAll(client, "HTTP/1.0 200 OK\r\nContent-Type: application/x-ndjson\r\nCache-Control: no-cache\r\n\r\n"))
+            streams.push_back(client);
+        else
+            close(client);
+        return;
+    }
+    if (line.rfind("GET /metrics", 0) == 0)
+    {
+        auto body = prometheusText();
+        sendAll(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+    }
+    else
+    {
+        sendAll(client, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    }
+    close(client);
+}
+
+std::string MetricsServer::prometheusText()
+{
+    std::stringstream ss;
+    ss << std::setprecision(9);
+    auto counter = [&](const char *name, const char *help, uint64_t value)
+    {
+        ss << "# HELP shaderbench_" << name << " " << help << "\n"
+           << "# TYPE shaderbench_" << name << " counter\n"
+           << "shaderbench_" << name << " " << value << "\n";
+    };
+    auto summary = [&](const char *name, const char *help, const Timing &timing)
+    {
+        ss << "# HELP shaderbench_" << name << "_seconds " << help << "\n"
+           << "# TYPE shaderbench_" << name << "_seconds summary\n"
+           << "shaderbench_" << name << "_seconds_sum " << timing.sum << "\n"
+           << "shaderbench_" << name << "_seconds_count " << timing.count << "\n"
+           << "# HELP shaderbench_" << name << "_last_seconds Latest sample of shaderbench_" << name << "_seconds.\n"
+           << "# TYPE shaderbench_" << name << "_last_seconds gauge\n"
+           << "shaderbench_" << name << "_last_seconds " << timing.last << "\n";
+    };
+    counter("frames_total", "Frames presented.", frames);
+    counter("resizes_total", "Swapchain rebuilds.", resizes);
+    counter("dropped_samples_total", "Samples lost because the metrics ring was full.", dropped.load(std::memory_order_relaxed));
+    summary("cpu_frame", "Cpu time between consecutive frame starts.", cpu);
+    summary("gpu_frame", "Gpu time of the timed draws, as read back from timestamp queries.", gpu);
+    summary("acquire_wait", "Time blocked in vkAcquireNextImageKHR.", acquire);
+    summary("present_wait", "Time blocked in vkQueuePresentKHR.", present);
+    return ss.str();
+}
+
+std::string MetricsServer::jsonLine(const MetricsSample &sample)
+{
+    auto number = [](double value)
+    {
+        if (value < 0.0)
+            return std::string("null");
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(4) << value;
+        return ss.str();
+    };
+    std::stringstream ss;
+    ss << "{\"event\":\"" << (sample.event == MetricsEvent::Resize ? "resize" : "frame") << "\""
+       << ",\"frame\":" << sample.frame
+       << ",\"time\":" << number(sample.seconds);
+    if (sample.event == MetricsEvent::Resize)
+        ss << ",\"width\":" << sample.width << ",\"height\":" << sample.height;
+    else
+        ss << ",\"cpu_ms\":" << number(sample.cpuMilliseconds)
+           << ",\"gpu_ms\":" << number(sample.gpuMilliseconds)
+           << ",\"acquire_ms\":" << number(sample.acquireMilliseconds)
+           << ",\"present_ms\":" << number(sample.presentMilliseconds);
+    ss << "}\n";
+    return ss.str();
+}
+
+bool MetricsServer::sendAll(int socket, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        auto count = send(socket, data.data() + sent, data.size() - sent, kMetricsSendFlags);
+        if (count <= 0)
+            return false;
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/*
+    --- input thread
+*/
+/*
+    GLFW only delivers events on the main thread, so with --input-thread the main thread does nothing but wait
+    for events and publish the input they produce, and the render loop runs on a thread of its own. The render
+    loop takes the newest state right before it writes the uniforms instead of polling once a frame ahead of a
+    possibly blocking acquire.
+*/
+const int kInputIdleMilliseconds = 2; // render thread nap while minimized or idle on demand
+
+// single producer single consumer latest value; neither side blocks and the consumer skips values it was too slow for
+template <typename T>
+class LatestSlot
+{
+public:
+    LatestSlot() : middle(1), back(0), front(2) {}
+
+    // producer only
+    void Publish(const T &value)
+    {
+        buffers[back] = value;
+        back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // consumer only, false if nothing was published since the last call
+    bool Take(T &value)
+    {
+        if ((middle.load(std::memory_order_relaxed) & kFresh) == 0)
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndex;
+        value = buffers[front];
+        return true;
+    }
+
+private:
+    static const uint32_t kIndex = 3;
+    static const uint32_t kFresh = 4;
+
+    std::array<T, 3> buffers;
+    std::atomic<uint32_t> middle; // the buffer passed between the two, with kFresh set when the producer left it
+    uint32_t back;                // producer's
+    uint32_t front;               // consumer's
+};
+
+// everything the render loop needs from the window, as of one point in time on the event thread
+struct InputState
+{
+    int width = 0; // framebuffer size
+    int height = 0;
+    MouseState mouse;     // clicked is unused, presses counts instead so a click between two frames is not lost
+    uint64_t presses = 0; // left button presses so far
+    uint64_t damage = 0;  // resizes, refreshes and button events so far, any of which needs a redraw
+    std::chrono::high_resolution_clock::time_point sampled;
+};
+
+/*
+    --- trace
+*/
+/*
+    A recorded run: the inputs of every frame as they went into the uniforms, and every swap chain rebuild.
+    Fields are written one at a time in host byte order after a magic and version, a frame is 66 bytes and a resize 17.
+*/
+const uint32_t kTraceMagic = 0x52544253; // "SBTR"
+const uint32_t kTraceVersion = 1;
+const uint64_t kTraceFlushFrames = 256; // frame records buffered between flushes, resizes flush at once
+
+enum class TraceEvent : uint8_t
+{
+    Frame,
+    Resize
+};
+
+struct TraceRecord
+{
+    TraceEvent event;
+    double seconds;    // since the run started
+    VkExtent2D extent; // Resize: the new swap chain extent, Frame: the resolution the inputs were sampled at
+    FrameInputs inputs; // Frame only
+};
+
+class TraceWriter
+{
+public:
+    TraceWriter(const std::string &path);
+    void Write(const TraceRecord &record);
+
+    uint64_t frames;
+
+private:
+    template <typename T>
+    void put(const T &value) { file.write(reinterpret_cast<const char *>(&value), sizeof(value)); }
+
+    std::string path;
+    std::ofstream file;
+};
+
+TraceWriter::TraceWriter(const std::string &path) : frames(0), path(path), file(path, std::ios::binary)
+{
+    if (!file)
+        throw std::runtime_error("[FATAL] could not open trace \'" + path + "\' for writing");
+    put(kTraceMagic);
+    put(kTraceVersion);
+}
+
+void TraceWriter::Write(const TraceRecord &record)
+{
+    put(record.event);
+    put(record.seconds);
+    put(record.extent.width);
+    put(record.extent.height);
+    if (record.event == TraceEvent::Frame)
+    {
+        const auto &inputs = record.inputs;
+        put(inputs.time);
+        put(inputs.timeDelta);
+        put(inputs.frameRate);
+        put(inputs.frame);
+        put(inputs.mouse.position.x);
+        put(inputs.mouse.position.y);
+        put(inputs.mouse.click.x);
+        put(inputs.mouse.click.y);
+        put(static_cast<uint8_t>((inputs.mouse.down ? 1 : 0) | (inputs.mouse.clicked ? 2 : 0)));
+        put(inputs.date);
+        frames++;
+    }
+    // flushed now and then rather than per frame, a crash loses at most the last few frames; closing flushes the rest
+    if (record.event == TraceEvent::Resize || frames % kTraceFlushFrames == 0)
+        file.flush();
+    if (!file)
+        throw std::runtime_error("[FATAL] could not write trace \'" + path + "\'");
+}
+
+// reads one record ahead, so the render loop can see a resize coming before it starts the frame
+class TraceReader
+{
+public:
+    TraceReader(const std::string &path);
+    const TraceRecord *Peek() { return pending ? &next : nullptr; }
+    void Pop() { pending = read(next); }
+
+private:
+    template <typename T>
+    bool get(T &value) { return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(value))); }
+    bool read(TraceRecord &record);
+
+    std::ifstream file;
+    TraceRecord next;
+    bool pending;
+};
+
+TraceReader::TraceReader(const std::string &path) : file(path, std::ios::binary)
+{
+    if (!file)
+        throw std::runtime_error("[FATAL] could not open trace \'" + path + "\'");
+    uint32_t magic = 0, version = 0;
+    if (!get(magic) || magic != kTraceMagic)
+        throw std::runtime_error("[FATAL] \'" + path + "\' is not a shaderbench trace");
+    if (!get(version) || version != kTraceVersion)
+        throw std::runtime_error("[FATAL] trace \'" + path + "\' has version " + std::to_string(version) + ", expected " + std::to_string(kTraceVersion));
+    pending = read(next);
+}
+
+// false at the end of the trace; a record cut short, as by a crash while recording, ends it too
+bool TraceReader::read(TraceRecord &record)
+{
+    record = TraceRecord{};
+    if (!get(record.event) || !get(record.seconds) || !get(record.extent.width) || !get(record.extent.height))
+        return false;
+    if (record.event == TraceEvent::Resize)
+        return true;
+    if (record.event != TraceEvent::Frame)
+        throw std::runtime_error("[FATAL] unknown trace event " + std::to_string(static_cast<int>(record.event)));
+
+    auto &inputs = record.inputs;
+    uint8_t flags = 0;
+    bool complete = get(inputs.time) && get(inputs.timeDelta) && get(inputs.frameRate) && get(inputs.frame) &&
+                    get(inputs.mouse.position.x) && get(inputs.mouse.position.y) &&
+                    get(inputs.mouse.click.x) && get(inputs.mouse.click.y) && get(flags) && get(inputs.date);
+    inputs.resolution = glm::vec3(record.extent.width, record.extent.height, 1.0);
+    inputs.mouse.down = (flags & 1) != 0;
+    inputs.mouse.clicked = (flags & 2) != 0;
+    return complete;
+}
+
+/*
+    --- tiled rendering
+*/
+/*
+    Splits each frame into scissored tiles, one per submit, sized so a submit stays under a gpu time budget.
+    Tiles are laid out in rows from the top left; the cost per pixel measured on the last tile sets the size of
+    the next. The first tile is small, since until it is measured nothing bounds how long an unknown shader runs.
+    The rest of a row is cut again at the latest size, so a row begun in a cheap region is split into shorter
+    rows once the shader gets expensive and no tile grows past the size the budget allows.
+*/
+const uint32_t kMinTileSide = 8;
+const uint32_t kFirstTileSide = 64;
+const VkFormat kTileTargetFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+class TileScheduler
+{
+public:
+    TileScheduler(VkExtent2D extent, double budgetMilliseconds);
+    bool AtFrameStart() const { return pending.empty(); }
+    VkRect2D Next();
+    void Measured(VkRect2D tile, double milliseconds);
+    std::string Summary() const;
+
+    SampleStats frameMilliseconds; // gpu time of every completed frame, summed over its tiles
+    SampleStats frameTiles;
+    uint64_t overBudgetTiles;
+
+private:
+    VkExtent2D extent;
+    double budgetMilliseconds;
+    double millisecondsPerPixel; // negative until the first tile is measured
+    uint32_t side;
+    std::vector<VkRect2D> pending; // the rest of the frame, the next tile is cut from the back
+    double currentMilliseconds; // the frame in progress
+    uint32_t currentTiles;
+    VkRect2D lastTile;
+    double lastMilliseconds;
+};
+
+TileScheduler::TileScheduler(VkExtent2D extent, double budgetMilliseconds)
+{
+    this->extent = extent;
+    this->budgetMilliseconds = budgetMilliseconds;
+    millisecondsPerPixel = -1.0;
+    side = kFirstTileSide;
+    overBudgetTiles = 0;
+    currentMilliseconds = 0.0;
+    currentTiles = 0;
+    lastTile = {{0, 0}, {0, 0}};
+    lastMilliseconds = 0.0;
+}
+
+VkRect2D TileScheduler::Next()
+{
+    if (pending.empty())
+        pending.push_back({{0, 0}, extent});
+    VkRect2D tile = pending.back();
+    pending.pop_back();
+
+    // a row of at most side pixels off the top, then at most side pixels off its left; the rest of the row
+    // is taken next and the rows below after it, each cut at whatever size is current by then
+    if (tile.extent.height > side)
+    {
+        pending.push_back({{tile.offset.x, tile.offset.y + static_cast<int32_t>(side)}, {tile.extent.width, tile.extent.height - side}});
+        tile.extent.height = side;
+    }
+    if (tile.extent.width > side)
+    {
+        pending.push_back({{tile.offset.x + static_cast<int32_t>(side), tile.offset.y}, {tile.extent.width - side, tile.extent.height}});
+        tile.extent.width = side;
+    }
+    return tile;
+}
+
+void TileScheduler::Measured(VkRect2D tile, double milliseconds)
+{
+    double pixels = static_cast<double>(tile.extent.width) * tile.extent.height;
+    double cost = milliseconds / pixels;
+    // react to a more expensive region at once, relax slowly so one cheap tile does not overshoot the next
+    millisecondsPerPixel = (millisecondsPerPixel < 0.0 || cost > millisecondsPerPixel) ? cost : 0.5 * millisecondsPerPixel + 0.5 * cost;
+
+    // aim below the budget, the cost varies across the frame
+    double targetPixels = 0.75 * budgetMilliseconds / std::max(millisecondsPerPixel, 1e-9);
+    uint32_t maxSide = std::max(extent.width, extent.height);
+    double root = std::sqrt(targetPixels);
+    side = root >= maxSide ? maxSide : std::max(kMinTileSide, static_cast<uint32_t>(root) / kMinTileSide * kMinTileSide);
+
+    if (milliseconds > budgetMilliseconds)
+        overBudgetTiles++;
+
+    lastTile = tile;
+    lastMilliseconds = milliseconds;
+    currentMilliseconds += milliseconds;
+    currentTiles++;
+    bool lastOfFrame = tile.offset.x + tile.extent.width >= extent.width && tile.offset.y + tile.extent.height >= extent.height;
+    if (lastOfFrame)
+    {
+        frameMilliseconds.Add(currentMilliseconds);
+        frameTiles.Add(currentTiles);
+        currentMilliseconds = 0.0;
+        currentTiles = 0;
+    }
+}
+
+std::string TileScheduler::Summary() const
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3)
+       << "tile " << lastTile.extent.width << "x" << lastTile.extent.height << " " << lastMilliseconds << " ms";
+    if (frameTiles.Count() > 0)
+        ss << ", " << std::setprecision(0) << frameTiles.values.back() << " tiles "
+           << std::setprecision(3) << frameMilliseconds.values.back() << " ms/frame";
+    if (overBudgetTiles > 0)
+        ss << ", " << overBudgetTiles << " tiles over budget";
+    return ss.str();
+}
+
+/*
+    --- multiple windows
+*/
+const int kWindowCascade = 40; // screen pixels between windows that share a monitor
+
+/*
+    One window of --windows, drawing one program. Every view renders through the application's device, pipeline
+    cache and frame timeline; each frame is one submit for all of them and one present of all their swap chains.
+*/
+struct WindowView
+{
+    Window *window; // the first view's is the application's own window
+    SwapChain *swapChain; // nullptr while the window is minimized
+    RenderPass *renderPass;
+    Framebuffer *framebuffer;
+    CommandRecorder *recorder;
+    std::vector<uint64_t> imageFrames; // per swapchain image, the last frame that rendered into it
+    bool stale;                        // out of date or suboptimal, rebuilt before the next frame
+    MouseState mouse;                  // in this window's framebuffer pixels
+};
+
+// one window per monitor while there are monitors left, the rest cascade over the first
+void placeWindow(GLFWwindow *window, size_t idx)
+{
+    int count = 0;
+    GLFWmonitor **monitors = glfwGetMonitors(&count);
+    if (monitors == nullptr || count == 0)
+        return;
+    size_t monitorCount = static_cast<size_t>(count);
+    size_t monitorIdx = idx < monitorCount ? idx : 0;
+    int step = idx < monitorCount ? 1 : static_cast<int>(idx - monitorCount) + 2;
+    int x, y;
+    glfwGetMonitorPos(monitors[monitorIdx], &x, &y);
+    glfwSetWindowPos(window, x + step * kWindowCascade, y + step * kWindowCascade);
+}
+
+/*
+    --- comparison
+*/
+const uint32_t kCompareWarmupPairs = 2; // untimed block pairs while clocks settle
+const uint32_t kCompareBootstrapResamples = 10000;
+const uint32_t kCompareBootstrapSeed = 1;
+
+/*
+    --- options
+*/
+struct Options
+{
+    std::vector<std::string> shaderPaths; // more than one only in gallery mode
+    bool gallery = false;      // tile every shader into one window, timing each cell
+    bool stats = false;        // print frame rate and memory budget once per second
+    bool memoryReport = false; // dump every live allocation by owner at exit
+    uint32_t recordThreads = 1; // command buffer recording threads, more than one records secondaries in parallel
+    uint32_t recordBench = 0;   // draws per recording for the thread count benchmark, 0 to render normally
+    std::optional<VkPresentModeKHR> presentMode;
+    uint32_t framesInFlight = 2; // frames the cpu may run ahead of the gpu
+    bool accumulate = false;                   // average every frame into a float target until the view changes
+    uint32_t samplesPerPixel = 0;              // stop after this many accumulated frames and write the result, 0 to run on
+    std::string outputPath = "accumulation.ppm";
+    bool checkerboard = false;     // shade half the pixels per frame and reconstruct the rest from the previous frame
+    uint32_t checkerboardEval = 0; // golden frames to compare against full rate rendering, 0 to render normally
+    double tileBudget = 0.0;       // gpu milliseconds per submit when rendering in tiles, 0 to draw whole frames
+    bool analyze = false;          // print the static cost of every shader and exit without a window
+    std::string metricsEndpoint;   // port on 127.0.0.1 or unix socket path serving live metrics, empty for none
+    std::optional<VkExtent2D> headless; // present to a VK_EXT_headless_surface of this size instead of a window
+    uint32_t frameLimit = 0;            // exit after this many presents, 0 to run until the window closes
+    uint32_t resizeEvery = 0;           // headless only, halve or restore the extent every this many presents
+    bool continuous = false;            // render every frame even if the shader's output cannot change
+    bool onDemand = false;              // render only on resize, input or damage even if the shader reads the clock
+    bool compare = false;               // time two shaders against each other instead of rendering
+    uint32_t compareBlocks = 30;        // measured block pairs
+    uint32_t compareBlockFrames = 10;   // frames per block, the first of which is not timed
+    bool compareOffscreen = false;      // render the comparison into an offscreen target instead of presenting it
+    std::optional<TargetFormat> targetFormat; // render into an offscreen target of this format and resolve it to the swapchain
+    uint32_t formatBench = 0;                 // frames to time per target format, 0 to render normally
+    uint32_t msaaSamples = 1;                 // samples per pixel of the swapchain pass, resolved at its end
+    bool sampleShading = false;               // run the shader once per sample instead of once per pixel
+    uint32_t supersample = 1;                 // per axis factor of the supersampled target, 1 to shade once per pixel
+    uint32_t aaBench = 0;                     // frames to time per anti-aliasing mode, 0 to render normally
+    bool heatmap = false;                     // show per pixel (shader clock) or per tile (timestamps) cost over the frame
+    uint32_t ablate = 0;                      // frames to time per stubbed out function or loop, 0 to render normally
+    bool inputThread = false;                 // render on a thread of its own while the main thread handles window events
+    bool windows = false;                     // every shader in a window of its own, all on one device
+    std::string recordPath;                   // write every frame's inputs and every resize to this trace
+    std::string replayPath;                   // take every frame's inputs and every resize from this trace instead
+    bool realtime = false;                    // replay at the recorded pace rather than as fast as possible
+};
+
+void printUsage()
+{
+    std::cerr << "usage: main [options] [path/filename]" << std::endl
+              << "       main --gallery [options] path/filename..." << std::endl
+              << "       main --windows [options] path/filename..." << std::endl
+              << "       main --analyze path/filename..." << std::endl
+              << "       main compare [options] a.frag b.frag" << std::endl
+              << "  path/filename        fragment shader glsl source, defaults to shader.frag" << std::endl
+              << "  --gallery            draw up to " << kMaxGalleryCells << " shaders in a grid with their gpu time overlaid" << std::endl
+              << "  --windows            draw each shader in a window of its own, one per monitor, sharing one device, submit and present" << std::endl
+              << "  --record PATH        write the time, mouse, resolution and date of every frame and every resize to a binary trace" << std::endl
+              << "  --replay PATH        render the frames of a trace with its inputs and resizes as fast as possible, then exit" << std::endl
+              << "  --realtime           with --replay, keep to the recorded pace" << std::endl
+              << "  --stats              print frame rate and per-heap memory usage/budget every second" << std::endl
+              << "  --memory-report      list every device memory allocation by owner at exit" << std::endl
+              << "  --present-mode MODE  fifo, mailbox, immediate or fifo-relaxed; defaults to mailbox if available, otherwise fifo" << std::endl
+              << "  --frames-in-flight N let the cpu run up to N frames ahead of the gpu, defaults to 2" << std::endl
+              << "  --threads N          record each frame's draws on N threads into secondary command buffers" << std::endl
+              << "  --record-bench N     time recording N draws for 1 up to all hardware threads, then exit" << std::endl
+              << "  --accumulate         average successive frames, restarting on resize or mouse input" << std::endl
+              << "  --spp N              accumulate N frames, write the average to the output image and exit" << std::endl
+              << "  --output PATH        image written by --spp, .pfm for linear floats, otherwise .ppm; defaults to accumulation.ppm" << std::endl
+              << "  --checkerboard       shade a checkerboard half of the pixels each frame, fill the rest from the previous frame" << std::endl
+              << "  --checkerboard-eval N  render N frames at full rate and checkerboarded, report speedup and error, then exit" << std::endl
+              << "  --tile-budget MS     draw each frame in tiles, one per submit, sized to stay under MS gpu milliseconds" << std::endl
+              << "  --metrics ENDPOINT   serve prometheus text at /metrics and json lines at /stream on a localhost port or unix socket path" << std::endl
+              << "  --headless WxH       present to a VK_EXT_headless_surface of WxH pixels, no window or display needed" << std::endl
+              << "  --frames N           exit after N presents" << std::endl
+              << "  --resize-every N     with --headless, alternate between WxH and half of it every N presents" << std::endl
+              << "  --continuous         render every frame; by default a shader that reads no clock, frame or mouse input is redrawn only on resize, input or damage" << std::endl
+              << "  --on-demand          redraw only on resize, input or damage whatever the shader reads" << std::endl
+              << "  --blocks N           compare: measured ABBA block pairs, defaults to 30" << std::endl
+              << "  --block-frames N     compare: frames per block, defaults to 10" << std::endl
+              << "  --offscreen          compare: render into an offscreen image instead of presenting" << std::endl
+              << "  --target-format FMT  render into an offscreen rgba8, rgb10a2, b10g11r11, rgba16f or rgba32f target, then resolve to the swapchain" << std::endl
+              << "  --format-bench N     time N frames through every supported target format, report gpu time and bytes per frame, then exit" << std::endl
+              << "  --msaa N             render with 2, 4 or 8 samples per pixel and resolve them at the end of the pass" << std::endl
+              << "  --sample-shading     with --msaa, run the shader for every sample rather than once per pixel" << std::endl
+              << "  --ssaa N             shade N x N samples per pixel on an ordered grid into an oversized target, N from 2 to " << kMaxSupersampleFactor << std::endl
+              << "  --aa-bench N         time N frames with no anti-aliasing, every supported msaa mode and supersampling, then exit" << std::endl
+              << "  --ablate N           time N frames with each function and outermost loop stubbed out in turn, rank what each costs, then exit" << std::endl
+              << "  --input-thread       render on a separate thread so window events and the cursor are handled while a frame blocks" << std::endl
+              << "  --heatmap            tint the frame by the cycles each pixel took, or the incremental gpu time of each " << kHeatmapTileSide << " pixel tile without VK_KHR_shader_clock, and print percentiles every second" << std::endl
+              << "  --analyze            print each shader's instruction mix, loop and call depth and estimated ops per pixel, then exit" << std::endl;
+}
+
+// strictly positive integer argument
+bool parseCount(const char *arg, uint32_t &count)
+{
+    char *end = nullptr;
+    auto value = std::strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0' || value == 0 || value > UINT32_MAX)
+        return false;
+    count = static_cast<uint32_t>(value);
+    return true;
+}
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    bool havePath = false;
+    for (int idx = 1; idx < argc; idx++)
+    {
+        std::string arg = argv[idx];
+        if (arg == "compare" && idx == 1)
+        {
+            options.compare = true;
+        }
+        else if (arg == "--stats")
+        {
+            options.stats = true;
+        }
+        else if (arg == "--memory-report")
+        {
+            options.memoryReport = true;
+        }
+        else if (arg == "--present-mode" && idx + 1 < argc)
+        {
+            options.presentMode = parsePresentMode(argv[++idx]);
+            if (!options.presentMode.has_value())
+            {
+                std::cerr << "[ERROR] unknown present mode \'" << argv[idx] << "\'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--frames-in-flight" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.framesInFlight))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--threads" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.recordThreads))
+            {
+                std::cerr << "[ERROR] invalid thread count \'" << argv[idx] << "\'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--record-bench" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.recordBench))
+            {
+                std::cerr << "[ERROR] invalid draw count \'" << argv[idx] << "\'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--gallery")
+        {
+            options.gallery = true;
+        }
+        else if (arg == "--analyze")
+        {
+            options.analyze = true;
+        }
+        else if (arg == "--metrics" && idx + 1 < argc)
+        {
+            options.metricsEndpoint = argv[++idx];
+        }
+        else if (arg == "--headless" && idx + 1 < argc)
+        {
+            unsigned width = 0, height = 0;
+            char trailing = 0;
+            if (std::sscanf(argv[++idx], "%ux%u%c", &width, &height, &trailing) != 2 || width == 0 || height == 0)
+            {
+                std::cerr << "[ERROR] invalid extent '" << argv[idx] << "', expected WxH" << std::endl;
+                return false;
+            }
+            options.headless = VkExtent2D{width, height};
+        }
+        else if (arg == "--blocks" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.compareBlocks))
+            {
+                std::cerr << "[ERROR] invalid block count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--block-frames" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.compareBlockFrames) || options.compareBlockFrames < 2)
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "', a block needs at least 2 frames" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--offscreen")
+        {
+            options.compareOffscreen = true;
+        }
+        else if (arg == "--target-format" && idx + 1 < argc)
+        {
+            options.targetFormat = parseTargetFormat(argv[++idx]);
+            if (!options.targetFormat.has_value())
+            {
+                std::cerr << "[ERROR] unknown target format '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--format-bench" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.formatBench))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--msaa" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.msaaSamples) || (options.msaaSamples != 2 && options.msaaSamples != 4 && options.msaaSamples != 8))
+            {
+                std::cerr << "[ERROR] invalid sample count '" << argv[idx] << "', use 2, 4 or 8" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--sample-shading")
+        {
+            options.sampleShading = true;
+        }
+        else if (arg == "--ssaa" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.supersample) || options.supersample < 2 || options.supersample > kMaxSupersampleFactor)
+            {
+                std::cerr << "[ERROR] invalid supersampling factor '" << argv[idx] << "', use 2 to " << kMaxSupersampleFactor << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--aa-bench" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.aaBench))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--ablate" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.ablate))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--input-thread")
+        {
+            options.inputThread = true;
+        }
+        else if (arg == "--windows")
+        {
+            options.windows = true;
+        }
+        else if (arg == "--record" && idx + 1 < argc)
+        {
+            options.recordPath = argv[++idx];
+        }
+        else if (arg == "--replay" && idx + 1 < argc)
+        {
+            options.replayPath = argv[++idx];
+        }
+        else if (arg == "--realtime")
+        {
+            options.realtime = true;
+        }
+        else if (arg == "--heatmap")
+        {
+            options.heatmap = true;
+        }
+        else if (arg == "--continuous")
+        {
+            options.continuous = true;
+        }
+        else if (arg == "--on-demand")
+        {
+            options.onDemand = true;
+        }
+        else if (arg == "--frames" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.frameLimit))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--resize-every" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.resizeEvery))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--accumulate")
+        {
+            options.accumulate = true;
+        }
+        else if (arg == "--spp" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.samplesPerPixel))
+            {
+                std::cerr << "[ERROR] invalid sample count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+            options.accumulate = true;
+        }
+        else if (arg == "--output" && idx + 1 < argc)
+        {
+            options.outputPath = argv[++idx];
+        }
+        else if (arg == "--checkerboard")
+        {
+            options.checkerboard = true;
+        }
+        else if (arg == "--checkerboard-eval" && idx + 1 < argc)
+        {
+            if (!parseCount(argv[++idx], options.checkerboardEval))
+            {
+                std::cerr << "[ERROR] invalid frame count '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+            options.checkerboard = true;
+        }
+        else if (arg == "--tile-budget" && idx + 1 < argc)
+        {
+            char *end = nullptr;
+            options.tileBudget = std::strtod(argv[++idx], &end);
+            if (end == argv[idx] || *end != '\0' || !(options.tileBudget > 0.0))
+            {
+                std::cerr << "[ERROR] invalid time budget '" << argv[idx] << "'" << std::endl;
+                return false;
+            }
+        }
+        else if (arg.rfind("--", 0) == 0)
+        {
+            std::cerr << "[ERROR] unexpected argument \'" << arg << "\'" << std::endl;
+            return false;
+        }
+        else
+        {
+            options.shaderPaths.push_back(arg);
+            havePath = true;
+        }
+    }
+    if (options.compare && (options.shaderPaths.size() != 2 || options.gallery || options.accumulate || options.checkerboard || options.tileBudget > 0.0 ||
+                            options.targetFormat.has_value() || options.msaaSamples > 1 || options.supersample > 1 || options.heatmap))
+    {
+        std::cerr << "[ERROR] compare takes exactly two shaders and no --gallery, --accumulate, --checkerboard, --tile-budget, --target-format, --msaa, --ssaa or --heatmap" << std::endl;
+        return false;
+    }
+    if (options.shaderPaths.size() > 1 && !options.gallery && !options.analyze && !options.compare && !options.windows)
+    {
+        std::cerr << "[ERROR] unexpected argument \'" << options.shaderPaths[1] << "\', use --gallery, --windows or --analyze for more than one shader" << std::endl;
+        return false;
+    }
+    if (options.windows && (options.gallery || options.compare || options.analyze || options.headless.has_value() || options.inputThread ||
+                            options.stats || options.onDemand || options.accumulate || options.checkerboard || options.tileBudget > 0.0 || options.targetFormat.has_value() ||
+                            options.msaaSamples > 1 || options.supersample > 1 || options.heatmap || options.recordBench > 0 ||
+                            options.checkerboardEval > 0 || options.formatBench > 0 || options.aaBench > 0 || options.ablate > 0))
+    {
+        std::cerr << "[ERROR] --windows draws each shader straight into a window of its own, it cannot be combined with other render modes, benchmarks, --stats, --on-demand or --headless" << std::endl;
+        return false;
+    }
+    if (options.accumulate && options.gallery)
+    {
+        std::cerr << "[ERROR] --accumulate and --spp render a single shader, they cannot be combined with --gallery" << std::endl;
+        return false;
+    }
+    if (options.checkerboard && (options.gallery || options.accumulate))
+    {
+        std::cerr << "[ERROR] --checkerboard cannot be combined with --gallery or --accumulate" << std::endl;
+        return false;
+    }
+    if (options.tileBudget > 0.0 && (options.gallery || options.accumulate || options.checkerboard))
+    {
+        std::cerr << "[ERROR] --tile-budget cannot be combined with --gallery, --accumulate or --checkerboard" << std::endl;
+        return false;
+    }
+    if (options.targetFormat.has_value() && (options.gallery || options.accumulate || options.checkerboard || options.tileBudget > 0.0))
+    {
+        std::cerr << "[ERROR] --target-format draws a single shader into a target of its own, it cannot be combined with --gallery, --accumulate, --checkerboard or --tile-budget" << std::endl;
+        return false;
+    }
+    if ((options.msaaSamples > 1 || options.supersample > 1) &&
+        (options.accumulate || options.checkerboard || options.tileBudget > 0.0 || options.targetFormat.has_value()))
+    {
+        std::cerr << "[ERROR] --msaa and --ssaa cannot be combined with --accumulate, --checkerboard, --tile-budget or --target-format" << std::endl;
+        return false;
+    }
+    if (options.msaaSamples > 1 && options.supersample > 1)
+    {
+        std::cerr << "[ERROR] --msaa and --ssaa are exclusive" << std::endl;
+        return false;
+    }
+    if (options.supersample > 1 && options.gallery)
+    {
+        std::cerr << "[ERROR] --ssaa renders a single shader, it cannot be combined with --gallery" << std::endl;
+        return false;
+    }
+    if (options.heatmap && (options.gallery || options.accumulate || options.checkerboard || options.tileBudget > 0.0 ||
+                            options.targetFormat.has_value() || options.msaaSamples > 1 || options.supersample > 1))
+    {
+        std::cerr << "[ERROR] --heatmap draws a single shader into a target of its own, it cannot be combined with other render modes" << std::endl;
+        return false;
+    }
+    if (options.ablate > 0 && (options.gallery || options.heatmap))
+    {
+        std::cerr << "[ERROR] --ablate times variants of a single shader, it cannot be combined with --gallery or --heatmap" << std::endl;
+        return false;
+    }
+    if (options.inputThread && options.headless.has_value())
+    {
+        std::cerr << "[ERROR] --input-thread needs a window, a headless surface has no input" << std::endl;
+        return false;
+    }
+    if ((!options.recordPath.empty() || !options.replayPath.empty()) &&
+        (options.windows || options.compare || options.recordBench > 0 || options.checkerboardEval > 0 || options.formatBench > 0 || options.aaBench > 0 || options.ablate > 0))
+    {
+        std::cerr << "[ERROR] --record and --replay trace the render loop, they cannot be combined with --windows, compare or the benchmarks" << std::endl;
+        return false;
+    }
+    if (!options.recordPath.empty() && !options.replayPath.empty())
+    {
+        std::cerr << "[ERROR] --record and --replay are exclusive" << std::endl;
+        return false;
+    }
+    if (!options.replayPath.empty() && (options.inputThread || options.onDemand || options.resizeEvery > 0))
+    {
+        std::cerr << "[ERROR] a replay takes its input and resizes from the trace and draws every frame in it, --input-thread, --on-demand and --resize-every do not apply" << std::endl;
+        return false;
+    }
+    if (options.realtime && options.replayPath.empty())
+    {
+        std::cerr << "[ERROR] --realtime needs --replay" << std::endl;
+        return false;
+    }
+    if (options.sampleShading && options.msaaSamples == 1)
+    {
+        std::cerr << "[ERROR] --sample-shading needs --msaa" << std::endl;
+        return false;
+    }
+    if (options.compareOffscreen && !options.compare)
+    {
+        std::cerr << "[ERROR] --offscreen only applies to compare" << std::endl;
+        return false;
+    }
+    if (options.continuous && options.onDemand)
+    {
+        std::cerr << "[ERROR] --continuous and --on-demand are exclusive" << std::endl;
+        return false;
+    }
+    if (options.resizeEvery > 0 && !options.headless.has_value())
+    {
+        std::cerr << "[ERROR] --resize-every needs --headless, resize the window instead" << std::endl;
+        return false;
+    }
+    if (options.gallery && options.shaderPaths.size() > kMaxGalleryCells)
+    {
+        std::cerr << "[ERROR] gallery holds at most " << kMaxGalleryCells << " shaders" << std::endl;
+        return false;
+    }
+    if (!havePath)
+    {
+        std::cout << "[INFO] selecting default shader file \'shader.frag\'" << std::endl;
+        options.shaderPaths.push_back("shader.frag");
+    }
+    bool precompiled = std::any_of(options.shaderPaths.begin(), options.shaderPaths.end(), isPrecompiled);
+    if (precompiled && (options.gallery || options.checkerboard || options.heatmap || options.ablate > 0))
+    {
+        std::cerr << "[ERROR] --gallery, --checkerboard, --heatmap and --ablate rewrite the glsl source, a precompiled .spv shader has none" << std::endl;
+        return false;
+    }
+#ifdef DISABLE_SHADERC
+    for (const auto &path : options.shaderPaths)
+    {
+        if (!isPrecompiled(path))
+        {
+            std::cerr << "[ERROR] built without shaderc, \'" << path << "\' must be a precompiled .spv fragment shader" << std::endl;
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+// a fragment shader as read from disk
+struct ShaderSource
+{
+    std::string path;
+    std::string source;
+    std::vector<uint32_t> spirv; // read from a .spv file instead, source is then empty
+};
+
+class Application
+{
+public:
+    Application(std::vector<ShaderSource> shaderSources, Options options) : options(options), shaderSources(shaderSources) {}
+    void Init()
+    {
+        statsFrames = 0;
+        statsStart = std::chrono::high_resolution_clock::now();
+        window = new Window(options.headless);
+
+#ifdef ENABLE_VALIDATION_LAYERS
+        // enable custom debug messenger
+        std::cout << "[DEBUG] validation layers enabled" << std::endl;
+        if (auto err = createDebugMessenger(&window->instance, &debugMessenger); err != VK_SUCCESS)
+        {
+            throw std::runtime_error("[FATAL] could not create debug messenger with error \'" + std::to_string(err) + "\'");
+        }
+#endif
+
+        device = new Device(window->instance, window->surface);
+        swapChain = nullptr;
+        renderPass = nullptr;
+        framebuffer = nullptr;
+        commandRecorder = nullptr;
+        gpuTimer = nullptr;
+        timeline = nullptr;
+        workers = new WorkerPool(options.recordThreads);
+        recordMicroseconds = 0.0;
+
+        descriptorCache = new DescriptorCache(device->handle);
+        placeholders = new PlaceholderResources(device);
+
+        // the builtin vertex shader declares no resources, the fragment shader alone defines the interface
+        vertexShader = builtinSpirv(builtin_fullscreen_vert);
+        pipelineLibraries = nullptr;
+        if (device->graphicsPipelineLibrarySupported)
+        {
+            // the timing modes measure optimized pipelines, interactive ones trade that for quick edits
+            bool optimize = options.compare || options.recordBench > 0 || options.checkerboardEval > 0 ||
+                            options.formatBench > 0 || options.aaBench > 0 || options.ablate > 0;
+            pipelineLibraries = new PipelineLibraries(device->handle, device->pipelineCache, vertexShader, optimize);
+            std::cout << "[INFO] shader pipelines linked from pipeline libraries (" << (optimize ? "link time optimized" : "fast link") << ")" << std::endl;
+        }
+        for (const auto &shaderSource : shaderSources)
+        {
+            ShaderProgram program{};
+            program.path = shaderSource.path;
+            // the same file in several cells or windows is compiled once
+            auto compiled = std::find_if(programs.begin(), programs.end(), [&](const ShaderProgram &other)
+                                         { return other.path == shaderSource.path; });
+            if (compiled != programs.end())
+            {
+                program.spirv = compiled->spirv;
+                program.reflection = compiled->reflection;
+                program.cost = compiled->cost;
+                program.costSet = compiled->costSet;
+            }
+            else if (!shaderSource.spirv.empty())
+            {
+                std::cout << "[INFO] load precompiled fragment shader \'" << shaderSource.path << "\'" << std::endl;
+                program.spirv = shaderSource.spirv;
+                program.reflection = reflectSpirv(program.spirv);
+                program.cost = analyzeSpirvCost(program.spirv);
+                std::cout << "[INFO] estimated cost " << costSummary(program.cost) << std::endl;
+            }
+            else
+            {
+                std::cout << "[INFO] compile fragment shader \'" << shaderSource.path << "\'" << std::endl;
+                bool rewrite = options.gallery || options.checkerboard;
+                program.spirv = compileSpriv(rewrite ? rewriteFragCoord(shaderSource.source) : shaderSource.source);
+                program.reflection = reflectSpirv(program.spirv);
+                program.cost = analyzeSpirvCost(program.spirv);
+                std::cout << "[INFO] estimated cost " << costSummary(program.cost) << std::endl;
+                if (options.heatmap && device->shaderClockSupported)
+                {
+                    // the cost image takes the set after the last one the shader declares
+                    program.costSet = 0;
+                    for (const auto &binding : program.reflection.bindings)
+                        program.costSet = std::max(program.costSet, binding.set + 1);
+                    program.spirv = compileSpriv(instrumentClock(shaderSource.source, program.costSet));
+                    program.reflection = reflectSpirv(program.spirv);
+                }
+            }
+            program.uniformLayout = new UniformLayout(program.reflection);
+
+            ShaderInterface shaderInterface;
+            shaderInterface.Add(program.reflection, VK_SHADER_STAGE_FRAGMENT_BIT);
+            program.interfaceLayout = descriptorCache->Get(shaderInterface);
+            programs.push_back(program);
+        }
+        cellMilliseconds.assign(programs.size(), -1.0);
+        cellTotalMilliseconds.assign(programs.size(), 0.0);
+        cellSamples.assign(programs.size(), 0);
+
+        // gpu cost overlay, only in gallery mode and only if the queue can time anything
+        overlay = ShaderProgram{};
+        if (options.gallery && device->timestampsSupported)
+        {
+            overlayVertexShader = builtinSpirv(builtin_overlay_vert);
+            overlay.path = "overlay";
+            overlay.spirv = builtinSpirv(builtin_overlay_frag);
+            overlay.reflection = reflectSpirv(overlay.spirv);
+
+            ShaderInterface shaderInterface;
+            shaderInterface.Add(reflectSpirv(overlayVertexShader), VK_SHADER_STAGE_VERTEX_BIT);
+            shaderInterface.Add(overlay.reflection, VK_SHADER_STAGE_FRAGMENT_BIT);
+            overlay.interfaceLayout = descriptorCache->Get(shaderInterface);
+        }
+        else if (options.gallery)
+        {
+            std::cout << "[WARN] queue family cannot write timestamps, gallery cells are not timed" << std::endl;
+        }
+
+        // progressive accumulation: the shader adds each frame into a float target, a resolve pass divides by the count
+        resolve = ShaderProgram{};
+        accumulation = nullptr;
+        accumulateClearPass = nullptr;
+        accumulateLoadPass = nullptr;
+        sampleCount = 0;
+        accumulatedMouse = MouseState{};
+        if (options.accumulate)
+        {
+            accumulationFormat = chooseAccumulationFormat(device->physicalDevice);
+            // compatible passes, so pipelines built against one run in both
+            accumulateClearPass = new RenderPass(device->handle,
+                                                 accumulationFormat,
+                                                 VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                                 VK_IMAGE_LAYOUT_UNDEFINED,
+                                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            accumulateLoadPass = new RenderPass(device->handle,
+                                                accumulationFormat,
+                                                VK_ATTACHMENT_LOAD_OP_LOAD,
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            if (AnyProgramUses(ShaderInput::Time) || AnyProgramUses(ShaderInput::TimeDelta) || AnyProgramUses(ShaderInput::Date))
+                std::cout << "[WARN] shader reads the clock, accumulated frames will blend over time; vary samples with iFrame instead" << std::endl;
+        }
+
+        // tiled: scissored tiles load and store one float target, assembled over several submits and resolved to the swapchain
+        tilePass = nullptr;
+        tileTarget = nullptr;
+        tiler = nullptr;
+        if (options.tileBudget > 0.0)
+        {
+            if (!device->timestampsSupported)
+                throw std::runtime_error("[FATAL] queue family cannot write timestamps, tiles cannot be sized to a time budget!");
+            tilePass = new RenderPass(device->handle,
+                                      kTileTargetFormat,
+                                      VK_ATTACHMENT_LOAD_OP_LOAD,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+
+        // format experiments: the shader renders into an intermediate of the chosen format, resolved to the swapchain
+        intermediatePass = nullptr;
+        intermediate = nullptr;
+        intermediateFormat = VK_FORMAT_UNDEFINED;
+        if (options.targetFormat.has_value())
+        {
+            if (!targetFormatSupported(device->physicalDevice, options.targetFormat->format))
+                throw std::runtime_error("[FATAL] target format " + std::string(options.targetFormat->name) + " cannot be rendered into and sampled on this device");
+            intermediateFormat = options.targetFormat->format;
+        }
+
+        // heatmap: the shader renders into an intermediate, the swapchain pass draws it under its cost
+        heatmap = ShaderProgram{};
+        costImage = nullptr;
+        heatmapTiles.clear();
+        heatmapTileMilliseconds.clear();
+        if (options.heatmap)
+        {
+            if (device->shaderClockSupported)
+                std::cout << "[INFO] heatmap of shader clock cycles per pixel" << std::endl;
+            else if (device->timestampsSupported)
+                std::cout << "[WARN] VK_KHR_shader_clock not available, heatmap of incremental gpu time per " << kHeatmapTileSide << " pixel tile" << std::endl;
+            else
+                throw std::runtime_error("[FATAL] the device has neither shader clocks nor timestamps, there is nothing to draw a heatmap from");
+            intermediateFormat = kHeatmapTargetFormat;
+
+            heatmap.path = "heatmap";
+            heatmap.spirv = builtinSpirv(builtin_heatmap_frag);
+            heatmap.reflection = reflectSpirv(heatmap.spirv);
+            ShaderInterface shaderInterface;
+            shaderInterface.Add(heatmap.reflection, VK_SHADER_STAGE_FRAGMENT_BIT);
+            heatmap.interfaceLayout = descriptorCache->Get(shaderInterface);
+            heatmapLow = 0.0f;
+            heatmapHigh = 1.0f;
+        }
+
+        if (intermediateFormat != VK_FORMAT_UNDEFINED)
+        {
+            intermediatePass = new RenderPass(device->handle,
+                                              intermediateFormat,
+                                              VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                              VK_IMAGE_LAYOUT_UNDEFINED,
+                                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+
+        // anti-aliasing: a multisampled swapchain pass, or the shader into a supersampled target box filtered by the resolve
+        multisampleImage = nullptr;
+        supersamplePass = nullptr;
+        supersampled = nullptr;
+        // sample rate shading is a device feature enabled at creation, only the sample count varies by device
+        if (options.msaaSamples > 1 && !sampleCountSupported(device, options.msaaSamples))
+            throw std::runtime_error("[FATAL] device cannot render " + std::to_string(options.msaaSamples) + " samples per pixel");
+        if (options.supersample > 1 || options.aaBench > 0)
+        {
+            supersamplePass = new RenderPass(device->handle,
+                                             kSupersampleFormat,
+                                             VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                             VK_IMAGE_LAYOUT_UNDEFINED,
+                                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+
+        if (accumulateLoadPass != nullptr || tilePass != nullptr || options.targetFormat.has_value() || supersamplePass != nullptr || options.formatBench > 0)
+        {
+            resolve.path = "resolve";
+            resolve.spirv = builtinSpirv(builtin_resolve_frag);
+            resolve.reflection = reflectSpirv(resolve.spirv);
+            ShaderInterface shaderInterface;
+            shaderInterface.Add(resolve.reflection, VK_SHADER_STAGE_FRAGMENT_BIT);
+            resolve.interfaceLayout = descriptorCache->Get(shaderInterface);
+        }
+
+        // checkerboard: half the pixels per frame into alternating half width targets, reconstructed in the swapchain pass
+        reconstruct = ShaderProgram{};
+        checkerPass = nullptr;
+        checkerTargets = {nullptr, nullptr};
+        checkerFrames = 0;
+        if (options.checkerboard)
+        {
+            checkerPass = new RenderPass(device->handle,
+                                         kCheckerboardFormat,
+                                         VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            reconstruct.path = "reconstruct";
+            reconstruct.spirv = builtinSpirv(builtin_reconstruct_frag);
+            reconstruct.reflection = reflectSpirv(reconstruct.spirv);
+            ShaderInterface shaderInterface;
+            shaderInterface.Add(reconstruct.reflection, VK_SHADER_STAGE_FRAGMENT_BIT);
+            reconstruct.interfaceLayout = descriptorCache->Get(shaderInterface);
+        }
+
+        frameInputs = FrameInputs{};
+        startTime = std::chrono::high_resolution_clock::now();
+        lastFrameTime = startTime;
+        lastFrameStart = startTime;
+
+        // a headless surface has no mouse and no monitor, pace against a nominal 60 Hz
+        const GLFWvidmode *videoMode = nullptr;
+        if (window->window != nullptr)
+        {
+            glfwSetWindowUserPointer(window->window, this);
+            glfwSetMouseButtonCallback(window->window, Application::MouseButtonCallback);
+            glfwSetFramebufferSizeCallback(window->window, Application::FramebufferSizeCallback);
+            glfwSetWindowRefreshCallback(window->window, Application::RefreshCallback);
+            videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        }
+        inputThread = options.inputThread && window->window != nullptr;
+        pendingInput = InputState{};
+        latestInput = InputState{};
+        latchedPresses = 0;
+        latchedDamage = 0;
+        inputSampledAt.reset();
+        inputLatency = SampleStats{};
+        if (inputThread)
+        {
+            // the first swapchain is sized from the published state like every later one
+            this->PublishInput();
+            this->LatchInput();
+        }
+        onDemand = this->ChooseOnDemand();
+        redrawRequested = true;
+        double refreshRate = (videoMode != nullptr && videoMode->refreshRate > 0) ? videoMode->refreshRate : 60.0;
+        framePacing = new FramePacing(refreshRate, device->presentWaitSupported);
+        presentId = 0;
+        timeline = new FrameTimeline(device, options.framesInFlight);
+        metrics = options.metricsEndpoint.empty() ? nullptr : new MetricsServer(options.metricsEndpoint);
+        lastGpuMilliseconds = -1.0;
+
+        traceWriter = options.recordPath.empty() ? nullptr : new TraceWriter(options.recordPath);
+        traceReader = options.replayPath.empty() ? nullptr : new TraceReader(options.replayPath);
+        replayMismatches = 0;
+
+        views.clear();
+        if (options.windows)
+            this->OpenWindows();
+        else
+            this->Resize();
+    }
+    void Run()
+    {
+        if (inputThread)
+        {
+            // glfw delivers events on the main thread only, so the frames move to another one
+            std::exception_ptr failure;
+            std::atomic<bool> rendering(true);
+            std::thread renderer([&]()
+                                 {
+                try
+                {
+                    this->RenderLoop();
+                }
+                catch (...)
+                {
+                    failure = std::current_exception();
+                }
+                rendering.store(false);
+                glfwPostEmptyEvent(); });
+            while (rendering.load())
+            {
+                glfwWaitEvents();
+                this->PublishInput();
+            }
+            renderer.join();
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+        else
+        {
+            this->RenderLoop();
+        }
+
+        vkDeviceWaitIdle(device->handle); // drain queues after exiting event loop
+
+        if (options.samplesPerPixel > 0 && sampleCount >= options.samplesPerPixel)
+            this->WriteAccumulation();
+        else if (options.samplesPerPixel > 0)
+            std::cout << "[WARN] window closed after " << sampleCount << " of " << options.samplesPerPixel << " samples, nothing written" << std::endl;
+
+        if (options.stats)
+            framePacing->Report(std::cout, swapChain->presentMode);
+        if (options.gallery)
+            this->ReportGallery();
+        if (tiler != nullptr && tiler->frameMilliseconds.Count() > 0)
+            std::cout << std::fixed << std::setprecision(3)
+                      << "[TILED] " << tiler->frameMilliseconds.Count() << " frames, mean " << tiler->frameTiles.Mean() << " tiles "
+                      << tiler->frameMilliseconds.Mean() << " ms/frame, p99 " << tiler->frameMilliseconds.Percentile(0.99) << " ms, "
+                      << tiler->overBudgetTiles << " tiles over the " << options.tileBudget << " ms budget" << std::endl;
+        if (traceWriter != nullptr)
+            std::cout << "[TRACE] recorded " << traceWriter->frames << " frames to \'" << options.recordPath << "\'" << std::endl;
+        if (traceReader != nullptr && replayMismatches > 0)
+            std::cout << "[TRACE] " << replayMismatches << " replayed frames rendered at a size other than recorded" << std::endl;
+        if (inputLatency.Count() > 0)
+            std::cout << std::fixed << std::setprecision(1)
+                      << "[INPUT] " << inputLatency.Count() << " samples from " << (inputThread ? "the event thread" : "the render loop")
+                      << ", input to uniform p50 " << inputLatency.Percentile(0.5) << " us p99 " << inputLatency.Percentile(0.99)
+                      << " us max " << inputLatency.Percentile(1.0) << " us" << std::endl;
+        if (options.memoryReport)
+            device->allocator->Report(std::cout);
+    }
+    void RenderLoop()
+    {
+        while (!window->ShouldClose())
+        {
+            int width = 0, height = 0;
+            this->FramebufferSize(width, height);
+            while (width == 0 || height == 0)
+            {
+                this->FramebufferSize(width, height);
+                this->WaitForInput();
+            }
+            this->PollInput();
+
+            if (traceReader != nullptr)
+            {
+                // the recorded resizes come before the frame that followed them; a trace that has run out ends the run
+                for (auto record = traceReader->Peek(); record != nullptr && record->event == TraceEvent::Resize; record = traceReader->Peek())
+                {
+                    window->RequestSize(record->extent);
+                    traceReader->Pop();
+                }
+                if (traceReader->Peek() == nullptr)
+                    break;
+            }
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+            // a headless surface never reports out of date, rebuild on the simulated resize instead
+            if (window->resized)
+            {
+                window->resized = false;
+                this->Resize();
+            }
+
+            // nothing on screen would change, sleep until glfw has an event for us
+            if (onDemand && !redrawRequested)
+            {
+                this->WaitForInput();
+                continue;
+            }
+
+            auto acquireStart = std::chrono::high_resolution_clock::now();
+            MetricsSample sample{};
+            sample.cpuMilliseconds = std::chrono::duration<double, std::milli>(acquireStart - lastFrameStart).count();
+            lastFrameStart = acquireStart;
+            if (device->presentWaitSupported)
+                framePacing->Poll(device->handle, swapChain->handle, device->waitForPresent);
+
+            // only block when the cpu is more than framesInFlight frames ahead of the gpu; acquire semaphores
+            // come back around every swapchain image count frames, which bounds the depth as well
+            auto acquireSemaphores = swapChain->imageAvailableSemaphores.size();
+            uint64_t depth = std::min<uint64_t>(timeline->framesInFlight, acquireSemaphores);
+            if (timeline->submitted >= depth)
+                timeline->Wait(timeline->submitted + 1 - depth);
+            timeline->Collect();
+
+            auto imageAvailableSemaphore = swapChain->imageAvailableSemaphores[(timeline->submitted + 1) % acquireSemaphores];
+
+            uint32_t imageIdx;
+            auto acquireCallStart = std::chrono::high_resolution_clock::now();
+            auto status = vkAcquireNextImageKHR(
+                device->handle,
+                swapChain->handle,
+                UINT64_MAX,
+                imageAvailableSemaphore,
+                VK_NULL_HANDLE,
+                &imageIdx);
+            sample.acquireMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - acquireCallStart).count();
+
+            /*
+            update uniform
+            */
+            // a tiled frame keeps the inputs of its first tile, so every tile shades the same image
+            if (tiler == nullptr || tiler->AtFrameStart())
+                this->UpdateFrameInputs(width, height);
+            if (accumulation != nullptr)
+                this->CheckAccumulationInputs();
+
+            bool mustResize = (status == VK_ERROR_OUT_OF_DATE_KHR || status == VK_SUBOPTIMAL_KHR);
+            if (mustResize)
+            {
+                this->Resize();
+            }
+            else
+            {
+                // the last frame drawn into this image must retire before its uniforms, timer slot and command pools are reused
+                timeline->Wait(imageFrames[imageIdx]);
+                auto renderFinishedSemaphore = swapChain->renderFinishedSemaphores[imageIdx];
+                if (tiler == nullptr)
+                    this->ReadGpuTimes(imageIdx);
+                // as late as possible: the newest input the event thread has published
+                if (inputThread && (tiler == nullptr || tiler->AtFrameStart()) && this->LatchInput())
+                {
+                    inputSampledAt = latestInput.sampled;
+                    if (accumulation != nullptr)
+                        this->CheckAccumulationInputs();
+                }
+                if (tiler == nullptr || tiler->AtFrameStart())
+                    this->TraceFrame();
+                this->UpdateUniforms(imageIdx);
+                if (inputSampledAt.has_value())
+                {
+                    inputLatency.Add(std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - *inputSampledAt).count());
+                    inputSampledAt.reset();
+                }
+                int32_t shadedFrame = frameInputs.frame;
+                VkRect2D tile{};
+                if (tiler != nullptr)
+                    tile = tiler->Next();
+                if (tiler == nullptr || tiler->AtFrameStart())
+                {
+                    frameInputs.frame++;
+                    frameInputs.mouse.clicked = false;
+                }
+
+                auto recordStart = std::chrono::high_resolution_clock::now();
+                std::vector<PassRecording> passes;
+                if (options.checkerboard)
+                {
+                    // iFrame parity picks the half shaded this frame and the target it lands in
+                    ReconstructPushConstants pushConstants{shadedFrame & 1, checkerFrames > 0 ? 1 : 0};
+                    memcpy(frameDraws[imageIdx][0].pushConstants.data(), &pushConstants, sizeof(pushConstants));
+                    auto target = checkerTargets[pushConstants.parity];
+                    passes.push_back({checkerPass->handle, target->framebuffer->handles[0], target->extent, &checkerDraws[pushConstants.parity][imageIdx]});
+                    checkerFrames++;
+                }
+                if (accumulation != nullptr)
+                {
+                    // the first sample clears the target, the rest add to it
+                    float scale = 1.0f / static_cast<float>(sampleCount + 1);
+                    memcpy(frameDraws[imageIdx][0].pushConstants.data(), &scale, sizeof(scale));
+                    passes.push_back({sampleCount == 0 ? accumulateClearPass->handle : accumulateLoadPass->handle,
+                                      accumulation->framebuffer->handles[0],
+                                      swapChain->extent,
+                                      &offscreenDraws[imageIdx]});
+                }
+                if (tileTarget != nullptr)
+                {
+                    offscreenDraws[imageIdx][0].scissor = tile;
+                    passes.push_back({tilePass->handle, tileTarget->framebuffer->handles[0], tileTarget->extent, &offscreenDraws[imageIdx]});
+                }
+                if (intermediate != nullptr)
+                    passes.push_back({intermediatePass->handle, intermediate->framebuffer->handles[0], intermediate->extent, &offscreenDraws[imageIdx]});
+                if (supersampled != nullptr)
+                    passes.push_back({supersamplePass->handle, supersampled->framebuffer->handles[0], supersampled->extent, &offscreenDraws[imageIdx]});
+                passes.push_back({renderPass->handle, framebuffer->handles[imageIdx], swapChain->extent, &frameDraws[imageIdx]});
+                std::vector<VkCommandBuffer> commandBuffers;
+                commandBuffers.push_back(commandRecorder->Record(imageIdx, passes, gpuTimer));
+                recordMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - recordStart).count();
+
+                VkSubmitInfo submitInfo{};
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+                // @@@ imageAvailableSemaphores should belong to swapchain?
+                VkSemaphore submitWaitSemaphores[] = {imageAvailableSemaphore};
+                VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+                submitInfo.waitSemaphoreCount = 1;
+                submitInfo.pWaitSemaphores = submitWaitSemaphores;
+                submitInfo.pWaitDstStageMask = waitStages;
+                submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+                submitInfo.pCommandBuffers = commandBuffers.data();
+
+                VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
+                submitInfo.signalSemaphoreCount = 1;
+                submitInfo.pSignalSemaphores = signalSemaphores;
+
+                imageFrames[imageIdx] = timeline->Submit(submitInfo);
+                if (accumulation != nullptr)
+                    sampleCount++;
+
+                VkPresentInfoKHR presentInfo{};
+                presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+                presentInfo.waitSemaphoreCount = 1;
+                VkSemaphore presentWaitSemaphores[] = {renderFinishedSemaphore};
+                presentInfo.pWaitSemaphores = presentWaitSemaphores;
+
+                VkSwapchainKHR swapChains[] = {swapChain->handle};
+                presentInfo.swapchainCount = 1;
+                presentInfo.pSwapchains = swapChains;
+                presentInfo.pImageIndices = &imageIdx;
+                presentInfo.pResults = nullptr; // Optional
+
+                // tag the present so VK_KHR_present_wait can tell when it reached the screen
+                presentId++;
+                VkPresentIdKHR presentIdInfo{};
+                presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+                presentIdInfo.swapchainCount = 1;
+                presentIdInfo.pPresentIds = &presentId;
+                if (device->presentWaitSupported)
+                    presentInfo.pNext = &presentIdInfo;
+
+                auto presentCallStart = std::chrono::high_resolution_clock::now();
+                auto presentStatus = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+                sample.presentMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - presentCallStart).count();
+                if (presentStatus == VK_ERROR_OUT_OF_DATE_KHR || presentStatus == VK_SUBOPTIMAL_KHR)
+                    this->Resize();
+                else if (presentStatus != VK_SUCCESS)
+                    throw std::runtime_error("failed to present command buffer!");
+                else
+                    framePacing->Presented(presentId, acquireStart);
+                if (presentStatus == VK_SUCCESS)
+                    redrawRequested = false;
+
+                // the next tile is sized from this one's cost, so wait for it rather than run ahead
+                if (tiler != nullptr)
+                {
+                    timeline->Wait(imageFrames[imageIdx]);
+                    std::vector<double> milliseconds;
+                    if (gpuTimer->Read(imageIdx, milliseconds))
+                    {
+                        tiler->Measured(tile, milliseconds[0]);
+                        lastGpuMilliseconds = milliseconds[0];
+                    }
+                }
+
+                if (metrics != nullptr)
+                {
+                    sample.event = MetricsEvent::Frame;
+                    sample.frame = presentId;
+                    sample.seconds = std::chrono::duration<double>(presentCallStart - startTime).count();
+                    sample.gpuMilliseconds = lastGpuMilliseconds;
+                    metrics->Record(sample);
+                }
+            }
+
+            if (options.stats)
+                this->ReportStats();
+            if (heatmap.pipeline != nullptr)
+                this->UpdateHeatmap();
+            if (options.samplesPerPixel > 0 && sampleCount >= options.samplesPerPixel)
+                break;
+            if (options.frameLimit > 0 && presentId >= options.frameLimit)
+                break;
+            if (options.resizeEvery > 0 && presentId > 0 && presentId % options.resizeEvery == 0)
+            {
+                VkExtent2D extent = options.headless.value();
+                if ((presentId / options.resizeEvery) % 2 == 1)
+                    extent = {std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u)};
+                window->SetHeadlessExtent(extent);
+            }
+        }
+    }
+    // event thread only: the window's input as of now, handed to the render loop
+    void PublishInput()
+    {
+        glfwGetFramebufferSize(window->window, &pendingInput.width, &pendingInput.height);
+        if (pendingInput.mouse.down)
+            pendingInput.mouse.position = this->CursorPosition();
+        pendingInput.sampled = std::chrono::high_resolution_clock::now();
+        inputSlot.Publish(pendingInput);
+    }
+    // render loop only: applies the newest published input to the frame inputs, false if there was none
+    bool LatchInput()
+    {
+        if (!inputSlot.Take(latestInput))
+            return false;
+        auto &mouse = frameInputs.mouse;
+        if (latestInput.presses != latchedPresses)
+        {
+            mouse.clicked = true;
+            mouse.click = latestInput.mouse.click;
+            latchedPresses = latestInput.presses;
+        }
+        mouse.down = latestInput.mouse.down;
+        if (mouse.down)
+            mouse.position = latestInput.mouse.position;
+        if (latestInput.damage != latchedDamage)
+        {
+            redrawRequested = true;
+            latchedDamage = latestInput.damage;
+        }
+        return true;
+    }
+    void PollInput()
+    {
+        if (inputThread)
+            this->LatchInput();
+        else
+            window->PollEvents();
+    }
+    // blocks until there may be something new; the render thread cannot wait on glfw, so it naps instead
+    void WaitForInput()
+    {
+        if (inputThread)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kInputIdleMilliseconds));
+            this->LatchInput();
+        }
+        else
+        {
+            window->WaitEvents();
+        }
+    }
+    void FramebufferSize(int &width, int &height)
+    {
+        if (inputThread)
+        {
+            width = latestInput.width;
+            height = latestInput.height;
+        }
+        else
+        {
+            window->FramebufferSize(width, height);
+        }
+    }
+    double Seconds()
+    {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+    }
+    // records the frame's inputs, or replaces them with the next recorded frame's
+    void TraceFrame()
+    {
+        if (traceWriter != nullptr)
+        {
+            VkExtent2D extent = {static_cast<uint32_t>(frameInputs.resolution.x), static_cast<uint32_t>(frameInputs.resolution.y)};
+            traceWriter->Write({TraceEvent::Frame, this->Seconds(), extent, frameInputs});
+        }
+        if (traceReader == nullptr || traceReader->Peek() == nullptr)
+            return;
+
+        auto record = *traceReader->Peek();
+        traceReader->Pop();
+        if (options.realtime)
+        {
+            auto due = startTime + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(record.seconds));
+            std::this_thread::sleep_until(due);
+        }
+        // the uniforms follow the trace, iResolution included; a window manager that refused the recorded size still
+        // changes how many pixels get shaded
+        if (record.extent.width != swapChain->extent.width || record.extent.height != swapChain->extent.height)
+        {
+            if (replayMismatches == 0)
+                std::cout << "[WARN] frame " << record.inputs.frame << " was recorded at " << record.extent.width << "x" << record.extent.height
+                          << " but renders at " << swapChain->extent.width << "x" << swapChain->extent.height << ", replay headless for exact sizes" << std::endl;
+            replayMismatches++;
+        }
+        frameInputs = record.inputs;
+        if (accumulation != nullptr)
+            this->CheckAccumulationInputs();
+    }
+    // localtime is not free, only shaders that read iDate pay for it every frame
+    void SampleDate(bool always = false)
+    {
+        if (always || AnyProgramUses(ShaderInput::Date))
+            frameInputs.date = localDate();
+    }
+    bool AnyProgramUses(ShaderInput input)
+    {
+        return std::any_of(programs.begin(), programs.end(), [&](const ShaderProgram &program)
+                           { return program.uniformLayout->Uses(input); });
+    }
+    // the offscreen target the swapchain pass resolves, nullptr when the shader draws to the swapchain directly
+    RenderTarget *ResolvedTarget()
+    {
+        if (accumulation != nullptr)
+            return accumulation;
+        if (tileTarget != nullptr)
+            return tileTarget;
+        if (supersampled != nullptr)
+            return supersampled;
+        return intermediate;
+    }
+    // a frame only needs drawing when something changed if the output depends on nothing but the resolution
+    bool ChooseOnDemand()
+    {
+        if (window->window == nullptr || options.continuous)
+            return false;
+        if (options.onDemand)
+        {
+            std::cout << "[INFO] redrawing only on resize, input or damage" << std::endl;
+            return true;
+        }
+        // modes that exist to render many frames keep rendering
+        if (options.gallery || options.stats || options.accumulate || options.checkerboard || options.tileBudget > 0.0 || options.frameLimit > 0 || options.heatmap ||
+            !options.replayPath.empty())
+            return false;
+        for (auto input : {ShaderInput::Time, ShaderInput::TimeDelta, ShaderInput::FrameRate, ShaderInput::Frame, ShaderInput::Mouse, ShaderInput::Date, ShaderInput::ChannelTime})
+        {
+            if (AnyProgramUses(input))
+                return false;
+        }
+        std::cout << "[INFO] shader reads no clock, frame or mouse input, redrawing only on resize, input or damage (--continuous to render every frame)" << std::endl;
+        return true;
+    }
+    void UpdateFrameInputs(int width, int height)
+    {
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        frameInputs.time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        this->SampleDate(traceWriter != nullptr); // a trace records iDate whether or not this shader reads it
+        frameInputs.timeDelta = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastFrameTime).count();
+        lastFrameTime = currentTime;
+        frameInputs.resolution = glm::vec3(width, height, 1.0);
+
+        if (AnyProgramUses(ShaderInput::FrameRate) && frameInputs.timeDelta > 0.0f)
+        {
+            // smoothed like shadertoy, a single late frame should not make iFrameRate jump
+            float instant = 1.0f / frameInputs.timeDelta;
+            frameInputs.frameRate = frameInputs.frameRate > 0.0f ? 0.9f * frameInputs.frameRate + 0.1f * instant : instant;
+        }
+
+        // with an event thread the cursor arrives with the rest of the input, see LatchInput
+        if (!inputThread && AnyProgramUses(ShaderInput::Mouse) && frameInputs.mouse.down)
+        {
+            frameInputs.mouse.position = this->CursorPosition();
+            inputSampledAt = std::chrono::high_resolution_clock::now();
+        }
+    }
+    // each program sees its own cell as the whole screen
+    void UpdateUniforms(uint32_t imageIdx)
+    {
+        // a replay keeps the recorded iResolution even where the window manager refused the recorded size
+        float scaleX = 1.0f, scaleY = 1.0f;
+        if (traceReader != nullptr && swapChain->extent.width > 0 && swapChain->extent.height > 0)
+        {
+            scaleX = frameInputs.resolution.x / static_cast<float>(swapChain->extent.width);
+            scaleY = frameInputs.resolution.y / static_cast<float>(swapChain->extent.height);
+        }
+        for (auto &program : programs)
+        {
+            FrameInputs cellInputs = frameInputs;
+            glm::vec2 origin(static_cast<float>(program.cell.offset.x), static_cast<float>(program.cell.offset.y));
+            cellInputs.resolution = glm::vec3(program.cell.extent.width * scaleX, program.cell.extent.height * scaleY, 1.0);
+            cellInputs.mouse.position = frameInputs.mouse.position - origin;
+            cellInputs.mouse.click = frameInputs.mouse.click - origin;
+            program.uniform->Update(*program.uniformLayout, cellInputs, imageIdx);
+        }
+
+        if (overlay.uniform != nullptr)
+        {
+            std::array<float, kMaxGalleryCells> values;
+            values.fill(-1.0f);
+            for (size_t idx = 0; idx < cellMilliseconds.size(); idx++)
+                values[idx] = static_cast<float>(cellMilliseconds[idx]);
+            memcpy(overlay.uniform->allocations[imageIdx].mapped, values.data(), sizeof(values));
+        }
+    }
+    // results of the last frame rendered into this image, if it has finished
+    void ReadGpuTimes(uint32_t imageIdx)
+    {
+        std::vector<double> milliseconds;
+        if (gpuTimer == nullptr || !gpuTimer->Read(imageIdx, milliseconds))
+            return;
+        if (!heatmapTiles.empty())
+        {
+            // heatmap tiles are timed one by one, the program's time is their sum
+            heatmapTileMilliseconds = milliseconds;
+            milliseconds = {std::accumulate(heatmapTileMilliseconds.begin(), heatmapTileMilliseconds.end(), 0.0)};
+        }
+
+        lastGpuMilliseconds = 0.0;
+        for (size_t idx = 0; idx < milliseconds.size(); idx++)
+        {
+            lastGpuMilliseconds += milliseconds[idx];
+            // smoothed so the overlay stays readable
+            cellMilliseconds[idx] = cellMilliseconds[idx] < 0.0 ? milliseconds[idx] : 0.9 * cellMilliseconds[idx] + 0.1 * milliseconds[idx];
+            cellTotalMilliseconds[idx] += milliseconds[idx];
+            cellSamples[idx]++;
+        }
+    }
+    // once a second: read back or upload the costs, print their distribution and fit the color ramp to it
+    void UpdateHeatmap()
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        if (now < heatmapNextReport)
+            return;
+        std::vector<uint32_t> costs;
+        if (heatmapTiles.empty())
+        {
+            // stalls the queue, which the per pixel clock does not see
+            vkDeviceWaitIdle(device->handle);
+            costs = costImage->Read();
+        }
+        else
+        {
+            if (heatmapTileMilliseconds.size() != heatmapTiles.size())
+                return;
+            // clipped tiles along the right and bottom edges are scaled up to a full tile
+            for (size_t idx = 0; idx < heatmapTiles.size(); idx++)
+            {
+                double area = static_cast<double>(heatmapTiles[idx].extent.width) * heatmapTiles[idx].extent.height;
+                double fullArea = static_cast<double>(kHeatmapTileSide) * kHeatmapTileSide;
+                costs.push_back(static_cast<uint32_t>(heatmapTileMilliseconds[idx] * 1e6 * fullArea / area));
+            }
+            vkDeviceWaitIdle(device->handle);
+            costImage->Write(costs);
+        }
+        heatmapNextReport = std::chrono::high_resolution_clock::now() +
+                            std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(kHeatmapReportSeconds));
+
+        auto distribution = summarizeCosts(costs);
+        std::string unit = heatmapTiles.empty() ? "cycles/px" : "incremental ns/tile";
+        std::string what = heatmapTiles.empty() ? "pixels" : "tiles";
+        std::cout << std::fixed << std::setprecision(1)
+                  << "[HEATMAP] " << unit << " min " << distribution.min << " p50 " << distribution.p50 << " p90 " << distribution.p90
+                  << " p99 " << distribution.p99 << " max " << distribution.max
+                  << " | costliest " << kHeatmapTopFraction * 100.0 << "% of " << what << " take " << distribution.topShare * 100.0 << "% of the total" << std::endl;
+
+        // p99 rather than max at the top, so a handful of outliers do not wash out the rest
+        heatmapLow = static_cast<float>(distribution.min);
+        heatmapHigh = static_cast<float>(std::max(distribution.p99, distribution.min + 1));
+        HeatmapPushConstants pushConstants{heatmapLow, heatmapHigh, static_cast<int32_t>(heatmapTiles.empty() ? 1 : kHeatmapTileSide)};
+        for (auto &draws : frameDraws)
+            memcpy(draws[0].pushConstants.data(), &pushConstants, sizeof(pushConstants));
+    }
+    // the accumulated frames are only valid while the shader sees the same mouse
+    void CheckAccumulationInputs()
+    {
+        const auto &mouse = frameInputs.mouse;
+        bool moved = mouse.position != accumulatedMouse.position || mouse.click != accumulatedMouse.click || mouse.down != accumulatedMouse.down;
+        if (moved && AnyProgramUses(ShaderInput::Mouse))
+            sampleCount = 0;
+        accumulatedMouse = mouse;
+    }
+    // average of everything accumulated so far, written to --output
+    void WriteAccumulation()
+    {
+        auto texels = accumulation->Read(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        float scale = 1.0f / static_cast<float>(sampleCount);
+        for (auto &value : texels)
+            value *= scale;
+
+        // 8 bit output is encoded like the window shows it
+        auto format = swapChain->surfaceFormat.format;
+        bool srgb = format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_R8G8B8A8_SRGB;
+        writeImage(options.outputPath, accumulation->extent.width, accumulation->extent.height, texels, srgb);
+        std::cout << "[INFO] wrote " << sampleCount << " samples per pixel to '" << options.outputPath << "'" << std::endl;
+    }
+    glm::vec2 CursorPosition()
+    {
+        return this->CursorPosition(window->window);
+    }
+    // cursor in framebuffer pixels, which differ from screen coordinates on high dpi displays
+    glm::vec2 CursorPosition(GLFWwindow *glfwWindow)
+    {
+        if (glfwWindow == nullptr)
+            return glm::vec2(0.0f, 0.0f);
+        double xpos, ypos;
+        glfwGetCursorPos(glfwWindow, &xpos, &ypos);
+        int windowWidth, windowHeight, width, height;
+        glfwGetWindowSize(glfwWindow, &windowWidth, &windowHeight);
+        glfwGetFramebufferSize(glfwWindow, &width, &height);
+        if (windowWidth == 0 || windowHeight == 0)
+            return glm::vec2(0.0f, 0.0f);
+        // a supersampled shader sees a framebuffer factor times larger
+        double factor = static_cast<double>(options.supersample);
+        return glm::vec2(xpos * width * factor / windowWidth, ypos * height * factor / windowHeight);
+    }
+    // glfw calls these on the main thread; with an event thread that is not the render loop's, so they only touch pendingInput
+    void Damaged()
+    {
+        if (inputThread)
+            pendingInput.damage++;
+        else
+            redrawRequested = true;
+    }
+    static void FramebufferSizeCallback(GLFWwindow *glfwWindow, int /*width*/, int /*height*/)
+    {
+        reinterpret_cast<Application *>(glfwGetWindowUserPointer(glfwWindow))->Damaged();
+    }
+    static void RefreshCallback(GLFWwindow *glfwWindow)
+    {
+        reinterpret_cast<Application *>(glfwGetWindowUserPointer(glfwWindow))->Damaged();
+    }
+    static void MouseButtonCallback(GLFWwindow *glfwWindow, int button, int action, int /*mods*/)
+    {
+        auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(glfwWindow));
+        app->Damaged();
+        if (button != GLFW_MOUSE_BUTTON_LEFT)
+            return;
+        if (app->inputThread && action == GLFW_PRESS)
+            app->pendingInput.presses++;
+        auto *mouse = app->inputThread ? &app->pendingInput.mouse : &app->frameInputs.mouse;
+        // with --windows each window keeps its own mouse
+        for (auto &view : app->views)
+            if (view.window->window == glfwWindow)
+                mouse = &view.mouse;
+        if (action == GLFW_PRESS)
+        {
+            mouse->down = true;
+            mouse->clicked = true;
+            mouse->position = app->CursorPosition(glfwWindow);
+            mouse->click = mouse->position;
+        }
+        else if (action == GLFW_RELEASE)
+        {
+            mouse->down = false;
+        }
+    }
+    void ReportStats()
+    {
+        statsFrames++;
+        auto now = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration<double>(now - statsStart).count();
+        if (elapsed < 1.0)
+            return;
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1)
+           << "[STATS] " << statsFrames / elapsed << " fps "
+           << 1000.0 * elapsed / statsFrames << " ms/frame | "
+           << "record " << recordMicroseconds / statsFrames << " us/frame (" << workers->threadCount << " threads) | ";
+        if (accumulation != nullptr)
+            ss << "spp " << sampleCount << " | ";
+        if (tiler != nullptr)
+            ss << tiler->Summary() << " | " << std::setprecision(1);
+        if (options.targetFormat.has_value())
+            ss << options.targetFormat->name << " " << TargetMegabytes(options.targetFormat->bytesPerPixel) << " MB written/frame | ";
+        if (gpuTimer != nullptr && cellSamples[0] > 0)
+        {
+            double gpuMilliseconds = 0.0;
+            for (auto milliseconds : cellMilliseconds)
+                gpuMilliseconds += milliseconds;
+            ss << std::setprecision(3) << "gpu " << gpuMilliseconds << " ms | " << std::setprecision(1);
+        }
+        ss << presentModeName(swapChain->presentMode) << " " << framePacing->Summary() << " | "
+           << device->allocator->BudgetSummary();
+        std::cout << ss.str() << std::endl;
+
+        statsFrames = 0;
+        statsStart = now;
+        recordMicroseconds = 0.0;
+    }
+    // mean gpu time per shader over the whole run, most expensive first, beside its static cost estimate
+    void ReportGallery()
+    {
+        std::vector<size_t> order(programs.size());
+        for (size_t idx = 0; idx < order.size(); idx++)
+            order[idx] = idx;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                  { return cellTotalMilliseconds[a] / std::max<size_t>(cellSamples[a], 1) > cellTotalMilliseconds[b] / std::max<size_t>(cellSamples[b], 1); });
+
+        // least squares fit of measured ns/pixel against estimated ops/pixel across the timed cells
+        std::vector<double> nanosecondsPerPixel(programs.size(), 0.0);
+        double n = 0.0, sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0, sumYY = 0.0;
+        for (size_t idx = 0; idx < programs.size(); idx++)
+        {
+            if (cellSamples[idx] == 0)
+                continue;
+            const auto &cell = programs[idx].cell;
+            nanosecondsPerPixel[idx] = 1e6 * cellTotalMilliseconds[idx] / cellSamples[idx] / (static_cast<double>(cell.extent.width) * cell.extent.height);
+            double x = programs[idx].cost.estimatedOps, y = nanosecondsPerPixel[idx];
+            n += 1.0;
+            sumX += x;
+            sumY += y;
+            sumXX += x * x;
+            sumXY += x * y;
+            sumYY += y * y;
+        }
+        double varianceX = n * sumXX - sumX * sumX;
+        double varianceY = n * sumYY - sumY * sumY;
+        bool fitted = n >= 3.0 && varianceX > 0.0;
+        double slope = fitted ? (n * sumXY - sumX * sumY) / varianceX : 0.0;
+        double intercept = fitted ? (sumY - slope * sumX) / n : 0.0;
+        double correlation = fitted && varianceY > 0.0 ? (n * sumXY - sumX * sumY) / std::sqrt(varianceX * varianceY) : 0.0;
+
+        std::cout << "[GALLERY] mean incremental gpu time per cell, measured and estimated cost per pixel" << std::endl;
+        for (auto idx : order)
+        {
+            std::stringstream ss;
+            ss << "[GALLERY] " << std::fixed;
+            if (cellSamples[idx] == 0)
+                ss << std::setw(10) << "-" << std::setw(15) << "-";
+            else
+                ss << std::setprecision(3) << std::setw(7) << cellTotalMilliseconds[idx] / cellSamples[idx] << " ms"
+                   << std::setw(9) << nanosecondsPerPixel[idx] << " ns/px";
+            ss << std::setprecision(0) << std::setw(9) << programs[idx].cost.estimatedOps << " ops";
+            if (fitted)
+                ss << std::setprecision(3) << "  fit " << std::setw(7) << intercept + slope * programs[idx].cost.estimatedOps << " ns/px";
+            ss << "  " << programs[idx].path;
+            std::cout << ss.str() << std::endl;
+        }
+        if (fitted)
+            std::cout << std::scientific << std::setprecision(3)
+                      << "[GALLERY] ns/px = " << intercept << " + " << slope << " * ops, r^2 " << std::fixed << correlation * correlation
+                      << " over " << static_cast<int>(n) << " shaders" << std::endl;
+        else
+            std::cout << "[GALLERY] at least three timed shaders of different estimated cost are needed to fit ns/px against ops" << std::endl;
+    }
+    void Resize()
+    {
+        // the extent arena is recycled below, nothing in flight may still reference it
+        vkDeviceWaitIdle(device->handle);
+        redrawRequested = true;
+        auto retired = swapChain;
+        swapChain = nullptr;
+        this->CleanupExtent();
+        device->allocator->ResetExtent();
+        framePacing->SwapChainRecreated();
+        int width, height;
+        this->FramebufferSize(width, height);
+        swapChain = new SwapChain(window->surface,
+                                  device->physicalDevice,
+                                  device->handle,
+                                  width,
+                                  height,
+                                  options.presentMode,
+                                  retired != nullptr ? retired->handle : VK_NULL_HANDLE);
+        // the new swap chain takes over from the retired one, which goes once the frames submitted so far have retired
+        if (retired != nullptr)
+            timeline->Defer([retired]()
+                            { delete retired; });
+        if (metrics != nullptr)
+        {
+            MetricsSample sample{};
+            sample.event = MetricsEvent::Resize;
+            sample.frame = presentId;
+            sample.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+            sample.width = swapChain->extent.width;
+            sample.height = swapChain->extent.height;
+            metrics->Record(sample);
+        }
+        if (traceWriter != nullptr)
+            traceWriter->Write({TraceEvent::Resize, this->Seconds(), swapChain->extent, {}});
+        imageFrames.assign(swapChain->imageHandles.size(), timeline->submitted);
+        auto samples = static_cast<VkSampleCountFlagBits>(options.msaaSamples);
+        renderPass = new RenderPass(device->handle,
+                                    swapChain->surfaceFormat.format,
+                                    VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                    VK_IMAGE_LAYOUT_UNDEFINED,
+                                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                    samples);
+        if (samples != VK_SAMPLE_COUNT_1_BIT)
+            multisampleImage = new MultisampleImage(device, swapChain->extent, swapChain->surfaceFormat.format, samples, "Multisample");
+        auto numImages = swapChain->imageViewHandles.size();
+
+        if (options.accumulate)
+        {
+            // a new target starts out undefined, the next frame has to clear it
+            accumulation = new RenderTarget(device, swapChain->extent, accumulationFormat, accumulateClearPass->handle, "Accumulation");
+            sampleCount = 0;
+        }
+
+        if (intermediatePass != nullptr)
+            intermediate = new RenderTarget(device, swapChain->extent, intermediateFormat, intermediatePass->handle, "Intermediate");
+
+        if (options.heatmap)
+        {
+            // a cycle count per pixel from the clock, otherwise a time per tile from timestamps
+            if (device->shaderClockSupported)
+            {
+                costImage = new CostImage(device, swapChain->extent);
+            }
+            else
+            {
+                VkExtent2D grid = {(swapChain->extent.width + kHeatmapTileSide - 1) / kHeatmapTileSide,
+                                   (swapChain->extent.height + kHeatmapTileSide - 1) / kHeatmapTileSide};
+                for (uint32_t row = 0; row < grid.height; row++)
+                {
+                    for (uint32_t column = 0; column < grid.width; column++)
+                    {
+                        VkOffset2D offset = {static_cast<int32_t>(column * kHeatmapTileSide), static_cast<int32_t>(row * kHeatmapTileSide)};
+                        heatmapTiles.push_back({offset,
+                                                {std::min(kHeatmapTileSide, swapChain->extent.width - column * kHeatmapTileSide),
+                                                 std::min(kHeatmapTileSide, swapChain->extent.height - row * kHeatmapTileSide)}});
+                    }
+                }
+                costImage = new CostImage(device, grid);
+            }
+            heatmapNextReport = std::chrono::high_resolution_clock::now();
+        }
+
+        if (options.supersample > 1)
+        {
+            VkExtent2D superExtent = {swapChain->extent.width * options.supersample, swapChain->extent.height * options.supersample};
+            supersampled = new RenderTarget(device, superExtent, kSupersampleFormat, supersamplePass->handle, "Supersampled");
+        }
+
+        if (tilePass != nullptr)
+        {
+            // cleared so the resolve shows black, not garbage, where the first frame's tiles have not landed yet
+            tileTarget = new RenderTarget(device, swapChain->extent, kTileTargetFormat, tilePass->handle, "Tiles");
+            tileTarget->Clear(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            tiler = new TileScheduler(swapChain->extent, options.tileBudget);
+        }
+
+        if (options.checkerboard)
+        {
+            // cleared so both targets are readable before the first odd frame has been shaded
+            VkExtent2D halfExtent = {(swapChain->extent.width + 1) / 2, swapChain->extent.height};
+            for (auto &target : checkerTargets)
+            {
+                target = new RenderTarget(device, halfExtent, kCheckerboardFormat, checkerPass->handle, "Checkerboard");
+                target->Clear(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+            checkerFrames = 0;
+        }
+
+        // one cell covering the framebuffer unless this is a gallery
+        std::vector<VkRect2D> cells;
+        if (options.gallery)
+            cells = galleryCells(swapChain->extent, programs.size());
+        else if (supersampled != nullptr)
+            cells.assign(programs.size(), {{0, 0}, supersampled->extent});
+        else
+            cells.assign(programs.size(), {{0, 0}, swapChain->extent});
+
+        for (size_t idx = 0; idx < programs.size(); idx++)
+        {
+            auto &program = programs[idx];
+            program.cell = cells[idx];
+            program.uniform = new Uniform(device->allocator, device->handle, numImages, program.uniformLayout->size);
+            std::map<std::pair<uint32_t, uint32_t>, VkDescriptorImageInfo> boundImages;
+            if (program.costSet != UINT32_MAX)
+                boundImages[{program.costSet, 0}] = {VK_NULL_HANDLE, costImage->view, VK_IMAGE_LAYOUT_GENERAL};
+            program.descriptorSet = new DescriptorSet(device->handle,
+                                                      descriptorCache,
+                                                      program.interfaceLayout,
+                                                      placeholders,
+                                                      program.reflection,
+                                                      program.uniformLayout->set,
+                                                      program.uniformLayout->binding,
+                                                      program.uniform->bufferHandles,
+                                                      boundImages);
+
+            if (options.checkerboard)
+            {
+                VkRect2D halfArea = {{0, 0}, checkerTargets[0]->extent};
+                for (int32_t parity = 0; parity < 2; parity++)
+                    program.parityPipelines[parity] = this->CreatePipeline(program, checkerPass->handle, halfArea, parity, false);
+            }
+            else if (tileTarget != nullptr)
+            {
+                program.pipeline = this->CreatePipeline(program, tilePass->handle, program.cell, -1, false, true);
+            }
+            else if (intermediate != nullptr)
+            {
+                program.pipeline = this->CreatePipeline(program, intermediatePass->handle, program.cell, -1, false, !heatmapTiles.empty());
+            }
+            else if (supersampled != nullptr)
+            {
+                program.pipeline = this->CreatePipeline(program, supersamplePass->handle, program.cell, -1, false);
+            }
+            else
+            {
+                program.pipeline = this->CreatePipeline(program,
+                                                        accumulation != nullptr ? accumulateClearPass->handle : renderPass->handle,
+                                                        program.cell,
+                                                        -1,
+                                                        accumulation != nullptr,
+                                                        false,
+                                                        samples,
+                                                        options.sampleShading);
+            }
+        }
+
+        if (options.checkerboard)
+        {
+            reconstruct.cell = {{0, 0}, swapChain->extent};
+            std::map<std::pair<uint32_t, uint32_t>, VkDescriptorImageInfo> halves;
+            for (uint32_t parity = 0; parity < 2; parity++)
+                halves[{0, parity}] = {VK_NULL_HANDLE, checkerTargets[parity]->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+            reconstruct.descriptorSet = new DescriptorSet(device->handle,
+                                                          descriptorCache,
+                                                          reconstruct.interfaceLayout,
+                                                          placeholders,
+                                                          reconstruct.reflection,
+                                                          UINT32_MAX,
+                                                          UINT32_MAX,
+                                                          std::vector<VkBuffer>(numImages, VK_NULL_HANDLE),
+                                                          halves);
+            reconstruct.pipeline = new Pipeline(device->handle,
+                                                reconstruct.cell,
+                                                renderPass->handle,
+                                                reconstruct.interfaceLayout->pipelineLayout,
+                                                vertexShader,
+                                                reconstruct.spirv);
+        }
+
+        if (heatmap.interfaceLayout != nullptr)
+        {
+            heatmap.cell = {{0, 0}, swapChain->extent};
+            heatmap.descriptorSet = new DescriptorSet(device->handle,
+                                                      descriptorCache,
+                                                      heatmap.interfaceLayout,
+                                                      placeholders,
+                                                      heatmap.reflection,
+                                                      UINT32_MAX,
+                                                      UINT32_MAX,
+                                                      std::vector<VkBuffer>(numImages, VK_NULL_HANDLE),
+                                                      {{{0, 0}, {VK_NULL_HANDLE, intermediate->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}},
+                                                       {{0, 1}, {VK_NULL_HANDLE, costImage->view, VK_IMAGE_LAYOUT_GENERAL}}});
+            heatmap.pipeline = new Pipeline(device->handle,
+                                            heatmap.cell,
+                                            renderPass->handle,
+                                            heatmap.interfaceLayout->pipelineLayout,
+                                            vertexShader,
+                                            heatmap.spirv);
+        }
+        else if (auto resolved = this->ResolvedTarget(); resolved != nullptr)
+        {
+            resolve.cell = {{0, 0}, swapChain->extent};
+            VkDescriptorImageInfo resolvedInfo{VK_NULL_HANDLE, resolved->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+            resolve.descriptorSet = new DescriptorSet(device->handle,
+                                                      descriptorCache,
+                                                      resolve.interfaceLayout,
+                                                      placeholders,
+                                                      resolve.reflection,
+                                                      UINT32_MAX,
+                                                      UINT32_MAX,
+                                                      std::vector<VkBuffer>(numImages, VK_NULL_HANDLE),
+                                                      {{{0, 0}, resolvedInfo}});
+            resolve.pipeline = new Pipeline(device->handle,
+                                            resolve.cell,
+                                            renderPass->handle,
+                                            resolve.interfaceLayout->pipelineLayout,
+                                            vertexShader,
+                                            resolve.spirv);
+        }
+
+        if (overlay.interfaceLayout != nullptr)
+        {
+            const auto &block = overlay.reflection.uniformBlocks[0];
+            overlay.cell = {{0, 0}, swapChain->extent};
+            overlay.uniform = new Uniform(device->allocator, device->handle, numImages, block.size);
+            overlay.descriptorSet = new DescriptorSet(device->handle,
+                                                      descriptorCache,
+                                                      overlay.interfaceLayout,
+                                                      placeholders,
+                                                      overlay.reflection,
+                                                      block.set,
+                                                      block.binding,
+                                                      overlay.uniform->bufferHandles);
+            overlay.pipeline = new Pipeline(device->handle,
+                                            overlay.cell,
+                                            renderPass->handle,
+                                            overlay.interfaceLayout->pipelineLayout,
+                                            overlayVertexShader,
+                                            overlay.spirv,
+                                            nullptr,
+                                            false,
+                                            false,
+                                            samples);
+        }
+
+        if (device->timestampsSupported)
+            gpuTimer = new GpuTimer(device,
+                                    static_cast<uint32_t>(numImages),
+                                    static_cast<uint32_t>(heatmapTiles.empty() ? programs.size() : heatmapTiles.size()));
+
+        framebuffer = new Framebuffer(device->handle,
+                                      swapChain->imageViewHandles,
+                                      swapChain->extent,
+                                      renderPass->handle,
+                                      multisampleImage != nullptr ? multisampleImage->view : VK_NULL_HANDLE);
+        commandRecorder = new CommandRecorder(device, workers, framebuffer->handles.size());
+        frameDraws.clear();
+        offscreenDraws.clear();
+        for (auto &draws : checkerDraws)
+            draws.clear();
+
+        for (size_t idx = 0; idx < framebuffer->handles.size(); idx++)
+        {
+            // every cell, then every cell's overlay, in one render pass
+            std::vector<DrawCall> draws;
+            if (!options.checkerboard)
+                draws = this->CellDraws(idx, -1);
+            if (!heatmapTiles.empty())
+            {
+                // one timed draw per tile, the timer regions follow the tiles; the tiles overlap in the pass, so each time
+                // is what the tile adds once those before it have finished, see RecordDraws
+                DrawCall draw = draws[0];
+                draws.clear();
+                for (size_t tileIdx = 0; tileIdx < heatmapTiles.size(); tileIdx++)
+                {
+                    draws.push_back(draw);
+                    draws.back().scissor = heatmapTiles[tileIdx];
+                    draws.back().timerRegion = static_cast<int>(tileIdx);
+                }
+            }
+            if (overlay.pipeline != nullptr)
+            {
+                for (size_t cellIdx = 0; cellIdx < programs.size(); cellIdx++)
+                {
+                    const auto &cell = programs[cellIdx].cell;
+                    OverlayPushConstants pushConstants{};
+                    pushConstants.box[0] = static_cast<float>(cell.offset.x);
+                    pushConstants.box[1] = static_cast<float>(cell.offset.y);
+                    pushConstants.box[2] = static_cast<float>(std::min(kOverlayWidth, cell.extent.width));
+                    pushConstants.box[3] = static_cast<float>(std::min(kOverlayHeight, cell.extent.height));
+                    pushConstants.extent[0] = static_cast<float>(swapChain->extent.width);
+                    pushConstants.extent[1] = static_cast<float>(swapChain->extent.height);
+                    pushConstants.cell = static_cast<uint32_t>(cellIdx);
+
+                    auto bytes = reinterpret_cast<const uint8_t *>(&pushConstants);
+                    draws.push_back({overlay.pipeline->handle,
+                                     overlay.pipeline->layout,
+                                     overlay.descriptorSet->handles[idx],
+                                     VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                                     std::vector<uint8_t>(bytes, bytes + sizeof(pushConstants)),
+                                     -1});
+                }
+            }
+
+            if (options.checkerboard)
+            {
+                // the half width draws alternate with frame parity, the swapchain pass reconstructs the full frame
+                for (int32_t parity = 0; parity < 2; parity++)
+                    checkerDraws[parity].push_back(this->CellDraws(idx, parity));
+                ReconstructPushConstants pushConstants{0, 0};
+                auto bytes = reinterpret_cast<const uint8_t *>(&pushConstants);
+                draws = {{reconstruct.pipeline->handle,
+                          reconstruct.pipeline->layout,
+                          reconstruct.descriptorSet->handles[idx],
+                          VK_SHADER_STAGE_FRAGMENT_BIT,
+                          std::vector<uint8_t>(bytes, bytes + sizeof(pushConstants)),
+                          -1}};
+            }
+
+            if (heatmap.pipeline != nullptr)
+            {
+                offscreenDraws.push_back(draws);
+                HeatmapPushConstants pushConstants{heatmapLow, heatmapHigh, static_cast<int32_t>(heatmapTiles.empty() ? 1 : kHeatmapTileSide)};
+                auto bytes = reinterpret_cast<const uint8_t *>(&pushConstants);
+                draws = {{heatmap.pipeline->handle,
+                          heatmap.pipeline->layout,
+                          heatmap.descriptorSet->handles[idx],
+                          VK_SHADER_STAGE_FRAGMENT_BIT,
+                          std::vector<uint8_t>(bytes, bytes + sizeof(pushConstants)),
+                          -1}};
+            }
+            else if (this->ResolvedTarget() != nullptr)
+            {
+                // the shader draws into an offscreen target, the swapchain pass only resolves it
+                offscreenDraws.push_back(draws);
+                ResolvePushConstants pushConstants{1.0f, static_cast<int32_t>(options.supersample)};
+                auto bytes = reinterpret_cast<const uint8_t *>(&pushConstants);
+                draws = {{resolve.pipeline->handle,
+                          resolve.pipeline->layout,
+                          resolve.descriptorSet->handles[idx],
+                          VK_SHADER_STAGE_FRAGMENT_BIT,
+                          std::vector<uint8_t>(bytes, bytes + sizeof(pushConstants)),
+                          -1}};
+            }
+
+            frameDraws.push_back(draws);
+        }
+    }
+    // the program's pipeline for one render pass; parity -1 shades every pixel of the area, 0 or 1 one checkerboard half
+    Pipeline *CreatePipeline(const ShaderProgram &program,
+                             VkRenderPass pass,
+                             VkRect2D area,
+                             int32_t parity,
+                             bool additiveBlend,
+                             bool dynamicScissor = false,
+                             VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+                             bool sampleShading = false)
     {
-        throw std::runtime_error("failed to begin recording command buffer!");
+        // constants for the rewritten gl_FragCoord, ignored by modules that do not declare them
+        FragCoordConstants constants{{static_cast<float>(program.cell.offset.x), static_cast<float>(program.cell.offset.y)}, parity};
+        std::array<VkSpecializationMapEntry, 3> mapEntries = {{{kCellOriginConstantId, 0, sizeof(float)},
+                                                               {kCellOriginConstantId + 1, sizeof(float), sizeof(float)},
+                                                               {kParityConstantId, 2 * sizeof(float), sizeof(int32_t)}}};
+        VkSpecializationInfo specialization{};
+        specialization.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+        specialization.pMapEntries = mapEntries.data();
+        specialization.dataSize = sizeof(constants);
+        specialization.pData = &constants;
+
+        return new Pipeline(device->handle,
+                            area,
+                            pass,
+                            program.interfaceLayout->pipelineLayout,
+                            vertexShader,
+                            program.spirv,
+                            &specialization,
+                            additiveBlend,
+                            dynamicScissor,
+                            samples,
+                            sampleShading,
+                            device->pipelineCache,
+                            pipelineLibraries);
     }
+    // one timed draw per program for swapchain image idx
+    std::vector<DrawCall> CellDraws(size_t idx, int32_t parity)
+    {
+        std::vector<DrawCall> draws;
+        for (size_t cellIdx = 0; cellIdx < programs.size(); cellIdx++)
+        {
+            const auto &program = programs[cellIdx];
+            auto pipeline = parity < 0 ? program.pipeline : program.parityPipelines[parity];
+            draws.push_back({pipeline->handle,
+                             pipeline->layout,
+                             program.descriptorSet->handles[idx],
+                             0,
+                             {},
+                             static_cast<int>(cellIdx)});
+        }
+        return draws;
+    }
+    // cpu cost of recording drawCount draws as the worker count grows, nothing is submitted
+    void BenchmarkRecording(uint32_t drawCount)
+    {
+        const int warmup = 10;
+        const int iterations = 100;
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = framebuffer;
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = extent;
-
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-    vkCmdBindDescriptorSets(commandBuffer,
-                            VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            layout,
-                            0,
-                            static_cast<uint32_t>(descriptorSets.size()),
-                            descriptorSets.data(),
-                            0,
-                            nullptr);
+        std::vector<DrawCall> draws;
+        for (uint32_t idx = 0; idx < drawCount; idx++)
+        {
+            draws.push_back(frameDraws[0][idx % frameDraws[0].size()]);
+            draws.back().timerRegion = -1;
+        }
 
-    vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+        std::vector<uint32_t> threadCounts = {1};
+        uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        for (uint32_t threads = 2; threads < maxThreads; threads *= 2)
+            threadCounts.push_back(threads);
+        if (maxThreads > 1)
+            threadCounts.push_back(maxThreads);
 
-    vkCmdEndRenderPass(commandBuffer);
+        std::cout << "[RECORD] " << drawCount << " draws, " << iterations << " recordings per thread count" << std::endl;
+        double baseline = 0.0;
+        for (auto threads : threadCounts)
+        {
+            WorkerPool pool(threads);
+            CommandRecorder recorder(device, &pool, 1);
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to record command buffer!");
+            std::vector<double> samples;
+            for (int iteration = 0; iteration < warmup + iterations; iteration++)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                recorder.Record(0, renderPass->handle, framebuffer->handles[0], swapChain->extent, draws, nullptr);
+                auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+                if (iteration >= warmup)
+                    samples.push_back(elapsed);
+            }
+            std::sort(samples.begin(), samples.end());
+            double median = samples[samples.size() / 2];
+            if (threads == 1)
+                baseline = median;
+
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(1)
+               << "[RECORD] threads " << std::setw(3) << threads
+               << "  median " << std::setw(9) << median << " us"
+               << "  min " << std::setw(9) << samples.front() << " us"
+               << "  " << std::setprecision(2) << 1000.0 * median / drawCount << " ns/draw"
+               << "  speedup " << baseline / median << "x";
+            std::cout << ss.str() << std::endl;
+        }
     }
-}
 
-class Application
-{
-public:
-    Application(std::string fragmentShaderSource) : fragmentShaderSource(fragmentShaderSource) {}
-    void Init()
+    /*
+        Renders the same deterministic frames (iTime advancing 1/60 s per frame) twice: at full rate as the golden
+        reference, and checkerboarded then reconstructed. Both land in float targets that are read back and compared.
+    */
+    void EvaluateCheckerboard(uint32_t frameCount)
     {
-        nextSemaphoreIdx = 0;
-        window = new Window();
-
-#ifdef ENABLE_VALIDATION_LAYERS
-        // enable custom debug messenger
-        std::cout << "[DEBUG] validation layers enabled" << std::endl;
-        if (auto err = createDebugMessenger(&window->instance, &debugMessenger); err != VK_SUCCESS)
+        if (gpuTimer == nullptr)
+            throw std::runtime_error("[FATAL] checkerboard evaluation needs timestamp queries, which the queue family does not support");
+
+        auto extent = swapChain->extent;
+        auto &program = programs[0];
+        RenderPass fullPass(device->handle,
+                            kCheckerboardFormat,
+                            VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                            VK_IMAGE_LAYOUT_UNDEFINED,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        // benchmark targets are freed on return, so they stay out of the extent arena that only a resize reclaims
+        RenderTarget golden(device, extent, kCheckerboardFormat, fullPass.handle, "Golden", VK_NULL_HANDLE, AllocationScope::Persistent);
+        RenderTarget reconstructed(device, extent, kCheckerboardFormat, fullPass.handle, "Reconstructed", VK_NULL_HANDLE, AllocationScope::Persistent);
+        Pipeline *fullPipeline = this->CreatePipeline(program, fullPass.handle, program.cell, -1, false);
+        Pipeline reconstructPipeline(device->handle,
+                                     reconstruct.cell,
+                                     fullPass.handle,
+                                     reconstruct.interfaceLayout->pipelineLayout,
+                                     vertexShader,
+                                     reconstruct.spirv);
+
+        // timer regions: full rate, checkerboard half, reconstruction
+        GpuTimer timer(device, 1, 3);
+        CommandRecorder recorder(device, workers, 1);
+        std::vector<DrawCall> fullDraws = {{fullPipeline->handle, fullPipeline->layout, program.descriptorSet->handles[0], 0, {}, 0}};
+        std::array<std::vector<DrawCall>, 2> halfDraws;
+        for (int32_t parity = 0; parity < 2; parity++)
         {
-            throw std::runtime_error("[FATAL] could not create debug messenger with error \'" + std::to_string(err) + "\'");
+            halfDraws[parity] = this->CellDraws(0, parity);
+            halfDraws[parity][0].timerRegion = 1;
         }
-#endif
+        std::vector<DrawCall> reconstructDraws = frameDraws[0];
+        reconstructDraws[0].pipeline = reconstructPipeline.handle;
+        reconstructDraws[0].timerRegion = 2;
 
-        device = new Device(window->instance, window->surface);
-        swapChain = nullptr;
-        renderPass = nullptr;
-        pipeline = nullptr;
-        framebuffer = nullptr;
-        commandBuffer = nullptr;
-        descriptorSet = nullptr;
-        uniform = nullptr;
+        SampleStats fullMilliseconds, halfMilliseconds, reconstructMilliseconds, meanErrors, psnrs;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            frameInputs.resolution = glm::vec3(extent.width, extent.height, 1.0);
+            frameInputs.time = static_cast<float>(frame) / 60.0f;
+            this->SampleDate();
+            frameInputs.timeDelta = 1.0f / 60.0f;
+            frameInputs.frameRate = 60.0f;
+            frameInputs.frame = static_cast<int32_t>(frame);
+            this->UpdateUniforms(0);
+
+            ReconstructPushConstants pushConstants{static_cast<int32_t>(frame & 1), frame > 0 ? 1 : 0};
+            memcpy(reconstructDraws[0].pushConstants.data(), &pushConstants, sizeof(pushConstants));
+            auto half = checkerTargets[pushConstants.parity];
+            std::vector<PassRecording> passes = {{fullPass.handle, golden.framebuffer->handles[0], extent, &fullDraws},
+                                                 {checkerPass->handle, half->framebuffer->handles[0], half->extent, &halfDraws[pushConstants.parity]},
+                                                 {fullPass.handle, reconstructed.framebuffer->handles[0], extent, &reconstructDraws}};
+            auto commandBuffer = recorder.Record(0, passes, &timer);
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &commandBuffer;
+            timeline->Wait(timeline->Submit(submitInfo));
+
+            // the first frame has no history to reconstruct from and pays for pipeline warmup
+            std::vector<double> milliseconds;
+            if (frame == 0 || !timer.Read(0, milliseconds))
+                continue;
+            fullMilliseconds.Add(milliseconds[0]);
+            halfMilliseconds.Add(milliseconds[1]);
+            reconstructMilliseconds.Add(milliseconds[2]);
+
+            // error on displayable values, so overbright pixels do not dominate
+            auto expected = golden.Read(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            auto actual = reconstructed.Read(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            double absolute = 0.0, squared = 0.0;
+            size_t count = 0;
+            for (size_t idx = 0; idx < expected.size(); idx++)
+            {
+                if (idx % 4 == 3)
+                    continue;
+                double difference = std::clamp(actual[idx], 0.0f, 1.0f) - std::clamp(expected[idx], 0.0f, 1.0f);
+                absolute += std::abs(difference);
+                squared += difference * difference;
+                count++;
+            }
+            meanErrors.Add(absolute / count);
+            psnrs.Add(squared > 0.0 ? 10.0 * std::log10(count / squared) : 99.0);
+        }
+        delete fullPipeline;
+        this->ForgetRenderPass(fullPass);
 
-        this->Resize();
+        if (fullMilliseconds.Count() == 0)
+        {
+            std::cout << "[CHECKER] no timed frames, use more than one" << std::endl;
+            return;
+        }
+        double checkerboardMilliseconds = halfMilliseconds.Mean() + reconstructMilliseconds.Mean();
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3)
+           << "[CHECKER] " << fullMilliseconds.Count() << " golden frames at " << extent.width << "x" << extent.height << std::endl
+           << "[CHECKER] full rate     " << std::setw(9) << fullMilliseconds.Mean() << " ms" << std::endl
+           << "[CHECKER] checkerboard  " << std::setw(9) << halfMilliseconds.Mean() << " ms + reconstruct " << reconstructMilliseconds.Mean() << " ms" << std::endl
+           << std::setprecision(2)
+           << "[CHECKER] speedup       " << std::setw(9) << fullMilliseconds.Mean() / checkerboardMilliseconds << "x" << std::endl
+           << "[CHECKER] psnr          " << std::setw(9) << psnrs.Mean() << " dB mean, " << psnrs.Percentile(0.0) << " dB worst" << std::endl
+           << std::setprecision(5)
+           << "[CHECKER] mean abs err  " << std::setw(9) << meanErrors.Mean() << " mean, " << meanErrors.Percentile(1.0) << " worst";
+        std::cout << ss.str() << std::endl;
     }
-    void Run()
+    // megabytes one full screen pass writes into a target with this many bytes per pixel
+    double TargetMegabytes(uint32_t bytesPerPixel)
+    {
+        return static_cast<double>(swapChain->extent.width) * swapChain->extent.height * bytesPerPixel / 1e6;
+    }
+    /*
+        Renders the shader into an intermediate of every supported format and resolves it into an image in the
+        swapchain format, timing both passes. The intermediate is written once by the shader and read once by the
+        resolve, so its bytes per frame are the traffic a multipass pipeline would pay per intermediate.
+    */
+    void BenchmarkFormats(uint32_t frameCount)
     {
-        while (!glfwWindowShouldClose(window->window))
+        if (gpuTimer == nullptr)
+            throw std::runtime_error("[FATAL] format benchmark needs timestamp queries, which the queue family does not support");
+
+        auto extent = swapChain->extent;
+        auto &program = programs[0];
+        auto outputFormat = swapChain->surfaceFormat.format;
+        RenderPass outputPass(device->handle,
+                              outputFormat,
+                              VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                              VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        RenderTarget output(device, extent, outputFormat, outputPass.handle, "FormatOutput", VK_NULL_HANDLE, AllocationScope::Persistent);
+        Pipeline resolvePipeline(device->handle,
+                                 {{0, 0}, extent},
+                                 outputPass.handle,
+                                 resolve.interfaceLayout->pipelineLayout,
+                                 vertexShader,
+                                 resolve.spirv);
+
+        // timer regions: shader into the intermediate, resolve out of it
+        GpuTimer timer(device, 1, 2);
+        CommandRecorder recorder(device, workers, 1);
+        ResolvePushConstants pushConstants{1.0f, 1};
+        auto pushBytes = reinterpret_cast<const uint8_t *>(&pushConstants);
+
+        std::cout << "[FORMAT] " << frameCount << " frames per format at " << extent.width << "x" << extent.height << std::endl;
+        for (const auto &targetFormat : kTargetFormats)
         {
-            int width = 0, height = 0;
-            glfwGetFramebufferSize(window->window, &width, &height);
-            while (width == 0 || height == 0)
+            if (!targetFormatSupported(device->physicalDevice, targetFormat.format))
             {
-                glfwGetFramebufferSize(window->window, &width, &height);
-                glfwWaitEvents();
+                std::cout << "[FORMAT] " << std::left << std::setw(10) << targetFormat.name << std::right << " not supported as a sampled color attachment" << std::endl;
+                continue;
             }
-            glfwPollEvents();
-
-            auto nextImageFence = swapChain->imageFenceHandles[nextSemaphoreIdx];
-            vkWaitForFences(device->handle, 1, &nextImageFence, VK_TRUE, UINT64_MAX);
-
-            auto imageAvailableSemaphore = swapChain->imageAvailableSemaphores[nextSemaphoreIdx];
-            auto renderFinishedSemaphore = swapChain->renderFinishedSemaphores[nextSemaphoreIdx];
-            this->nextSemaphoreIdx = (this->nextSemaphoreIdx++) % swapChain->imageViewHandles.size();
-
-            uint32_t imageIdx;
-            auto status = vkAcquireNextImageKHR(
-                device->handle,
-                swapChain->handle,
-                UINT64_MAX,
-                imageAvailableSemaphore,
-                VK_NULL_HANDLE,
-                &imageIdx);
-
-            /*
-            update uniform
-            */
-            double xpos, ypos;
-            glfwGetCursorPos(window->window, &xpos, &ypos);
-            static auto startTime = std::chrono::high_resolution_clock::now();
-            auto currentTime = std::chrono::high_resolution_clock::now();
-            ubo.time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-            ubo.mouse = glm::vec4(xpos, ypos, 0.0, 0.0);
-            ubo.resolution = glm::vec3(width, height, 0.0);
-            uniform->Update(reinterpret_cast<void *>(&ubo), imageIdx);
+            RenderPass pass(device->handle,
+                            targetFormat.format,
+                            VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                            VK_IMAGE_LAYOUT_UNDEFINED,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            RenderTarget target(device, extent, targetFormat.format, pass.handle, "Format", VK_NULL_HANDLE, AllocationScope::Persistent);
+            Pipeline *pipeline = this->CreatePipeline(program, pass.handle, program.cell, -1, false);
+            DescriptorSet resolveSet(device->handle,
+                                     descriptorCache,
+                                     resolve.interfaceLayout,
+                                     placeholders,
+                                     resolve.reflection,
+                                     UINT32_MAX,
+                                     UINT32_MAX,
+                                     {VK_NULL_HANDLE},
+                                     {{{0, 0}, {VK_NULL_HANDLE, target.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}}});
+            std::vector<DrawCall> shaderDraws = {{pipeline->handle, pipeline->layout, program.descriptorSet->handles[0], 0, {}, 0}};
+            std::vector<DrawCall> resolveDraws = {{resolvePipeline.handle,
+                                                   resolvePipeline.layout,
+                                                   resolveSet.handles[0],
+                                                   VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                   std::vector<uint8_t>(pushBytes, pushBytes + sizeof(pushConstants)),
+                                                   1}};
+
+            SampleStats shaderMilliseconds, resolveMilliseconds;
+            for (uint32_t frame = 0; frame <= frameCount; frame++)
+            {
+                frameInputs.resolution = glm::vec3(extent.width, extent.height, 1.0);
+                frameInputs.time = static_cast<float>(frame) / 60.0f;
+                this->SampleDate();
+                frameInputs.timeDelta = 1.0f / 60.0f;
+                frameInputs.frameRate = 60.0f;
+                frameInputs.frame = static_cast<int32_t>(frame);
+                this->UpdateUniforms(0);
+
+                std::vector<PassRecording> passes = {{pass.handle, target.framebuffer->handles[0], extent, &shaderDraws},
+                                                     {outputPass.handle, output.framebuffer->handles[0], extent, &resolveDraws}};
+                auto commandBuffer = recorder.Record(0, passes, &timer);
+                VkSubmitInfo submitInfo{};
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &commandBuffer;
+                timeline->Wait(timeline->Submit(submitInfo));
+
+                // the first frame pays for pipeline warmup
+                std::vector<double> milliseconds;
+                if (frame == 0 || !timer.Read(0, milliseconds))
+                    continue;
+                shaderMilliseconds.Add(milliseconds[0]);
+                resolveMilliseconds.Add(milliseconds[1]);
+            }
+            delete pipeline;
+            this->ForgetRenderPass(pass);
+
+            double megabytes = TargetMegabytes(targetFormat.bytesPerPixel);
+            double shader = shaderMilliseconds.Percentile(0.5), resolved = resolveMilliseconds.Percentile(0.5);
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(3)
+               << "[FORMAT] " << std::left << std::setw(10) << targetFormat.name << std::right
+               << std::setw(3) << targetFormat.bytesPerPixel << " B/px " << std::setprecision(2) << std::setw(8) << megabytes << " MB/frame"
+               << std::setprecision(3)
+               << "  shader " << std::setw(8) << shader << " ms"
+               << "  resolve " << std::setw(8) << resolved << " ms"
+               << "  total " << std::setw(8) << shader + resolved << " ms"
+               << std::setprecision(1) << "  resolve read " << (resolved > 0.0 ? megabytes / resolved : 0.0) << " GB/s";
+            std::cout << ss.str() << std::endl;
+        }
+    }
+    /*
+        Renders the shader into an image in the swapchain format without anti-aliasing, with every supported MSAA
+        count with and without sample shading, and supersampled on 2x2 and 3x3 grids. Timer region 0 covers the
+        shading pass including its multisample resolve, region 1 the supersampling box filter.
+    */
+    void BenchmarkAntialiasing(uint32_t frameCount)
+    {
+        if (gpuTimer == nullptr)
+            throw std::runtime_error("[FATAL] anti-aliasing benchmark needs timestamp queries, which the queue family does not support");
 
-            bool mustResize = (status == VK_ERROR_OUT_OF_DATE_KHR || status == VK_SUBOPTIMAL_KHR);
-            if (mustResize)
+        struct Mode
+        {
+            std::string name;
+            uint32_t samples;
+            bool sampleShading;
+            uint32_t factor;
+        };
+        std::vector<Mode> modes = {{"none", 1, false, 1}};
+        for (uint32_t samples : {2u, 4u, 8u})
+        {
+            if (!sampleCountSupported(device, samples))
             {
-                this->Resize();
+                std::cout << "[AA] msaa " << samples << "x not supported" << std::endl;
+                continue;
+            }
+            modes.push_back({"msaa " + std::to_string(samples) + "x", samples, false, 1});
+            modes.push_back({"msaa " + std::to_string(samples) + "x per sample", samples, true, 1});
+        }
+        modes.push_back({"ssaa 2x2", 1, false, 2});
+        modes.push_back({"ssaa 3x3", 1, false, 3});
+
+        auto extent = swapChain->extent;
+        auto &program = programs[0];
+        auto fullCell = program.cell;
+        auto outputFormat = swapChain->surfaceFormat.format;
+        RenderPass outputPass(device->handle,
+                              outputFormat,
+                              VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                              VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        RenderTarget output(device, extent, outputFormat, outputPass.handle, "AaOutput", VK_NULL_HANDLE, AllocationScope::Persistent);
+        Pipeline resolvePipeline(device->handle,
+                                 {{0, 0}, extent},
+                                 outputPass.handle,
+                                 resolve.interfaceLayout->pipelineLayout,
+                                 vertexShader,
+                                 resolve.spirv);
+
+        GpuTimer timer(device, 1, 2);
+        CommandRecorder recorder(device, workers, 1);
+
+        std::cout << "[AA] " << frameCount << " frames per mode at " << extent.width << "x" << extent.height << std::endl;
+        double baseline = 0.0;
+        for (const auto &mode : modes)
+        {
+            // the shader sees the supersampled target as its framebuffer
+            auto samples = static_cast<VkSampleCountFlagBits>(mode.samples);
+            VkExtent2D shadedExtent = {extent.width * mode.factor, extent.height * mode.factor};
+            program.cell = {{0, 0}, shadedExtent};
+
+            RenderPass *pass = nullptr;
+            RenderTarget *target = nullptr;
+            MultisampleImage *multisample = nullptr;
+            Framebuffer *multisampleFramebuffer = nullptr;
+            DescriptorSet *resolveSet = nullptr;
+            VkFramebuffer shadedFramebuffer;
+            if (mode.factor > 1)
+            {
+                target = new RenderTarget(device, shadedExtent, kSupersampleFormat, supersamplePass->handle, "AaSupersampled", VK_NULL_HANDLE, AllocationScope::Persistent);
+                resolveSet = new DescriptorSet(device->handle,
+                                               descriptorCache,
+                                               resolve.interfaceLayout,
+                                               placeholders,
+                                               resolve.reflection,
+                                               UINT32_MAX,
+                                               UINT32_MAX,
+                                               {VK_NULL_HANDLE},
+                                               {{{0, 0}, {VK_NULL_HANDLE, target->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}}});
+                shadedFramebuffer = target->framebuffer->handles[0];
+            }
+            else if (samples != VK_SAMPLE_COUNT_1_BIT)
+            {
+                pass = new RenderPass(device->handle,
+                                      outputFormat,
+                                      VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                      samples);
+                multisample = new MultisampleImage(device, extent, outputFormat, samples, "AaMultisample", AllocationScope::Persistent);
+                multisampleFramebuffer = new Framebuffer(device->handle, {output.view}, extent, pass->handle, multisample->view);
+                shadedFramebuffer = multisampleFramebuffer->handles[0];
             }
             else
             {
-                std::vector<VkCommandBuffer> commandBuffers;
-                commandBuffers.push_back(commandBuffer->handles[imageIdx]);
+                shadedFramebuffer = output.framebuffer->handles[0];
+            }
+            VkRenderPass shadedPass = mode.factor > 1 ? supersamplePass->handle : (pass != nullptr ? pass->handle : outputPass.handle);
+            Pipeline *pipeline = this->CreatePipeline(program, shadedPass, program.cell, -1, false, false, samples, mode.sampleShading);
 
+            std::vector<DrawCall> shaderDraws = {{pipeline->handle, pipeline->layout, program.descriptorSet->handles[0], 0, {}, 0}};
+            std::vector<DrawCall> resolveDraws;
+            if (resolveSet != nullptr)
+            {
+                ResolvePushConstants pushConstants{1.0f, static_cast<int32_t>(mode.factor)};
+                auto bytes = reinterpret_cast<const uint8_t *>(&pushConstants);
+                resolveDraws = {{resolvePipeline.handle,
+                                 resolvePipeline.layout,
+                                 resolveSet->handles[0],
+                                 VK_SHADER_STAGE_FRAGMENT_BIT,
+                                 std::vector<uint8_t>(bytes, bytes + sizeof(pushConstants)),
+                                 1}};
+            }
+
+            SampleStats shaderMilliseconds, resolveMilliseconds;
+            for (uint32_t frame = 0; frame <= frameCount; frame++)
+            {
+                frameInputs.time = static_cast<float>(frame) / 60.0f;
+                this->SampleDate();
+                frameInputs.timeDelta = 1.0f / 60.0f;
+                frameInputs.frameRate = 60.0f;
+                frameInputs.frame = static_cast<int32_t>(frame);
+                this->UpdateUniforms(0);
+
+                std::vector<PassRecording> passes = {{shadedPass, shadedFramebuffer, shadedExtent, &shaderDraws}};
+                if (resolveSet != nullptr)
+                    passes.push_back({outputPass.handle, output.framebuffer->handles[0], extent, &resolveDraws});
+                auto commandBuffer = recorder.Record(0, passes, &timer);
                 VkSubmitInfo submitInfo{};
                 submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &commandBuffer;
+                timeline->Wait(timeline->Submit(submitInfo));
+
+                // the first frame pays for pipeline warmup
+                std::vector<double> milliseconds;
+                if (frame == 0 || !timer.Read(0, milliseconds))
+                    continue;
+                shaderMilliseconds.Add(milliseconds[0]);
+                if (resolveSet != nullptr)
+                    resolveMilliseconds.Add(milliseconds[1]);
+            }
+            delete pipeline;
+            if (resolveSet != nullptr)
+                delete resolveSet;
+            if (multisampleFramebuffer != nullptr)
+                delete multisampleFramebuffer;
+            if (multisample != nullptr)
+                delete multisample;
+            if (target != nullptr)
+                delete target;
+            if (pass != nullptr)
+            {
+                this->ForgetRenderPass(*pass);
+                delete pass;
+            }
 
-                // @@@ imageAvailableSemaphores should belong to swapchain?
-                VkSemaphore submitWaitSemaphores[] = {imageAvailableSemaphore};
-                VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-                submitInfo.waitSemaphoreCount = 1;
-                submitInfo.pWaitSemaphores = submitWaitSemaphores;
-                submitInfo.pWaitDstStageMask = waitStages;
-                submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
-                submitInfo.pCommandBuffers = commandBuffers.data();
+            double shader = shaderMilliseconds.Percentile(0.5);
+            double downsample = resolveMilliseconds.Count() > 0 ? resolveMilliseconds.Percentile(0.5) : 0.0;
+            double total = shader + downsample;
+            if (mode.samples == 1 && mode.factor == 1)
+                baseline = total;
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(3)
+               << "[AA] " << std::left << std::setw(22) << mode.name << std::right
+               << "  shader " << std::setw(8) << shader << " ms"
+               << "  downsample " << std::setw(8) << downsample << " ms"
+               << "  total " << std::setw(8) << total << " ms"
+               << std::setprecision(2) << "  x" << (baseline > 0.0 ? total / baseline : 0.0);
+            std::cout << ss.str() << std::endl;
+        }
+        program.cell = fullCell;
+        this->ForgetRenderPass(outputPass);
+    }
+    // median gpu milliseconds of the fragment shader over frameCount offscreen frames after one warmup frame, negative if untimed
+    double TimeOffscreen(const std::vector<uint32_t> &spirv, RenderPass &pass, RenderTarget &target, uint32_t frameCount, GpuTimer &timer, CommandRecorder &recorder)
+    {
+        ShaderProgram program{};
+        program.spirv = spirv;
+        program.reflection = reflectSpirv(spirv);
+        program.uniformLayout = new UniformLayout(program.reflection);
+        ShaderInterface shaderInterface;
+        shaderInterface.Add(program.reflection, VK_SHADER_STAGE_FRAGMENT_BIT);
+        program.interfaceLayout = descriptorCache->Get(shaderInterface);
+        program.cell = {{0, 0}, target.extent};
+        program.uniform = new Uniform(device->allocator, device->handle, 1, program.uniformLayout->size, AllocationScope::Persistent); // one per site
+        program.descriptorSet = new DescriptorSet(device->handle,
+                                                  descriptorCache,
+                                                  program.interfaceLayout,
+                                                  placeholders,
+                                                  program.reflection,
+                                                  program.uniformLayout->set,
+                                                  program.uniformLayout->binding,
+                                                  program.uniform->bufferHandles);
+        program.pipeline = this->CreatePipeline(program, pass.handle, program.cell, -1, false);
+
+        std::vector<DrawCall> draws = {{program.pipeline->handle, program.pipeline->layout, program.descriptorSet->handles[0], 0, {}, 0}};
+        SampleStats milliseconds;
+        for (uint32_t frame = 0; frame <= frameCount; frame++)
+        {
+            FrameInputs inputs = frameInputs;
+            inputs.resolution = glm::vec3(target.extent.width, target.extent.height, 1.0);
+            inputs.time = static_cast<float>(frame) / 60.0f;
+            inputs.timeDelta = 1.0f / 60.0f;
+            inputs.frameRate = 60.0f;
+            inputs.frame = static_cast<int32_t>(frame);
+            program.uniform->Update(*program.uniformLayout, inputs, 0);
+
+            std::vector<PassRecording> passes = {{pass.handle, target.framebuffer->handles[0], target.extent, &draws}};
+            auto commandBuffer = recorder.Record(0, passes, &timer);
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &commandBuffer;
+            timeline->Wait(timeline->Submit(submitInfo));
+
+            std::vector<double> regions;
+            if (frame > 0 && timer.Read(0, regions))
+                milliseconds.Add(regions[0]);
+        }
 
-                VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-                submitInfo.signalSemaphoreCount = 1;
-                submitInfo.pSignalSemaphores = signalSemaphores;
+        this->CleanupProgramExtent(program);
+        delete program.uniformLayout;
+        return milliseconds.Count() > 0 ? milliseconds.Percentile(0.5) : -1.0;
+    }
+    /*
+        Times the shader as is, then with each function and outermost loop found by findAblationSites stubbed out,
+        offscreen at the swapchain extent. The baseline is timed again at the end and the two runs averaged, so slow
+        drift over the session is charged to no site in particular.
+    */
+    void Ablate(uint32_t frameCount)
+    {
+        if (gpuTimer == nullptr)
+            throw std::runtime_error("[FATAL] ablation needs timestamp queries, which the queue family does not support");
+
+        const auto &source = shaderSources[0].source;
+        auto sites = findAblationSites(source);
+        auto extent = swapChain->extent;
+        auto format = swapChain->surfaceFormat.format;
+        RenderPass pass(device->handle, format, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        RenderTarget target(device, extent, format, pass.handle, "Ablation", VK_NULL_HANDLE, AllocationScope::Persistent);
+        GpuTimer timer(device, 1, 1);
+        CommandRecorder recorder(device, workers, 1);
+
+        std::cout << "[ABLATE] " << sites.size() << " functions and loops in '" << shaderSources[0].path << "', "
+                  << frameCount << " frames each at " << extent.width << "x" << extent.height << std::endl;
+        // compiled the way the variants are, without any rewrite the render mode would apply
+        auto full = compileSpriv(source);
+        double before = this->TimeOffscreen(full, pass, target, frameCount, timer, recorder);
+
+        struct Result
+        {
+            const AblationSite *site;
+            double milliseconds;
+        };
+        std::vector<Result> results;
+        for (const auto &site : sites)
+        {
+            std::vector<uint32_t> spirv;
+            try
+            {
+                spirv = compileSpriv(ablate(source, site));
+            }
+            catch (const std::runtime_error &)
+            {
+                std::cout << "[ABLATE] " << site.name << " line " << site.line << " cannot be stubbed with '" << site.stub << "', skipped" << std::endl;
+                continue;
+            }
+            results.push_back({&site, this->TimeOffscreen(spirv, pass, target, frameCount, timer, recorder)});
+        }
 
-                // "it's best to call vkResetFences right before using the fence"
-                vkResetFences(device->handle, 1, &nextImageFence);
-                if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo, nextImageFence) != VK_SUCCESS)
-                    throw std::runtime_error("failed to submit draw command buffer!");
+        double after = this->TimeOffscreen(full, pass, target, frameCount, timer, recorder);
+        this->ForgetRenderPass(pass);
+        double baseline = 0.5 * (before + after);
+        std::sort(results.begin(), results.end(), [](const Result &a, const Result &b)
+                  { return a.milliseconds < b.milliseconds; });
 
-                VkPresentInfoKHR presentInfo{};
-                presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-                presentInfo.waitSemaphoreCount = 1;
-                VkSemaphore presentWaitSemaphores[] = {renderFinishedSemaphore};
-                presentInfo.pWaitSemaphores = presentWaitSemaphores;
+        std::cout << std::fixed << std::setprecision(3)
+                  << "[ABLATE] full shader " << baseline << " ms (" << before << " before, " << after << " after)" << std::endl
+                  << "[ABLATE] rank  site                                  line  stubbed ms  saved ms   share" << std::endl;
+        for (size_t rank = 0; rank < std::min(results.size(), kAblationTableRows); rank++)
+        {
+            const auto &result = results[rank];
+            double saved = baseline - result.milliseconds;
+            std::cout << "[ABLATE] " << std::setw(4) << rank + 1 << "  " << std::left << std::setw(36) << result.site->name << std::right
+                      << std::setw(6) << result.site->line
+                      << std::setw(12) << result.milliseconds
+                      << std::setw(10) << saved
+                      << std::setprecision(1) << std::setw(7) << (baseline > 0.0 ? 100.0 * saved / baseline : 0.0) << "%"
+                      << std::setprecision(3) << std::endl;
+        }
+        if (results.size() > kAblationTableRows)
+            std::cout << "[ABLATE] " << results.size() - kAblationTableRows << " cheaper sites not shown" << std::endl;
+    }
+    // one frame of programs[programIdx] with deterministic inputs; gpu milliseconds, negative if the frame was lost to a resize
+    double CompareFrame(size_t programIdx, int32_t frame, RenderPass *offscreenPass, RenderTarget *offscreen, GpuTimer &timer, CommandRecorder &recorder)
+    {
+        window->PollEvents();
+        auto extent = offscreen != nullptr ? offscreen->extent : swapChain->extent;
+        frameInputs.resolution = glm::vec3(extent.width, extent.height, 1.0);
+        frameInputs.time = static_cast<float>(frame) / 60.0f;
+        this->SampleDate();
+        frameInputs.timeDelta = 1.0f / 60.0f;
+        frameInputs.frameRate = 60.0f;
+        frameInputs.frame = frame;
+
+        // every frame waits for the last, so one acquire semaphore is always free again
+        uint32_t imageIdx = 0;
+        VkSemaphore imageAvailableSemaphore = swapChain->imageAvailableSemaphores[0];
+        if (offscreen == nullptr)
+        {
+            auto status = vkAcquireNextImageKHR(device->handle, swapChain->handle, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIdx);
+            if (status == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                this->Resize();
+                return -1.0;
+            }
+            if (status != VK_SUCCESS && status != VK_SUBOPTIMAL_KHR)
+                throw std::runtime_error("failed to acquire swap chain image!");
+        }
+        this->UpdateUniforms(imageIdx);
+
+        const auto &program = programs[programIdx];
+        std::vector<DrawCall> draws = {{program.pipeline->handle, program.pipeline->layout, program.descriptorSet->handles[imageIdx], 0, {}, 0}};
+        auto commandBuffer = offscreen != nullptr
+                                 ? recorder.Record(0, offscreenPass->handle, offscreen->framebuffer->handles[0], extent, draws, &timer)
+                                 : recorder.Record(0, renderPass->handle, framebuffer->handles[imageIdx], extent, draws, &timer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        VkSemaphore renderFinishedSemaphore = swapChain->renderFinishedSemaphores[imageIdx];
+        if (offscreen == nullptr)
+        {
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
+            submitInfo.pWaitDstStageMask = &waitStage;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &renderFinishedSemaphore;
+        }
+        timeline->Wait(timeline->Submit(submitInfo));
+
+        std::vector<double> milliseconds;
+        double result = timer.Read(0, milliseconds) ? milliseconds[0] : -1.0;
+        if (offscreen != nullptr)
+            return result;
+
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &renderFinishedSemaphore;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &swapChain->handle;
+        presentInfo.pImageIndices = &imageIdx;
+        auto presentStatus = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+        if (presentStatus == VK_ERROR_OUT_OF_DATE_KHR || presentStatus == VK_SUBOPTIMAL_KHR)
+            this->Resize();
+        else if (presentStatus != VK_SUCCESS)
+            throw std::runtime_error("failed to present command buffer!");
+        return result;
+    }
+    /*
+        A/B timing of programs[0] against programs[1] in one device session. Blocks of frames alternate ABBA so drift in
+        clocks and temperature lands on both sides; the first pairs warm up and are dropped, and so is the first frame of
+        every block, which pays for the pipeline switch. Frames outside the Tukey fences of their program are rejected,
+        each block is reduced to its median, and the paired relative differences of adjacent blocks are bootstrapped.
+    */
+    void Compare()
+    {
+        if (gpuTimer == nullptr)
+            throw std::runtime_error("[FATAL] compare needs timestamp queries, which the queue family does not support");
 
-                VkSwapchainKHR swapChains[] = {swapChain->handle};
-                presentInfo.swapchainCount = 1;
-                presentInfo.pSwapchains = swapChains;
-                presentInfo.pImageIndices = &imageIdx;
-                presentInfo.pResults = nullptr; // Optional
+        RenderPass *offscreenPass = nullptr;
+        RenderTarget *offscreen = nullptr;
+        if (options.compareOffscreen)
+        {
+            // same format and, with --msaa and --ssaa excluded, the same single sample as the swapchain pass,
+            // so the programs' pipelines run in it unchanged
+            offscreenPass = new RenderPass(device->handle,
+                                           swapChain->surfaceFormat.format,
+                                           VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                           VK_IMAGE_LAYOUT_UNDEFINED,
+                                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            offscreen = new RenderTarget(device, swapChain->extent, swapChain->surfaceFormat.format, offscreenPass->handle, "Compare");
+        }
+        GpuTimer timer(device, 1, 1);
+        CommandRecorder recorder(device, workers, 1);
+
+        uint32_t pairs = kCompareWarmupPairs + options.compareBlocks;
+        uint32_t blockFrames = options.compareBlockFrames;
+        // [program][pair] the timed frames of that block
+        std::array<std::vector<std::vector<double>>, 2> samples;
+        samples.fill(std::vector<std::vector<double>>(pairs));
+        std::cout << "[COMPARE] " << options.compareBlocks << " block pairs of " << blockFrames << " frames, "
+                  << (offscreen != nullptr ? "offscreen" : "presented") << ", A '" << programs[0].path << "' B '" << programs[1].path << "'" << std::endl;
+        for (uint32_t pair = 0; pair < pairs && !window->ShouldClose(); pair++)
+        {
+            for (uint32_t slot = 0; slot < 2; slot++)
+            {
+                size_t programIdx = (pair % 2 == 0) ? slot : 1 - slot;
+                for (uint32_t frame = 0; frame < blockFrames; frame++)
+                {
+                    // both sides shade the same sequence of inputs
+                    auto milliseconds = this->CompareFrame(programIdx, static_cast<int32_t>(pair * blockFrames + frame), offscreenPass, offscreen, timer, recorder);
+                    if (frame > 0 && milliseconds >= 0.0)
+                        samples[programIdx][pair].push_back(milliseconds);
+                }
+            }
+        }
+        vkDeviceWaitIdle(device->handle);
+        if (offscreen != nullptr)
+            delete offscreen;
+        if (offscreenPass != nullptr)
+        {
+            this->ForgetRenderPass(*offscreenPass);
+            delete offscreenPass;
+        }
 
-                if (vkQueuePresentKHR(device->presentQueue, &presentInfo) != VK_SUCCESS)
-                    throw std::runtime_error("failed to present command buffer!");
+        // Tukey fences over every timed frame of a program
+        std::array<std::pair<double, double>, 2> fences;
+        size_t rejected = 0;
+        for (size_t programIdx = 0; programIdx < 2; programIdx++)
+        {
+            SampleStats all;
+            for (uint32_t pair = kCompareWarmupPairs; pair < pairs; pair++)
+                for (auto value : samples[programIdx][pair])
+                    all.Add(value);
+            double q1 = all.Percentile(0.25), q3 = all.Percentile(0.75);
+            fences[programIdx] = {q1 - 1.5 * (q3 - q1), q3 + 1.5 * (q3 - q1)};
+        }
+
+        SampleStats medians[2];
+        SampleStats relativeDifferences; // (B - A) / A per pair
+        for (uint32_t pair = kCompareWarmupPairs; pair < pairs; pair++)
+        {
+            SampleStats block[2];
+            for (size_t programIdx = 0; programIdx < 2; programIdx++)
+            {
+                for (auto value : samples[programIdx][pair])
+                {
+                    if (value < fences[programIdx].first || value > fences[programIdx].second)
+                        rejected++;
+                    else
+                        block[programIdx].Add(value);
+                }
             }
+            if (block[0].Count() == 0 || block[1].Count() == 0)
+                continue;
+            double a = block[0].Percentile(0.5), b = block[1].Percentile(0.5);
+            medians[0].Add(a);
+            medians[1].Add(b);
+            if (a > 0.0)
+                relativeDifferences.Add((b - a) / a);
+        }
+        if (relativeDifferences.Count() < 2)
+        {
+            std::cout << "[COMPARE] too few timed blocks for a verdict, run more --blocks" << std::endl;
+            return;
         }
 
-        vkDeviceWaitIdle(device->handle); // drain queues after exiting event loop
+        // percentile bootstrap of the median paired difference, seeded so reruns on the same data agree
+        std::mt19937 random(kCompareBootstrapSeed);
+        std::uniform_int_distribution<size_t> pick(0, relativeDifferences.Count() - 1);
+        SampleStats bootstrap;
+        for (uint32_t resample = 0; resample < kCompareBootstrapResamples; resample++)
+        {
+            SampleStats drawn;
+            for (size_t idx = 0; idx < relativeDifferences.Count(); idx++)
+                drawn.Add(relativeDifferences.values[pick(random)]);
+            bootstrap.Add(drawn.Percentile(0.5));
+        }
+        double difference = relativeDifferences.Percentile(0.5);
+        double low = bootstrap.Percentile(0.025), high = bootstrap.Percentile(0.975);
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(4)
+           << "[COMPARE] A median " << std::setw(9) << medians[0].Percentile(0.5) << " ms  " << programs[0].path << std::endl
+           << "[COMPARE] B median " << std::setw(9) << medians[1].Percentile(0.5) << " ms  " << programs[1].path << std::endl
+           << std::setprecision(2)
+           << "[COMPARE] " << relativeDifferences.Count() << " block pairs, " << rejected << " outlier frames rejected" << std::endl
+           << "[COMPARE] B - A " << std::showpos << 100.0 * difference << "% (95% CI " << 100.0 * low << "% to " << 100.0 * high << "%)" << std::noshowpos << std::endl
+           << "[COMPARE] ";
+        if (high < 0.0)
+            ss << "B is faster";
+        else if (low > 0.0)
+            ss << "B is slower";
+        else
+            ss << "no significant difference";
+        std::cout << ss.str() << std::endl;
     }
-    void Resize()
+    // --windows: the application's window shows the first program, every further program gets a window on the same instance
+    void OpenWindows()
     {
-        this->CleanupExtent();
-        int width, height;
-        glfwGetFramebufferSize(window->window, &width, &height);
-        swapChain = new SwapChain(window->surface, device->physicalDevice, device->handle, width, height);
-        renderPass = new RenderPass(device->handle, swapChain->surfaceFormat.format);
-
-        uniform = new Uniform(device->physicalDevice, device->handle, swapChain->imageViewHandles.size());
-        descriptorSet = new DescriptorSet(device->handle, swapChain->imageViewHandles.size(), uniform->bufferHandles);
-
-        pipeline = new Pipeline(device->handle, swapChain->extent, renderPass->handle, descriptorSet->layout, fragmentShaderSource);
-        framebuffer = new Framebuffer(device->handle, swapChain->imageViewHandles, swapChain->extent, renderPass->handle);
-        commandBuffer = new CommandBuffer(device->handle, device->commandPoolHandle, framebuffer->handles);
+        for (size_t idx = 0; idx < programs.size(); idx++)
+        {
+            WindowView view{};
+            view.window = idx == 0 ? window : new Window(window, programs[idx].path);
+            views.push_back(view);
+            if (!surfaceSupported(device, view.window->surface))
+                throw std::runtime_error("[FATAL] the selected queue family cannot present to the window of \'" + programs[idx].path + "\'");
+            glfwSetWindowTitle(view.window->window, programs[idx].path.c_str());
+            glfwSetWindowUserPointer(view.window->window, this);
+            glfwSetMouseButtonCallback(view.window->window, Application::MouseButtonCallback);
+            placeWindow(view.window->window, idx);
+        }
+        std::cout << "[INFO] " << views.size() << " windows on one device" << std::endl;
+        this->ResizeWindows();
+    }
+    /*
+        Rebuilds the swap chain of every stale window and the extent resources of all of them, which share the extent
+        arena. Other windows keep their swap chains; their pipelines come back out of the pipeline cache.
+    */
+    void ResizeWindows()
+    {
+        vkDeviceWaitIdle(device->handle);
+        for (size_t idx = 0; idx < views.size(); idx++)
+        {
+            auto &view = views[idx];
+            this->CleanupViewExtent(view);
+            this->CleanupProgramExtent(programs[idx]);
+        }
+        device->allocator->ResetExtent();
 
-        for (size_t idx = 0; idx < framebuffer->handles.size(); idx++)
+        for (size_t idx = 0; idx < views.size(); idx++)
+        {
+            auto &view = views[idx];
+            auto &program = programs[idx];
+            int width, height;
+            view.window->FramebufferSize(width, height);
+            if (view.stale || width == 0 || height == 0)
+            {
+                auto retired = view.swapChain;
+                view.swapChain = nullptr;
+                if (width > 0 && height > 0)
+                    view.swapChain = new SwapChain(view.window->surface,
+                                                   device->physicalDevice,
+                                                   device->handle,
+                                                   width,
+                                                   height,
+                                                   options.presentMode,
+                                                   retired != nullptr ? retired->handle : VK_NULL_HANDLE);
+                if (retired != nullptr)
+                    timeline->Defer([retired]()
+                                    { delete retired; });
+            }
+            else if (view.swapChain == nullptr)
+            {
+                view.swapChain = new SwapChain(view.window->surface, device->physicalDevice, device->handle, width, height, options.presentMode);
+            }
+            view.stale = false;
+            if (view.swapChain == nullptr)
+                continue;
+
+            auto extent = view.swapChain->extent;
+            auto numImages = view.swapChain->imageViewHandles.size();
+            view.imageFrames.assign(numImages, timeline->submitted);
+            view.renderPass = new RenderPass(device->handle,
+                                             view.swapChain->surfaceFormat.format,
+                                             VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                             VK_IMAGE_LAYOUT_UNDEFINED,
+                                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            view.framebuffer = new Framebuffer(device->handle, view.swapChain->imageViewHandles, extent, view.renderPass->handle);
+            view.recorder = new CommandRecorder(device, workers, numImages);
+
+            program.cell = {{0, 0}, extent};
+            program.uniform = new Uniform(device->allocator, device->handle, numImages, program.uniformLayout->size);
+            program.descriptorSet = new DescriptorSet(device->handle,
+                                                      descriptorCache,
+                                                      program.interfaceLayout,
+                                                      placeholders,
+                                                      program.reflection,
+                                                      program.uniformLayout->set,
+                                                      program.uniformLayout->binding,
+                                                      program.uniform->bufferHandles);
+            program.pipeline = this->CreatePipeline(program, view.renderPass->handle, program.cell, -1, false);
+        }
+    }
+    // a window that changed size or went in or out of being minimized needs new extent resources
+    bool WindowsChanged()
+    {
+        for (auto &view : views)
+        {
+            int width, height;
+            view.window->FramebufferSize(width, height);
+            bool minimized = width == 0 || height == 0;
+            if (view.stale || minimized != (view.swapChain == nullptr))
+                return true;
+        }
+        return false;
+    }
+    /*
+        Every window acquires, the frame's command buffers go to the queue in one submit waiting on all acquires, and
+        one present hands every swap chain its image. A window that is minimized or out of date sits the frame out.
+        Closing any window ends the run.
+    */
+    void RunWindows()
+    {
+        uint64_t frames = 0;
+        SampleStats frameMilliseconds;
+        bool closed = false;
+        while (!closed)
         {
-            std::vector<VkDescriptorSet> descriptorSets = {
-                descriptorSet->handles[idx],
-            };
+            glfwPollEvents();
+            for (auto &view : views)
+                closed = closed || view.window->ShouldClose();
+            if (closed)
+                break;
+            if (this->WindowsChanged())
+                this->ResizeWindows();
+
+            // as in Run, acquire semaphores come back around after the smallest swapchain's image count
+            auto frameStart = std::chrono::high_resolution_clock::now();
+            uint64_t depth = timeline->framesInFlight;
+            for (auto &view : views)
+                if (view.swapChain != nullptr)
+                    depth = std::min<uint64_t>(depth, view.swapChain->imageAvailableSemaphores.size());
+            uint64_t frame = timeline->submitted + 1;
+            if (frame > depth)
+                timeline->Wait(frame - depth);
+            timeline->Collect();
+            this->UpdateFrameInputs(0, 0);
+
+            std::vector<size_t> acquired; // view indices taking part in this frame
+            std::vector<uint32_t> imageIndices;
+            std::vector<VkSemaphore> waitSemaphores;
+            std::vector<VkPipelineStageFlags> waitStages;
+            std::vector<VkCommandBuffer> commandBuffers;
+            std::vector<VkSemaphore> signalSemaphores;
+            std::vector<VkSwapchainKHR> swapChains;
+            for (size_t idx = 0; idx < views.size(); idx++)
+            {
+                auto &view = views[idx];
+                if (view.swapChain == nullptr)
+                    continue;
+                const auto &semaphores = view.swapChain->imageAvailableSemaphores;
+                auto imageAvailableSemaphore = semaphores[frame % semaphores.size()];
+                uint32_t imageIdx;
+                auto status = vkAcquireNextImageKHR(device->handle, view.swapChain->handle, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIdx);
+                if (status == VK_ERROR_OUT_OF_DATE_KHR)
+                {
+                    view.stale = true;
+                    continue;
+                }
+                if (status != VK_SUCCESS && status != VK_SUBOPTIMAL_KHR)
+                    throw std::runtime_error("failed to acquire swap chain image!");
+                view.stale = status == VK_SUBOPTIMAL_KHR;
+
+                // the last frame drawn into this image must retire before its uniforms and command pools are reused
+                timeline->Wait(view.imageFrames[imageIdx]);
+                auto &program = programs[idx];
+                if (view.mouse.down && program.uniformLayout->Uses(ShaderInput::Mouse))
+                    view.mouse.position = this->CursorPosition(view.window->window);
+                FrameInputs viewInputs = frameInputs;
+                viewInputs.mouse = view.mouse;
+                viewInputs.resolution = glm::vec3(program.cell.extent.width, program.cell.extent.height, 1.0);
+                program.uniform->Update(*program.uniformLayout, viewInputs, imageIdx);
+                std::vector<DrawCall> draws = {{program.pipeline->handle, program.pipeline->layout, program.descriptorSet->handles[imageIdx], 0, {}, -1}};
+
+                acquired.push_back(idx);
+                imageIndices.push_back(imageIdx);
+                waitSemaphores.push_back(imageAvailableSemaphore);
+                waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+                commandBuffers.push_back(view.recorder->Record(imageIdx, view.renderPass->handle, view.framebuffer->handles[imageIdx], view.swapChain->extent, draws, nullptr));
+                signalSemaphores.push_back(view.swapChain->renderFinishedSemaphores[imageIdx]);
+                swapChains.push_back(view.swapChain->handle);
+            }
+            if (acquired.empty())
+            {
+                // everything is minimized or waiting to be rebuilt
+                if (!this->WindowsChanged())
+                    glfwWaitEvents();
+                continue;
+            }
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+            submitInfo.pWaitSemaphores = waitSemaphores.data();
+            submitInfo.pWaitDstStageMask = waitStages.data();
+            submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+            submitInfo.pCommandBuffers = commandBuffers.data();
+            submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+            submitInfo.pSignalSemaphores = signalSemaphores.data();
+            frame = timeline->Submit(submitInfo);
+            for (size_t slot = 0; slot < acquired.size(); slot++)
+                views[acquired[slot]].imageFrames[imageIndices[slot]] = frame;
+
+            std::vector<VkResult> results(acquired.size(), VK_SUCCESS);
+            VkPresentInfoKHR presentInfo{};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+            presentInfo.pWaitSemaphores = signalSemaphores.data();
+            presentInfo.swapchainCount = static_cast<uint32_t>(swapChains.size());
+            presentInfo.pSwapchains = swapChains.data();
+            presentInfo.pImageIndices = imageIndices.data();
+            presentInfo.pResults = results.data();
+            vkQueuePresentKHR(device->presentQueue, &presentInfo);
+            for (size_t slot = 0; slot < acquired.size(); slot++)
+            {
+                if (results[slot] == VK_ERROR_OUT_OF_DATE_KHR || results[slot] == VK_SUBOPTIMAL_KHR)
+                    views[acquired[slot]].stale = true;
+                else if (results[slot] != VK_SUCCESS)
+                    throw std::runtime_error("failed to present command buffer!");
+            }
 
-            RecordCommand(
-                commandBuffer->handles[idx],
-                renderPass->handle,
-                framebuffer->handles[idx],
-                swapChain->extent,
-                pipeline->handle,
-                pipeline->layout,
-                descriptorSets);
+            frameInputs.frame++;
+            for (size_t idx : acquired)
+                views[idx].mouse.clicked = false;
+            frameMilliseconds.Add(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count());
+            frames++;
+            if (options.frameLimit > 0 && frames >= options.frameLimit)
+                break;
         }
+        vkDeviceWaitIdle(device->handle);
+
+        if (frameMilliseconds.Count() > 0)
+            std::cout << std::fixed << std::setprecision(3)
+                      << "[WINDOWS] " << views.size() << " windows, " << frames << " frames of one submit and one present, cpu "
+                      << frameMilliseconds.Mean() << " ms/frame, p99 " << frameMilliseconds.Percentile(0.99) << " ms" << std::endl;
+        if (options.memoryReport)
+            device->allocator->Report(std::cout);
     }
 
     void Cleanup()
@@ -1667,8 +9392,45 @@ public:
             func(window->instance, debugMessenger, nullptr);
         }
 #endif
+        this->CloseWindows();
         this->CleanupExtent();
 
+        for (auto &program : programs)
+        {
+            if (program.uniformLayout != nullptr)
+                delete program.uniformLayout;
+            program.uniformLayout = nullptr;
+        }
+        if (timeline != nullptr)
+            delete timeline;
+        if (metrics != nullptr)
+            delete metrics;
+        if (traceWriter != nullptr)
+            delete traceWriter;
+        if (traceReader != nullptr)
+            delete traceReader;
+        if (checkerPass != nullptr)
+            delete checkerPass;
+        if (tilePass != nullptr)
+            delete tilePass;
+        if (intermediatePass != nullptr)
+            delete intermediatePass;
+        if (supersamplePass != nullptr)
+            delete supersamplePass;
+        if (accumulateClearPass != nullptr)
+            delete accumulateClearPass;
+        if (accumulateLoadPass != nullptr)
+            delete accumulateLoadPass;
+        if (framePacing != nullptr)
+            delete framePacing;
+        if (workers != nullptr)
+            delete workers;
+        if (placeholders != nullptr)
+            delete placeholders;
+        if (descriptorCache != nullptr)
+            delete descriptorCache;
+        if (pipelineLibraries != nullptr)
+            delete pipelineLibraries;
         if (device != nullptr)
             delete device;
         if (window != nullptr)
@@ -1677,35 +9439,202 @@ public:
 
 private:
     Application();
+    // the pipeline libraries key their parts by render pass handle, which a destroyed pass frees for the next one
+    void ForgetRenderPass(const RenderPass &pass)
+    {
+        if (pipelineLibraries != nullptr)
+            pipelineLibraries->Forget(pass.handle);
+    }
+    void CleanupProgramExtent(ShaderProgram &program)
+    {
+        if (program.pipeline != nullptr)
+            delete program.pipeline;
+        for (auto &pipeline : program.parityPipelines)
+        {
+            if (pipeline != nullptr)
+                delete pipeline;
+            pipeline = nullptr;
+        }
+        if (program.descriptorSet != nullptr)
+            delete program.descriptorSet;
+        if (program.uniform != nullptr)
+            delete program.uniform;
+        program.pipeline = nullptr;
+        program.descriptorSet = nullptr;
+        program.uniform = nullptr;
+    }
+    void CleanupViewExtent(WindowView &view)
+    {
+        if (view.recorder != nullptr)
+            delete view.recorder;
+        if (view.framebuffer != nullptr)
+            delete view.framebuffer;
+        if (view.renderPass != nullptr)
+        {
+            this->ForgetRenderPass(*view.renderPass);
+            delete view.renderPass;
+        }
+        view.recorder = nullptr;
+        view.framebuffer = nullptr;
+        view.renderPass = nullptr;
+    }
+    // the swap chains go before their surfaces, and every window but the application's own with them
+    void CloseWindows()
+    {
+        if (views.empty())
+            return;
+        vkDeviceWaitIdle(device->handle);
+        timeline->Collect();
+        for (size_t idx = 0; idx < views.size(); idx++)
+        {
+            auto &view = views[idx];
+            this->CleanupViewExtent(view);
+            if (view.swapChain != nullptr)
+                delete view.swapChain;
+            view.swapChain = nullptr;
+            if (idx > 0)
+                delete view.window;
+        }
+        views.clear();
+    }
     void CleanupExtent()
     {
-        if (commandBuffer != nullptr)
-            delete commandBuffer;
+        if (commandRecorder != nullptr)
+            delete commandRecorder;
+        commandRecorder = nullptr;
         if (framebuffer != nullptr)
             delete framebuffer;
-        if (pipeline != nullptr)
-            delete pipeline;
-        if (descriptorSet != nullptr)
-            delete descriptorSet;
-        if (uniform != nullptr)
-            delete uniform;
+        if (gpuTimer != nullptr)
+            delete gpuTimer;
+        gpuTimer = nullptr;
+        for (auto &program : programs)
+            this->CleanupProgramExtent(program);
+        this->CleanupProgramExtent(overlay);
+        this->CleanupProgramExtent(resolve);
+        if (accumulation != nullptr)
+            delete accumulation;
+        accumulation = nullptr;
+        if (tileTarget != nullptr)
+            delete tileTarget;
+        tileTarget = nullptr;
+        if (tiler != nullptr)
+            delete tiler;
+        tiler = nullptr;
+        if (intermediate != nullptr)
+            delete intermediate;
+        intermediate = nullptr;
+        if (supersampled != nullptr)
+            delete supersampled;
+        supersampled = nullptr;
+        this->CleanupProgramExtent(heatmap);
+        if (costImage != nullptr)
+            delete costImage;
+        costImage = nullptr;
+        heatmapTiles.clear();
+        heatmapTileMilliseconds.clear();
+        this->CleanupProgramExtent(reconstruct);
+        for (auto &target : checkerTargets)
+        {
+            if (target != nullptr)
+                delete target;
+            target = nullptr;
+        }
+        if (multisampleImage != nullptr)
+            delete multisampleImage;
+        multisampleImage = nullptr;
         if (renderPass != nullptr)
+        {
+            this->ForgetRenderPass(*renderPass);
             delete renderPass;
+        }
         if (swapChain != nullptr)
             delete swapChain;
     }
     Window *window;
     Device *device;
+    std::vector<WindowView> views; // --windows only, one per program
+    TraceWriter *traceWriter;      // --record
+    TraceReader *traceReader;      // --replay
+    uint64_t replayMismatches;     // replayed frames whose swap chain did not come out at the recorded size
     SwapChain *swapChain;
-    Pipeline *pipeline;
     Framebuffer *framebuffer;
     RenderPass *renderPass;
-    CommandBuffer *commandBuffer;
-    DescriptorSet *descriptorSet;
-    Uniform *uniform;
-    UniformBufferObject ubo;
-    size_t nextSemaphoreIdx;
-    std::string fragmentShaderSource;
+    CommandRecorder *commandRecorder;
+    WorkerPool *workers;
+    std::vector<std::vector<DrawCall>> frameDraws; // per swapchain image, re-recorded every frame
+    double recordMicroseconds;                     // cpu time spent recording since the last stats line
+    FrameTimeline *timeline;
+    std::vector<uint64_t> imageFrames; // per swapchain image, the last frame that rendered into it
+    Options options;
+    std::vector<ShaderSource> shaderSources;
+    std::vector<uint32_t> vertexShader;
+    std::vector<ShaderProgram> programs; // one per gallery cell, a single one otherwise
+    DescriptorCache *descriptorCache;
+    PipelineLibraries *pipelineLibraries; // nullptr without VK_EXT_graphics_pipeline_library
+    PlaceholderResources *placeholders;
+    FrameInputs frameInputs;
+    std::chrono::high_resolution_clock::time_point startTime;
+    std::chrono::high_resolution_clock::time_point lastFrameTime;
+
+    GpuTimer *gpuTimer; // one region per program
+    std::vector<double> cellMilliseconds; // smoothed, negative until the first result
+    std::vector<double> cellTotalMilliseconds;
+    std::vector<size_t> cellSamples;
+    ShaderProgram overlay;
+    std::vector<uint32_t> overlayVertexShader;
+
+    VkFormat accumulationFormat;
+    RenderPass *accumulateClearPass; // first sample
+    RenderPass *accumulateLoadPass;  // every later one
+    RenderTarget *accumulation;      // running sum, nullptr unless accumulating
+    ShaderProgram resolve;
+    std::vector<std::vector<DrawCall>> offscreenDraws; // per swapchain image, the shader's draws into the accumulation or tile target
+    uint32_t sampleCount;                               // frames summed into the target so far
+    MouseState accumulatedMouse;
+
+    RenderPass *tilePass;
+    RenderTarget *tileTarget; // the frame being assembled, nullptr unless tiled
+    TileScheduler *tiler;
+
+    RenderPass *intermediatePass;
+    RenderTarget *intermediate; // --target-format or --heatmap, nullptr otherwise
+    VkFormat intermediateFormat;
+
+    ShaderProgram heatmap;
+    CostImage *costImage;                        // --heatmap, nullptr otherwise
+    std::vector<VkRect2D> heatmapTiles;          // timed one by one when there is no shader clock, empty otherwise
+    std::vector<double> heatmapTileMilliseconds; // latest read back, by tile
+    float heatmapLow, heatmapHigh;               // cost mapped to either end of the color ramp
+    std::chrono::high_resolution_clock::time_point heatmapNextReport;
+
+    MultisampleImage *multisampleImage; // --msaa, the swapchain pass shades into it and resolves into the swapchain image
+    RenderPass *supersamplePass;
+    RenderTarget *supersampled; // --ssaa, nullptr otherwise
+
+    RenderPass *checkerPass;
+    std::array<RenderTarget *, 2> checkerTargets;               // half width, by frame parity
+    ShaderProgram reconstruct;
+    std::array<std::vector<std::vector<DrawCall>>, 2> checkerDraws; // [parity][swapchain image]
+    uint64_t checkerFrames;                                     // shaded since the targets were created
+
+    size_t statsFrames;
+    std::chrono::high_resolution_clock::time_point statsStart;
+    FramePacing *framePacing;
+    uint64_t presentId; // monotonically increasing across swapchains, as VK_KHR_present_id requires per swapchain
+    MetricsServer *metrics;
+    std::chrono::high_resolution_clock::time_point lastFrameStart;
+    double lastGpuMilliseconds; // sum over the timed draws of the latest frame read back, negative before the first
+    bool onDemand;              // the output only changes with resize or input, draw then and block otherwise
+    bool redrawRequested;
+
+    bool inputThread;                  // --input-thread with a window: events on the main thread, frames on another
+    InputState pendingInput;           // event thread's, built up by the callbacks
+    LatestSlot<InputState> inputSlot;  // event thread to render loop
+    InputState latestInput;            // render loop's, the last one taken from the slot
+    uint64_t latchedPresses;
+    uint64_t latchedDamage;
+    std::optional<std::chrono::high_resolution_clock::time_point> inputSampledAt; // of the input the next uniform write carries
+    SampleStats inputLatency;          // microseconds from sampling the input to writing it into the uniforms
 
 #ifdef ENABLE_VALIDATION_LAYERS
     VkDebugUtilsMessengerEXT debugMessenger;
@@ -1715,38 +9644,79 @@ private:
 int main(int argc, char **argv)
 {
     // parse args
-    std::string path;
-    if (argc == 1)
-    {
-        std::cout << "[INFO] selecting default shader file \'shader.frag\'" << std::endl;
-        path = "shader.frag";
-    }
-    else if (argc == 2)
+    Options options;
+    if (!parseOptions(argc, argv, options))
     {
-        path = argv[1];
+        printUsage();
+        return -1;
     }
-    else
+
+    std::vector<ShaderSource> shaderSources;
+    for (const auto &path : options.shaderPaths)
     {
-        std::cerr << "specify path to uncompiled fragment shader glsl source." << std::endl;
-        return -1;
+        std::cout << "[INFO] read fragment shader \'" << path << "\'" << std::endl;
+
+        std::ifstream srcFile(path, std::ios::binary);
+        if (srcFile.fail())
+        {
+            std::cerr << "[ERROR] file \'" + std::string(path) + "\' does not exist!" << std::endl;
+            return -1;
+        }
+        std::stringstream buffer;
+        buffer << srcFile.rdbuf();
+        if (isPrecompiled(path))
+        {
+            auto bytes = buffer.str();
+            std::vector<uint32_t> words(bytes.size() / sizeof(uint32_t));
+            memcpy(words.data(), bytes.data(), words.size() * sizeof(uint32_t));
+            if (bytes.size() % sizeof(uint32_t) != 0 || words.empty() || words[0] != spirv::MagicNumber)
+            {
+                std::cerr << "[ERROR] \'" + std::string(path) + "\' is not a spir-v module!" << std::endl;
+                return -1;
+            }
+            shaderSources.push_back({path, "", words});
+        }
+        else
+            shaderSources.push_back({path, buffer.str(), {}});
     }
-    std::cout << "[INFO] read fragment shader \'" << path << "\'" << std::endl;
 
-    std::ifstream srcFile(path);
-    if (srcFile.fail())
+    // static analysis only, no device needed
+    if (options.analyze)
     {
-        std::cerr << "[ERROR] file \'" + std::string(path) + "\' does not exist!" << std::endl;
-        return -1;
+        try
+        {
+            for (const auto &shaderSource : shaderSources)
+                std::cout << "[COST] " << shaderSource.path << ": " << costSummary(analyzeSpirvCost(shaderSource.spirv.empty() ? compileSpriv(shaderSource.source) : shaderSource.spirv)) << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
     }
-    std::stringstream buffer;
-    buffer << srcFile.rdbuf();
 
     // setup app
-    Application *app = new Application(buffer.str());
+    Application *app = new Application(shaderSources, options);
     try
     {
         app->Init();
-        app->Run();
+        if (options.recordBench > 0)
+            app->BenchmarkRecording(options.recordBench);
+        else if (options.checkerboardEval > 0)
+            app->EvaluateCheckerboard(options.checkerboardEval);
+        else if (options.compare)
+            app->Compare();
+        else if (options.formatBench > 0)
+            app->BenchmarkFormats(options.formatBench);
+        else if (options.aaBench > 0)
+            app->BenchmarkAntialiasing(options.aaBench);
+        else if (options.ablate > 0)
+            app->Ablate(options.ablate);
+        else if (options.windows)
+            app->RunWindows();
+        else
+            app->Run();
         app->Cleanup();
     }
     catch (const std::exception &e)
@@ -1758,4 +9728,4 @@ int main(int argc, char **argv)
 
     delete app;
     return 0;
-}
\ No newline at end of file
+}